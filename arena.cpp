@@ -0,0 +1,89 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        // Перед каждым узлом хранится указатель на арену, в которой он размещён, либо nullptr,
+        // если узел размещён в куче. Размер заголовка сохраняет выравнивание узла
+        constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+        static_assert(HEADER_SIZE >= sizeof(AstArena *));
+
+        constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+        thread_local AstArena *current_arena = nullptr;
+
+        constexpr size_t AlignUp(size_t size) {
+            return (size + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE;
+        }
+    }  // namespace
+
+    AstArena::Scope::Scope()
+            : arena_(new AstArena), previous_(current_arena) {
+        current_arena = arena_;
+    }
+
+    AstArena::Scope::~Scope() {
+        current_arena = previous_;
+        arena_->Release();
+    }
+
+    void *AstArena::AllocateNode(size_t size) {
+        AstArena *arena = current_arena;
+        std::byte *header;
+        if (arena) {
+            header = static_cast<std::byte *>(arena->Allocate(HEADER_SIZE + AlignUp(size)));
+            arena->ref_count_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            header = static_cast<std::byte *>(::operator new(HEADER_SIZE + size));
+        }
+        std::memcpy(header, &arena, sizeof(arena));
+        return header + HEADER_SIZE;
+    }
+
+    void AstArena::DeallocateNode(void *node) noexcept {
+        if (!node) {
+            return;
+        }
+        std::byte *header = static_cast<std::byte *>(node) - HEADER_SIZE;
+        AstArena *arena;
+        std::memcpy(&arena, header, sizeof(arena));
+        if (arena) {
+            arena->Release();
+        } else {
+            ::operator delete(header);
+        }
+    }
+
+    bool AstArena::Contains(const void *node) const {
+        const auto *p = static_cast<const std::byte *>(node);
+        return std::any_of(blocks_.begin(), blocks_.end(), [p](const Block &block) {
+            return p >= block.data.get() && p < block.data.get() + block.size;
+        });
+    }
+
+    void *AstArena::Allocate(size_t size) {
+        if (static_cast<size_t>(end_ - pos_) < size) {
+            // Остаток текущего блока не используется. Узел крупнее блока получает отдельный блок
+            const size_t block_size = std::max(size, BLOCK_SIZE);
+            blocks_.push_back({std::unique_ptr<std::byte[]>(new std::byte[block_size]), block_size});
+            pos_ = blocks_.back().data.get();
+            end_ = pos_ + block_size;
+        }
+        void *result = pos_;
+        pos_ += size;
+        return result;
+    }
+
+    void AstArena::Release() noexcept {
+        if (ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+}  // namespace runtime
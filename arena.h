@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace runtime {
+
+    /*
+     * Арена для узлов AST. Пока на потоке действует AstArena::Scope, узлы размещаются в блоках арены
+     * подряд, в порядке создания. Удаление узла лишь вызывает его деструктор, а блоки освобождаются
+     * все сразу, когда удалён последний размещённый в арене узел. Поэтому методы классов,
+     * пережившие дерево программы, остаются действительными
+     */
+    class AstArena {
+    public:
+        // Делает новую арену текущей для потока на время своей жизни
+        class Scope {
+        public:
+            Scope();
+
+            Scope(const Scope &) = delete;
+
+            Scope &operator=(const Scope &) = delete;
+
+            ~Scope();
+
+            [[nodiscard]] const AstArena &GetArena() const {
+                return *arena_;
+            }
+
+        private:
+            AstArena *arena_;
+            AstArena *previous_;
+        };
+
+        AstArena(const AstArena &) = delete;
+
+        AstArena &operator=(const AstArena &) = delete;
+
+        // Выделяет память под узел в текущей арене потока либо в куче, если арены нет
+        static void *AllocateNode(size_t size);
+
+        // Освобождает память узла, выделенную AllocateNode
+        static void DeallocateNode(void *node) noexcept;
+
+        // Возвращает true, если память узла выделена в этой арене
+        [[nodiscard]] bool Contains(const void *node) const;
+
+        [[nodiscard]] size_t GetBlockCount() const {
+            return blocks_.size();
+        }
+
+    private:
+        AstArena() = default;
+
+        ~AstArena() = default;
+
+        void *Allocate(size_t size);
+
+        void Release() noexcept;
+
+        struct Block {
+            std::unique_ptr<std::byte[]> data;
+            size_t size;
+        };
+
+        std::vector<Block> blocks_;
+        std::byte *pos_ = nullptr;
+        std::byte *end_ = nullptr;
+        // Число живых узлов арены плюс одна ссылка от Scope
+        std::atomic<size_t> ref_count_{1};
+    };
+
+}  // namespace runtime
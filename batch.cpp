@@ -0,0 +1,210 @@
+#include "batch.h"
+
+#include "lexer.h"
+#include "runtime.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <utility>
+
+using namespace std;
+
+namespace batch {
+
+    WorkStealingPool::WorkStealingPool(size_t thread_count) {
+        if (thread_count == 0) {
+            thread_count = std::max(1U, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < thread_count; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads_.emplace_back([this, i] {
+                WorkerLoop(i);
+            });
+        }
+    }
+
+    WorkStealingPool::~WorkStealingPool() {
+        {
+            std::lock_guard guard(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void WorkStealingPool::ForEach(size_t count, const Task &task) {
+        if (count == 0) {
+            return;
+        }
+        {
+            std::lock_guard guard(mutex_);
+            task_ = &task;
+            pending_.store(count);
+            // Соседние задачи достаются одному потоку, чужие задачи забираются с другого конца очереди
+            const size_t worker_count = workers_.size();
+            for (size_t worker = 0; worker < worker_count; ++worker) {
+                std::lock_guard worker_guard(workers_[worker]->mutex);
+                for (size_t index = count * worker / worker_count; index < count * (worker + 1) / worker_count; ++index) {
+                    workers_[worker]->tasks.push_back(index);
+                }
+            }
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [this] {
+            return pending_.load() == 0;
+        });
+        task_ = nullptr;
+        if (error_) {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+    void WorkStealingPool::WorkerLoop(size_t worker) {
+        size_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock lock(mutex_);
+                wake_.wait(lock, [this, seen_generation] {
+                    return stop_ || generation_ != seen_generation;
+                });
+                if (stop_) {
+                    return;
+                }
+                seen_generation = generation_;
+            }
+            // Задача получена из очереди под её мьютексом, поэтому task_ уже записан
+            while (auto index = TakeTask(worker)) {
+                try {
+                    (*task_)(*index, worker);
+                } catch (...) {
+                    std::lock_guard guard(mutex_);
+                    if (!error_) {
+                        error_ = std::current_exception();
+                    }
+                }
+                if (pending_.fetch_sub(1) == 1) {
+                    std::lock_guard guard(mutex_);
+                    done_.notify_all();
+                }
+            }
+        }
+    }
+
+    std::optional<size_t> WorkStealingPool::TakeTask(size_t worker) {
+        {
+            Worker &own = *workers_[worker];
+            std::lock_guard guard(own.mutex);
+            if (!own.tasks.empty()) {
+                const size_t index = own.tasks.front();
+                own.tasks.pop_front();
+                return index;
+            }
+        }
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            Worker &victim = *workers_[(worker + i) % workers_.size()];
+            std::lock_guard guard(victim.mutex);
+            if (!victim.tasks.empty()) {
+                const size_t index = victim.tasks.back();
+                victim.tasks.pop_back();
+                stolen_.fetch_add(1, std::memory_order_relaxed);
+                return index;
+            }
+        }
+        return std::nullopt;
+    }
+
+    ScriptResult RunScript(const std::string &path, const ParseOptions &options) {
+        using Clock = std::chrono::steady_clock;
+
+        ScriptResult result;
+        result.path = path;
+        const auto start = Clock::now();
+        auto run_start = start;
+        bool parsed = false;
+        try {
+            parse::MappedFile file(path);
+            parse::Lexer lexer(file.GetText());
+            auto program = ParseProgram(lexer, options);
+            run_start = Clock::now();
+            parsed = true;
+
+            // Вывод, сделанный до ошибки, сохраняется: приёмник сбрасывает буфер при уничтожении
+            runtime::StringSink sink(result.output);
+            runtime::SinkContext context(sink);
+            runtime::Closure globals;
+            program->Execute(globals, context);
+        } catch (const std::exception &e) {
+            result.error = e.what();
+        } catch (...) {
+            result.error = "Unknown error"s;
+        }
+        const auto end = Clock::now();
+        result.parse_time = (parsed ? run_start : end) - start;
+        result.run_time = parsed ? end - run_start : Clock::duration::zero();
+        return result;
+    }
+
+    std::vector<ScriptResult> RunBatch(WorkStealingPool &pool, const std::vector<std::string> &paths,
+                                       const ParseOptions &options) {
+        std::vector<ScriptResult> results(paths.size());
+        pool.ForEach(paths.size(), [&](size_t index, size_t worker) {
+            results[index] = RunScript(paths[index], options);
+            results[index].worker = worker;
+        });
+        return results;
+    }
+
+    std::vector<ScriptResult> RunBatch(const std::vector<std::string> &paths, const BatchOptions &options) {
+        size_t thread_count = options.thread_count;
+        if (thread_count == 0) {
+            thread_count = std::max(1U, std::thread::hardware_concurrency());
+        }
+        // Потоков не больше, чем сценариев
+        WorkStealingPool pool(std::min(thread_count, std::max<size_t>(paths.size(), 1)));
+        return RunBatch(pool, paths, options.parse_options);
+    }
+
+    void WriteOutputs(const std::vector<ScriptResult> &results, std::ostream &output) {
+        for (const auto &result : results) {
+            output << result.output;
+        }
+    }
+
+    void WriteTimingReport(const std::vector<ScriptResult> &results, std::ostream &report) {
+        auto to_ms = [](std::chrono::nanoseconds time) {
+            return std::chrono::duration<double, std::milli>(time).count();
+        };
+
+        const auto flags = report.flags();
+        const auto precision = report.precision();
+        report << std::fixed << std::setprecision(3);
+
+        std::chrono::nanoseconds total_parse{0};
+        std::chrono::nanoseconds total_run{0};
+        size_t failed = 0;
+        for (const auto &result : results) {
+            report << result.path << ": parse "sv << to_ms(result.parse_time) << " ms, run "sv
+                   << to_ms(result.run_time) << " ms, worker "sv << result.worker;
+            if (!result.Succeeded()) {
+                report << ", error: "sv << result.error;
+                ++failed;
+            }
+            report << '\n';
+            total_parse += result.parse_time;
+            total_run += result.run_time;
+        }
+        report << "total: "sv << results.size() << " scripts, "sv << failed << " failed, parse "sv
+               << to_ms(total_parse) << " ms, run "sv << to_ms(total_run) << " ms\n"sv;
+
+        report.flags(flags);
+        report.precision(precision);
+    }
+
+}  // namespace batch
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "parse.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace batch {
+
+    /*
+     * Пул потоков с перехватом работы (work stealing). Задачи пакета поровну распределяются
+     * по очередям потоков непрерывными блоками. Поток берёт задачи из начала своей очереди,
+     * а опустошив её, забирает задачи из конца очередей других потоков. Поэтому потоки,
+     * которым достались короткие задачи, помогают потокам с длинными.
+     * Пакеты выполняются по одному: ForEach нельзя вызывать одновременно из нескольких потоков
+     */
+    class WorkStealingPool {
+    public:
+        // Задача пакета: номер задачи и номер выполняющего её потока пула
+        using Task = std::function<void(size_t index, size_t worker)>;
+
+        // Создаёт пул из thread_count потоков. При thread_count == 0 потоков столько же, сколько ядер
+        explicit WorkStealingPool(size_t thread_count = 0);
+
+        WorkStealingPool(const WorkStealingPool &) = delete;
+
+        WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+        ~WorkStealingPool();
+
+        // Выполняет task для каждого номера из [0, count) и ждёт завершения всех задач.
+        // Первое исключение, выброшенное задачей, выбрасывается после завершения пакета
+        void ForEach(size_t count, const Task &task);
+
+        [[nodiscard]] size_t GetThreadCount() const {
+            return workers_.size();
+        }
+
+        // Возвращает количество задач, забранных из чужих очередей с момента создания пула
+        [[nodiscard]] size_t GetStolenCount() const {
+            return stolen_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<size_t> tasks;
+        };
+
+        void WorkerLoop(size_t worker);
+
+        // Возвращает номер следующей задачи потока worker либо пустой optional, если задач не осталось
+        std::optional<size_t> TakeTask(size_t worker);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::vector<std::thread> threads_;
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        // Номер текущего пакета. Поток пула просыпается, когда номер меняется
+        size_t generation_ = 0;
+        bool stop_ = false;
+        const Task *task_ = nullptr;
+        std::atomic<size_t> pending_{0};
+        std::atomic<size_t> stolen_{0};
+        std::exception_ptr error_;
+    };
+
+    // Результат выполнения одного сценария
+    struct ScriptResult {
+        std::string path;
+        // Вывод сценария. Если сценарий завершился ошибкой, содержит вывод до ошибки
+        std::string output;
+        // Сообщение об ошибке чтения, разбора либо выполнения. Пусто, если сценарий выполнен успешно
+        std::string error;
+        std::chrono::nanoseconds parse_time{0};
+        std::chrono::nanoseconds run_time{0};
+        // Номер потока пула, выполнившего сценарий
+        size_t worker = 0;
+
+        [[nodiscard]] bool Succeeded() const {
+            return error.empty();
+        }
+    };
+
+    // Параметры пакетного выполнения
+    struct BatchOptions {
+        // Количество потоков. 0 - по количеству ядер
+        size_t thread_count = 0;
+        ParseOptions parse_options;
+    };
+
+    // Выполняет программу из файла path в отдельном экземпляре интерпретатора:
+    // со своим деревом программы, глобальными переменными и контекстом вывода.
+    // Ошибки сценария не выбрасываются, а сохраняются в результате
+    ScriptResult RunScript(const std::string &path, const ParseOptions &options = {});
+
+    // Выполняет сценарии paths в пуле pool. Результаты возвращаются в порядке paths
+    std::vector<ScriptResult> RunBatch(WorkStealingPool &pool, const std::vector<std::string> &paths,
+                                       const ParseOptions &options = {});
+
+    // Выполняет сценарии paths в новом пуле потоков. Результаты возвращаются в порядке paths
+    std::vector<ScriptResult> RunBatch(const std::vector<std::string> &paths, const BatchOptions &options = {});
+
+    // Записывает в output выводы сценариев в порядке results
+    void WriteOutputs(const std::vector<ScriptResult> &results, std::ostream &output);
+
+    // Записывает в report время разбора и выполнения каждого сценария, ошибки и итог пакета
+    void WriteTimingReport(const std::vector<ScriptResult> &results, std::ostream &report);
+
+}  // namespace batch
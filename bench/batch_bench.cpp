@@ -0,0 +1,91 @@
+#include "../batch.h"
+#include "bench_runner.h"
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+    constexpr int SCRIPT_COUNT = 200;
+
+    // Записывает во временный каталог name сценарии, текст которых возвращает make_script(i)
+    template <typename MakeScript>
+    vector<string> WriteScripts(const string &name, MakeScript make_script) {
+        const auto directory = filesystem::temp_directory_path() / name;
+        filesystem::create_directories(directory);
+        vector<string> result;
+        for (int i = 0; i < SCRIPT_COUNT; ++i) {
+            const auto path = directory / ("script"s + to_string(i) + ".my"s);
+            ofstream(path) << make_script(i);
+            result.push_back(path.string());
+        }
+        return result;
+    }
+
+    // Небольшие сценарии разной длины с рекурсивными вызовами методов
+    const vector<string> &GetScripts() {
+        static const vector<string> paths = WriteScripts("mython_batch_bench"s, [](int i) {
+            return "class Fib:\n"
+                   "  def calc(n):\n"
+                   "    if n < 2:\n"
+                   "      return n\n"
+                   "    return self.calc(n - 1) + self.calc(n - 2)\n"
+                   "\n"
+                   "fib = Fib()\n"
+                   "print 'script', "s + to_string(i) + ", fib.calc("s + to_string(8 + i % 8) + ")\n"s;
+        });
+        return paths;
+    }
+
+    // Сценарии, создающие много объектов с полями
+    const vector<string> &GetObjectScripts() {
+        static const vector<string> paths = WriteScripts("mython_batch_objects_bench"s, [](int i) {
+            return "class Point:\n"
+                   "  def __init__(x, y):\n"
+                   "    self.x = x\n"
+                   "    self.y = y\n"
+                   "\n"
+                   "class Maker:\n"
+                   "  def make(n):\n"
+                   "    if n == 0:\n"
+                   "      return 0\n"
+                   "    p = Point(n, n)\n"
+                   "    return p.x + p.y + self.make(n - 1)\n"
+                   "\n"
+                   "m = Maker()\n"
+                   "print 'script', "s + to_string(i) + ", m.make("s + to_string(100 + i % 8 * 10) + ")\n"s;
+        });
+        return paths;
+    }
+
+    void BatchOneThread() {
+        static batch::WorkStealingPool pool(1);
+        DoNotOptimize(batch::RunBatch(pool, GetScripts()));
+    }
+
+    void BatchAllCores() {
+        static batch::WorkStealingPool pool;
+        DoNotOptimize(batch::RunBatch(pool, GetScripts()));
+    }
+
+    void BatchObjectsOneThread() {
+        static batch::WorkStealingPool pool(1);
+        DoNotOptimize(batch::RunBatch(pool, GetObjectScripts()));
+    }
+
+    void BatchObjectsAllCores() {
+        static batch::WorkStealingPool pool;
+        DoNotOptimize(batch::RunBatch(pool, GetObjectScripts()));
+    }
+
+}  // namespace
+
+void RunBatchBenchmarks(BenchRunner &br) {
+    RUN_BENCH(br, BatchOneThread, 10);
+    RUN_BENCH(br, BatchAllCores, 10);
+    RUN_BENCH(br, BatchObjectsOneThread, 10);
+    RUN_BENCH(br, BatchObjectsAllCores, 10);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Предотвращает удаление компилятором вычислений, результат которых не используется
+template<typename T>
+void DoNotOptimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class BenchRunner {
+public:
+    // Выполняет func iterations раз и выводит среднее время одной итерации
+    template<class BenchFunc>
+    double RunBench(BenchFunc func, const std::string &bench_name, std::int64_t iterations) {
+        using namespace std::chrono;
+
+        func();  // прогрев
+        const auto start = steady_clock::now();
+        for (std::int64_t i = 0; i < iterations; ++i) {
+            func();
+        }
+        const auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        const double ns_per_iteration = static_cast<double>(elapsed) / static_cast<double>(iterations);
+
+        std::cout << std::left << std::setw(48) << bench_name << std::right << std::setw(14)
+                  << std::fixed << std::setprecision(1) << ns_per_iteration << " ns/iter" << std::endl;
+        return ns_per_iteration;
+    }
+};
+
+#define RUN_BENCH(br, func, iterations) br.RunBench(func, #func, iterations)
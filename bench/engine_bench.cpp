@@ -0,0 +1,247 @@
+#include "../frozen_program.h"
+#include "../lexer.h"
+#include "../parse.h"
+#include "../statement.h"
+#include "../vm.h"
+#include "bench_runner.h"
+
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+    const string METHOD_HEAVY_PROGRAM = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+class Vector:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def dot(other):
+    return self.x * other.x + self.y * other.y
+
+class Sum:
+  def run(v, n):
+    if n == 0:
+      return 0
+    return v.dot(v) + self.run(v, n - 1)
+
+fib = Fib()
+sum = Sum()
+print fib.calc(20), sum.run(Vector(3, 4), 500)
+)";
+
+    const string RECURSIVE_FIB_PROGRAM = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+fib = Fib()
+print fib.calc(18)
+)";
+
+    // Метод с длинным телом, многократно читающий и присваивающий локальные переменные
+    string MakeLocalsHeavyProgram() {
+        ostringstream program;
+        program << "class Poly:\n"
+                   "  def eval(x, n):\n"
+                   "    if n == 0:\n"
+                   "      return 0\n"
+                   "    a = x\n"
+                   "    b = x + 1\n"
+                   "    c = x + 2\n";
+        for (int i = 0; i < 100; ++i) {
+            program << "    a = b + c - a\n"
+                       "    b = a * 2 - b\n"
+                       "    c = a + b - c - x\n";
+        }
+        program << "    return a + self.eval(x, n - 1)\n"
+                   "\n"
+                   "poly = Poly()\n"
+                   "print poly.eval(3, 50)\n";
+        return program.str();
+    }
+
+    // Выражения с константными подвыражениями и отрицательными литералами
+    const string CONSTANT_HEAVY_PROGRAM = R"(
+class Calc:
+  def run(x, n):
+    if n == 0:
+      return 0
+    a = x * (60 * 60) + -1
+    b = a - 24 * 7 + (x - 1) * 1 + 0
+    return a + b + -5 - -3 + self.run(x, n - 1)
+
+calc = Calc()
+print calc.run(2, 300)
+)";
+
+    // Отчёт из множества строк с числами, строками, логическими значениями и объектами
+    string MakePrintHeavyProgram() {
+        ostringstream program;
+        program << "class Cell:\n"
+                   "  def __init__(v):\n"
+                   "    self.v = v\n"
+                   "  def __str__():\n"
+                   "    return '[' + str(self.v) + ']'\n"
+                   "c = Cell(42)\n";
+        for (int i = 0; i < 2000; ++i) {
+            program << "print " << i << ", " << i * 1000 + 7 << ", 'name', " << -i << ", True, None, c, "
+                    << i % 10 << "\n";
+        }
+        return program.str();
+    }
+
+    // Программа, собирающая строки из чисел, логических значений и объектов с __str__
+    string MakeStringifyProgram() {
+        ostringstream program;
+        program << "class Cell:\n"
+                   "  def __init__(v):\n"
+                   "    self.v = v\n"
+                   "  def __str__():\n"
+                   "    return str(self.v)\n"
+                   "c = Cell(42)\n";
+        for (int i = 0; i < 2000; ++i) {
+            program << "s = str(" << i * 1000 + 7 << ") + str(True) + str(None) + str(c) + str('x')\n";
+        }
+        return program.str();
+    }
+
+    unique_ptr<ast::Statement> Parse(const string &program) {
+        istringstream input(program);
+        parse::Lexer lexer(input);
+        return ParseProgram(lexer);
+    }
+
+    void AstMethodCalls() {
+        static const auto program = Parse(METHOD_HEAVY_PROGRAM);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+        DoNotOptimize(context.output);
+    }
+
+    void BytecodeMethodCalls() {
+        static const auto program = Parse(METHOD_HEAVY_PROGRAM);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        vm::VirtualMachine{}.Run(*program, closure, context);
+        DoNotOptimize(context.output);
+    }
+
+    void AstRecursiveFib() {
+        static const auto program = Parse(RECURSIVE_FIB_PROGRAM);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+        DoNotOptimize(context.output);
+    }
+
+    void AstManyLocals() {
+        static const auto program = Parse(MakeLocalsHeavyProgram());
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+        DoNotOptimize(context.output);
+    }
+
+    void AstConstantExpressions() {
+        static const auto program = Parse(CONSTANT_HEAVY_PROGRAM);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+        DoNotOptimize(context.output);
+    }
+
+    void AstStringify() {
+        static const auto program = Parse(MakeStringifyProgram());
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program->Execute(closure, context);
+        DoNotOptimize(closure);
+    }
+
+    // Вывод через std::ostream, каждый элемент форматируется потоком
+    void AstPrintToStream() {
+        static const auto program = Parse(MakePrintHeavyProgram());
+        static ofstream null_output("/dev/null");
+        runtime::SimpleContext context{null_output};
+        runtime::Closure closure;
+        program->Execute(closure, context);
+        null_output.flush();
+    }
+
+    // Вывод через буферизованный приёмник, который пишет в файл крупными блоками
+    void AstPrintToSink() {
+        static const auto program = Parse(MakePrintHeavyProgram());
+        static const int null_fd = open("/dev/null", O_WRONLY);
+        runtime::FileSink sink{null_fd};
+        runtime::SinkContext context{sink};
+        runtime::Closure closure;
+        program->Execute(closure, context);
+    }
+
+    // Замороженная программа выполняется FROZEN_RUNS раз в одном потоке либо поровну в FROZEN_THREADS потоках
+    constexpr size_t FROZEN_RUNS = 8;
+    constexpr size_t FROZEN_THREADS = 4;
+
+    const runtime::FrozenProgram &GetFrozenMethodHeavyProgram() {
+        static const auto program = [] {
+            parse::Lexer lexer(string_view{METHOD_HEAVY_PROGRAM});
+            return ParseFrozenProgram(lexer);
+        }();
+        return *program;
+    }
+
+    void FrozenRunsSerial() {
+        const auto &program = GetFrozenMethodHeavyProgram();
+        for (size_t i = 0; i < FROZEN_RUNS; ++i) {
+            runtime::DummyContext context;
+            program.Run(context);
+            DoNotOptimize(context.output);
+        }
+    }
+
+    void FrozenRunsParallel() {
+        const auto &program = GetFrozenMethodHeavyProgram();
+        vector<thread> threads;
+        for (size_t t = 0; t < FROZEN_THREADS; ++t) {
+            threads.emplace_back([&program] {
+                for (size_t i = 0; i < FROZEN_RUNS / FROZEN_THREADS; ++i) {
+                    runtime::DummyContext context;
+                    program.Run(context);
+                    DoNotOptimize(context.output);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+}  // namespace
+
+void RunEngineBenchmarks(BenchRunner &br) {
+    RUN_BENCH(br, AstMethodCalls, 20);
+    RUN_BENCH(br, BytecodeMethodCalls, 20);
+    RUN_BENCH(br, AstRecursiveFib, 50);
+    RUN_BENCH(br, AstManyLocals, 200);
+    RUN_BENCH(br, AstConstantExpressions, 200);
+    RUN_BENCH(br, AstStringify, 50);
+    RUN_BENCH(br, AstPrintToStream, 50);
+    RUN_BENCH(br, AstPrintToSink, 50);
+    RUN_BENCH(br, FrozenRunsSerial, 5);
+    RUN_BENCH(br, FrozenRunsParallel, 5);
+}
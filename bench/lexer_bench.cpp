@@ -0,0 +1,125 @@
+#include "../lexer.h"
+#include "../parse.h"
+#include "../runtime.h"
+#include "../serialize.h"
+#include "bench_runner.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+    // Крупный сгенерированный сценарий с комментариями, строками и вложенными блоками
+    const string &GetLargeScript() {
+        static const string script = [] {
+            ostringstream program;
+            for (int i = 0; i < 2000; ++i) {
+                program << "# class number " << i << " with a fairly long descriptive comment line\n"
+                           "class Generated" << i << ":\n"
+                           "  def __init__(first_value, second_value):\n"
+                           "    self.first_value = first_value  # stored as is\n"
+                           "    self.second_value = second_value\n"
+                           "\n"
+                           "  def describe(prefix):\n"
+                           "    if self.first_value >= self.second_value:\n"
+                           "      return prefix + 'first value is not less than the second one'\n"
+                           "    else:\n"
+                           "      return prefix + \"second value is \\\"greater\\\"\"\n"
+                           "\n"
+                           "instance_" << i << " = Generated" << i << "(" << i << ", " << i * 7 << ")\n"
+                           "print instance_" << i << ".describe('item: ')\n";
+            }
+            return program.str();
+        }();
+        return script;
+    }
+
+    // Сценарий из длинных комментариев, идентификаторов и строк с глубокими отступами
+    const string &GetCommentHeavyScript() {
+        static const string script = [] {
+            const string comment(200, '-');
+            ostringstream program;
+            for (int i = 0; i < 2000; ++i) {
+                program << "# " << comment << "\n"
+                           "class VeryLongGeneratedClassNameNumber" << i << ":\n"
+                           "  def very_long_generated_method_name_for_benchmark():\n"
+                           "    # " << comment << "\n"
+                           "    if self.rather_long_field_name_used_for_benchmark_purposes_only:\n"
+                           "      # " << comment << "\n"
+                           "      return 'a rather long string literal that spans most of the line width ok'\n"
+                           "    return None  # " << comment << "\n";
+            }
+            return program.str();
+        }();
+        return script;
+    }
+
+    size_t CountTokens(const string &script) {
+        parse::Lexer lexer(string_view{script});
+        size_t count = 1;
+        for (; !lexer.CurrentToken().Is<parse::token_type::Eof>(); lexer.NextToken()) {
+            ++count;
+        }
+        return count;
+    }
+
+    void LexStream() {
+        istringstream input(GetLargeScript());
+        parse::Lexer lexer(input);
+        size_t count = 1;
+        for (; !lexer.CurrentToken().Is<parse::token_type::Eof>(); lexer.NextToken()) {
+            ++count;
+        }
+        DoNotOptimize(count);
+    }
+
+    void LexBuffer() {
+        DoNotOptimize(CountTokens(GetLargeScript()));
+    }
+
+    void LexCommentHeavy() {
+        DoNotOptimize(CountTokens(GetCommentHeavyScript()));
+    }
+
+    void ParseSequential() {
+        parse::Lexer lexer(string_view{GetLargeScript()});
+        DoNotOptimize(ParseProgram(lexer).get());
+    }
+
+    // Лексемы читаются в фоновом потоке одновременно с работой парсера
+    void ParsePipelined() {
+        parse::Lexer lexer(string_view{GetLargeScript()}, parse::Lexer::DEFAULT_LOOKAHEAD, parse::LexerMode::PIPELINED);
+        DoNotOptimize(ParseProgram(lexer).get());
+    }
+
+    // Тела методов только пропускаются и разбираются при первом вызове, которого здесь нет
+    void ParseLazy() {
+        parse::Lexer lexer(string_view{GetLargeScript()});
+        DoNotOptimize(ParseProgram(lexer, ParseOptions{true}).get());
+    }
+
+    // Программа восстанавливается из образа без лексического и синтаксического разбора
+    void LoadImage() {
+        static const string image = [] {
+            parse::Lexer lexer(string_view{GetLargeScript()});
+            return serialize::SerializeProgram(*ParseProgram(lexer));
+        }();
+        DoNotOptimize(serialize::DeserializeProgram(image).get());
+    }
+
+}  // namespace
+
+void RunLexerBenchmarks(BenchRunner &br) {
+    RUN_BENCH(br, LexStream, 20);
+    const double ns_per_script = RUN_BENCH(br, LexBuffer, 20);
+    std::cout << std::left << std::setw(48) << "LexBuffer throughput" << std::right << std::setw(14)
+              << static_cast<double>(CountTokens(GetLargeScript())) / ns_per_script * 1e3 << " Mtokens/s" << std::endl;
+    const double ns_per_comment_heavy = RUN_BENCH(br, LexCommentHeavy, 20);
+    std::cout << std::left << std::setw(48) << "LexCommentHeavy throughput" << std::right << std::setw(14)
+              << static_cast<double>(GetCommentHeavyScript().size()) / ns_per_comment_heavy << " GB/s" << std::endl;
+    RUN_BENCH(br, ParseSequential, 20);
+    RUN_BENCH(br, ParsePipelined, 20);
+    RUN_BENCH(br, ParseLazy, 20);
+    RUN_BENCH(br, LoadImage, 20);
+}
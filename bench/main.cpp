@@ -0,0 +1,15 @@
+#include "bench_runner.h"
+
+void RunEngineBenchmarks(BenchRunner &br);
+void RunObjectBenchmarks(BenchRunner &br);
+void RunLexerBenchmarks(BenchRunner &br);
+void RunBatchBenchmarks(BenchRunner &br);
+
+int main() {
+    BenchRunner br;
+    RunEngineBenchmarks(br);
+    RunObjectBenchmarks(br);
+    RunLexerBenchmarks(br);
+    RunBatchBenchmarks(br);
+    return 0;
+}
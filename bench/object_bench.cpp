@@ -0,0 +1,164 @@
+#include "../runtime.h"
+#include "bench_runner.h"
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+    constexpr int OBJECT_COUNT = 1000;
+
+    // Набор объектов всех встроенных типов, по которому выполняются проверки типа
+    const vector<runtime::ObjectHolder> &GetObjects() {
+        static const auto objects = [] {
+            static runtime::Class cls{"Bench"s, {}, nullptr};
+            vector<runtime::ObjectHolder> result;
+            for (int i = 0; i < OBJECT_COUNT; ++i) {
+                switch (i % 5) {
+                    case 0:
+                        result.push_back(runtime::ObjectHolder::Own(runtime::Number{i}));
+                        break;
+                    case 1:
+                        result.push_back(runtime::ObjectHolder::Own(runtime::String{to_string(i)}));
+                        break;
+                    case 2:
+                        result.push_back(runtime::ObjectHolder::Own(runtime::Bool{i % 2 == 0}));
+                        break;
+                    case 3:
+                        result.push_back(runtime::ObjectHolder::Own(runtime::ClassInstance{cls}));
+                        break;
+                    default:
+                        result.push_back(runtime::ObjectHolder::None());
+                }
+            }
+            return result;
+        }();
+        return objects;
+    }
+
+    // Прежняя реализация IsTrue, основанная на цепочке dynamic_cast
+    bool LegacyIsTrue(const runtime::ObjectHolder &object) {
+        const runtime::Object *ptr = object.Get();
+        if (ptr == nullptr) {
+            return false;
+        } else if (auto bool_ptr = dynamic_cast<const runtime::Bool *>(ptr)) {
+            return bool_ptr->GetValue();
+        } else if (auto num_ptr = dynamic_cast<const runtime::Number *>(ptr)) {
+            return num_ptr->GetValue() != 0;
+        } else if (auto str_ptr = dynamic_cast<const runtime::String *>(ptr)) {
+            return !str_ptr->GetValue().empty();
+        } else if (dynamic_cast<const runtime::Class *>(ptr) || dynamic_cast<const runtime::ClassInstance *>(ptr)) {
+            return false;
+        }
+        return true;
+    }
+
+    void DynamicCastIsTrue() {
+        int count = 0;
+        for (const auto &object : GetObjects()) {
+            count += LegacyIsTrue(object);
+        }
+        DoNotOptimize(count);
+    }
+
+    void TypeTagIsTrue() {
+        int count = 0;
+        for (const auto &object : GetObjects()) {
+            count += runtime::IsTrue(object);
+        }
+        DoNotOptimize(count);
+    }
+
+    void DynamicCastTryAs() {
+        int count = 0;
+        for (const auto &object : GetObjects()) {
+            count += dynamic_cast<const runtime::ClassInstance *>(object.Get()) != nullptr;
+        }
+        DoNotOptimize(count);
+    }
+
+    void TypeTagTryAs() {
+        int count = 0;
+        for (const auto &object : GetObjects()) {
+            count += object.TryAs<runtime::ClassInstance>() != nullptr;
+        }
+        DoNotOptimize(count);
+    }
+
+    void TypeTagEqual() {
+        runtime::DummyContext context;
+        const auto &objects = GetObjects();
+        int count = 0;
+        for (size_t i = 0; i + 5 < objects.size(); i += 5) {
+            count += runtime::Equal(objects[i], objects[i + 5], context);
+            count += runtime::Equal(objects[i + 1], objects[i + 6], context);
+            count += runtime::Equal(objects[i + 2], objects[i + 7], context);
+        }
+        DoNotOptimize(count);
+    }
+
+    // Цепочка наследования из HIERARCHY_DEPTH классов, метод объявлен только в корневом
+    constexpr int HIERARCHY_DEPTH = 8;
+
+    const runtime::Class &GetDeepHierarchy() {
+        static const auto classes = [] {
+            vector<unique_ptr<runtime::Class>> result;
+            vector<runtime::Method> methods;
+            methods.push_back({"base_method"s, {"x"s}, nullptr});
+            result.push_back(make_unique<runtime::Class>("Level0"s, std::move(methods), nullptr));
+            for (int i = 1; i < HIERARCHY_DEPTH; ++i) {
+                result.push_back(make_unique<runtime::Class>("Level"s + to_string(i), vector<runtime::Method>{},
+                                                             result.back().get()));
+            }
+            return result;
+        }();
+        return *classes.back();
+    }
+
+    void DeepHierarchyMethodLookup() {
+        static runtime::ClassInstance instance{GetDeepHierarchy()};
+        const runtime::Symbol method_name{"base_method"};
+        int count = 0;
+        for (int i = 0; i < OBJECT_COUNT; ++i) {
+            count += instance.HasMethod(method_name, 1);
+        }
+        DoNotOptimize(count);
+    }
+
+    // Прежняя реализация Share: невладеющий shared_ptr с управляющим блоком в куче
+    void SharedPtrShare() {
+        static runtime::ClassInstance instance{GetDeepHierarchy()};
+        int count = 0;
+        for (int i = 0; i < OBJECT_COUNT; ++i) {
+            shared_ptr<runtime::Object> self(&instance, [](auto * /*p*/) {});
+            auto copy = self;
+            count += copy.get() == &instance;
+        }
+        DoNotOptimize(count);
+    }
+
+    void BorrowedShare() {
+        static runtime::ClassInstance instance{GetDeepHierarchy()};
+        int count = 0;
+        for (int i = 0; i < OBJECT_COUNT; ++i) {
+            auto self = runtime::ObjectHolder::Share(instance);
+            auto copy = self;
+            count += copy.Get() == &instance;
+        }
+        DoNotOptimize(count);
+    }
+
+}  // namespace
+
+void RunObjectBenchmarks(BenchRunner &br) {
+    RUN_BENCH(br, DynamicCastIsTrue, 20000);
+    RUN_BENCH(br, TypeTagIsTrue, 20000);
+    RUN_BENCH(br, DynamicCastTryAs, 20000);
+    RUN_BENCH(br, TypeTagTryAs, 20000);
+    RUN_BENCH(br, TypeTagEqual, 20000);
+    RUN_BENCH(br, DeepHierarchyMethodLookup, 20000);
+    RUN_BENCH(br, SharedPtrShare, 20000);
+    RUN_BENCH(br, BorrowedShare, 20000);
+}
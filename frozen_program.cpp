@@ -0,0 +1,44 @@
+#include "frozen_program.h"
+
+#include "statement.h"
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        // Сохраняет классы, объявленные в node, и разбирает отложенные тела их методов
+        void Freeze(Executable &node, vector<ObjectHolder> &classes) {  // NOLINT
+            if (const auto *class_def = dynamic_cast<const ast::ClassDefinition *>(&node)) {
+                const ObjectHolder &cls = class_def->GetClass();
+                classes.push_back(cls);
+                for (const auto &method : cls.TryAs<Class>()->GetMethods()) {
+                    if (method.body) {
+                        Freeze(method.body->Prepare(), classes);
+                    }
+                }
+            }
+            node.ForEachChild([&classes](unique_ptr<Executable> &child) {
+                if (child) {
+                    Freeze(*child, classes);
+                }
+            });
+        }
+    }  // namespace
+
+    FrozenProgram::FrozenProgram(unique_ptr<Executable> program)
+            : program_(std::move(program)) {
+        Freeze(*program_, classes_);
+    }
+
+    Closure FrozenProgram::Run(Context &context) const {
+        Closure globals;
+        Run(globals, context);
+        return globals;
+    }
+
+    void FrozenProgram::Run(Closure &globals, Context &context) const {
+        program_->Execute(globals, context);
+    }
+
+}  // namespace runtime
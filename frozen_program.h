@@ -0,0 +1,48 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <memory>
+
+namespace runtime {
+
+    /*
+     * Замороженная программа: разобранное дерево вместе с его константами и классами, которое
+     * после создания только читается. Одну замороженную программу можно одновременно выполнять
+     * из нескольких потоков, каждое выполнение получает собственные глобальные переменные и контекст.
+     * Кеши точек вызова методов и доступа к полям в дереве общие для всех выполнений и обновляются
+     * без блокировок, а стек вызовов у каждого потока свой.
+     * Программа должна пережить все свои выполнения и созданные ими объекты
+     */
+    class FrozenProgram {
+    public:
+        // Замораживает программу program. Отложенные тела методов разбираются сразу,
+        // поэтому ошибки в них выбрасываются из конструктора
+        explicit FrozenProgram(std::unique_ptr<Executable> program);
+
+        FrozenProgram(const FrozenProgram &) = delete;
+
+        FrozenProgram &operator=(const FrozenProgram &) = delete;
+
+        // Выполняет программу с новыми глобальными переменными и возвращает их
+        Closure Run(Context &context) const;
+
+        // Выполняет программу с глобальными переменными globals
+        void Run(Closure &globals, Context &context) const;
+
+        [[nodiscard]] const Executable &GetProgram() const {
+            return *program_;
+        }
+
+        // Возвращает количество классов программы
+        [[nodiscard]] size_t GetClassCount() const {
+            return classes_.size();
+        }
+
+    private:
+        std::unique_ptr<Executable> program_;
+        // Классы программы, в том числе объявленные в отложенных телах методов
+        std::vector<ObjectHolder> classes_;
+    };
+
+}  // namespace runtime
@@ -1,10 +1,28 @@
 #include "lexer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <charconv>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <thread>
 #include <unordered_map>
 #include <cassert>
-#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -77,223 +95,690 @@ if (rhs.Is<type>()) return os << #type;
         return os << "Unknown token :("sv;
     }
 
-    Lexer::Lexer(std::istream &input)
-            : in_(input) {
-        NextToken();
+    MappedFile::MappedFile(const std::string &path) {
+#if defined(__unix__) || defined(__APPLE__)
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            throw std::runtime_error("Cannot open file "s + path);
+        }
+        struct stat st{};
+        if (fstat(fd, &st) == -1) {
+            close(fd);
+            throw std::runtime_error("Cannot read file "s + path);
+        }
+        // Пустой файл отобразить невозможно, ему соответствует пустой текст
+        if (st.st_size > 0) {
+            const auto size = static_cast<size_t>(st.st_size);
+            void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED) {
+                throw std::runtime_error("Cannot map file "s + path);
+            }
+            text_ = std::string_view(static_cast<const char *>(data), size);
+        } else {
+            close(fd);
+        }
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open file "s + path);
+        }
+        contents_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        text_ = contents_;
+#endif
     }
 
-    const Token &Lexer::CurrentToken() const {
-        assert(!tokens_.empty());
-        return tokens_.at(curr_pos_);
+    MappedFile::~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (!text_.empty()) {
+            munmap(const_cast<char *>(text_.data()), text_.size());
+        }
+#endif
     }
 
-    Token Lexer::NextToken() {
-        if (static_cast<size_t>(++curr_pos_) == tokens_.size()) {
-            if (!tokens_.empty() && tokens_.back().Is<token_type::Eof>()) {
-                --curr_pos_;
-                return tokens_.back();
+    /*
+     * Кольцевая очередь без блокировок для одного производителя (фоновый поток чтения)
+     * и одного потребителя (парсер). Каждая сторона кэширует индекс другой стороны
+     * и перечитывает атомарный индекс, только когда кэшированного значения недостаточно
+     */
+    struct Lexer::Pipeline {
+        // Элемент очереди: лексема либо ошибка, возникшая при её чтении
+        struct Entry {
+            Token token;
+            size_t offset = 0;
+            std::string escaped;
+            // Значение лексемы String ссылается на escaped
+            bool has_escaped = false;
+            std::exception_ptr error;
+        };
+
+        // Степень двойки, чтобы номер ячейки вычислялся маской
+        static constexpr size_t CAPACITY = 512;
+        static constexpr size_t CACHE_LINE = 64;
+
+        Pipeline()
+                : entries(CAPACITY) {
+        }
+
+        Pipeline(const Pipeline &) = delete;
+
+        Pipeline &operator=(const Pipeline &) = delete;
+
+        // Вызывается и при исключении в конструкторе Lexer, поэтому поток останавливается здесь
+        ~Pipeline() {
+            stopped.store(true, std::memory_order_relaxed);
+            if (producer.joinable()) {
+                producer.join();
             }
-            TextLine line;
-            for (line = TextLine::ReadLine(in_);
-                 line.IsEmpty();
-                 line = TextLine::ReadLine(in_));
-            if (line.indent_ % 2 != 0) throw LexerError("Bad indent size.");
-            if (!line.IsEofOnly() && line.indent_ > current_indent_) {
-                for (int i = 0; i < (line.indent_ - current_indent_) / 2; ++i) {
-                    tokens_.emplace_back(token_type::Indent{});
+        }
+
+        // Вызывается производителем. Ожидает свободную ячейку.
+        // Возвращает nullptr, если Lexer разрушается и чтение нужно прекратить
+        Entry *AcquireWrite() {
+            while (write - cached_read == CAPACITY) {
+                cached_read = read_index.load(std::memory_order_acquire);
+                if (write - cached_read == CAPACITY) {
+                    if (stopped.load(std::memory_order_relaxed)) {
+                        return nullptr;
+                    }
+                    std::this_thread::yield();
                 }
-                current_indent_ = line.indent_;
             }
-            if (!line.IsEofOnly() && line.indent_ < current_indent_) {
-                for (int i = 0; i < (current_indent_ - line.indent_) / 2; ++i) {
-                    tokens_.emplace_back(token_type::Dedent{});
+            return &entries[write & (CAPACITY - 1)];
+        }
+
+        void Publish() {
+            write_index.store(++write, std::memory_order_release);
+        }
+
+        // Вызывается потребителем. Ожидает, пока производитель опубликует очередной элемент
+        Entry &AcquireRead() {
+            while (read == cached_write) {
+                cached_write = write_index.load(std::memory_order_acquire);
+                if (read == cached_write) {
+                    std::this_thread::yield();
                 }
-                current_indent_ = line.indent_;
             }
-            if (line.IsEofOnly() && current_indent_ > 0) {
-                for (int i = 0; i < current_indent_ / 2; ++i) {
-                    tokens_.emplace_back(token_type::Dedent{});
-                }
-                current_indent_ = line.indent_;
+            return entries[read & (CAPACITY - 1)];
+        }
+
+        void Release() {
+            read_index.store(++read, std::memory_order_release);
+        }
+
+        std::vector<Entry> entries;
+        std::atomic<bool> stopped{false};
+        std::thread producer;
+
+        // Индексы производителя и потребителя лежат в разных кэш-линиях
+        alignas(CACHE_LINE) std::atomic<size_t> write_index{0};
+        size_t write = 0;
+        size_t cached_read = 0;
+
+        alignas(CACHE_LINE) std::atomic<size_t> read_index{0};
+        size_t read = 0;
+        size_t cached_write = 0;
+    };
+
+    Lexer::Lexer(std::istream &input, size_t lookahead, LexerMode mode)
+            : source_(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()),
+              begin_(source_.data()),
+              pos_(source_.data()),
+              end_(source_.data() + source_.size()),
+              window_(lookahead + 1) {
+        Start(mode);
+    }
+
+    Lexer::Lexer(std::string_view source, size_t lookahead, LexerMode mode)
+            : begin_(source.data()),
+              pos_(source.data()),
+              end_(source.data() + source.size()),
+              window_(lookahead + 1) {
+        Start(mode);
+    }
+
+    Lexer::~Lexer() = default;
+
+    void Lexer::Start(LexerMode mode) {
+        if (mode == LexerMode::PIPELINED) {
+            pipeline_ = std::make_unique<Pipeline>();
+            pipeline_->producer = std::thread([this] {
+                Produce();
+            });
+        }
+        for (auto &slot : window_) {
+            ReadToken(slot);
+        }
+    }
+
+    void Lexer::ReadToken(Slot &slot) {
+        if (!pipeline_) {
+            slot.token = ScanTokenAt(slot.offset, slot.escaped);
+            return;
+        }
+        Pipeline::Entry &entry = pipeline_->AcquireRead();
+        // Ошибка и конец файла остаются в очереди, поэтому повторные вызовы вернут их снова
+        if (entry.error) {
+            std::rethrow_exception(entry.error);
+        }
+        slot.offset = entry.offset;
+        if (entry.token.Is<token_type::Eof>()) {
+            slot.token = entry.token;
+            return;
+        }
+        if (entry.has_escaped) {
+            // Раскрытая строка переходит в ячейку окна, а её прежний буфер - в очередь
+            slot.escaped.swap(entry.escaped);
+            slot.token = token_type::String{slot.escaped};
+        } else {
+            slot.token = entry.token;
+        }
+        pipeline_->Release();
+    }
+
+    void Lexer::Produce() {
+        Pipeline &pipeline = *pipeline_;
+        while (Pipeline::Entry *entry = pipeline.AcquireWrite()) {
+            bool finished;
+            try {
+                entry->token = ScanTokenAt(entry->offset, entry->escaped);
+                const auto *str = entry->token.TryAs<token_type::String>();
+                entry->has_escaped = str && str->value.data() == entry->escaped.data();
+                finished = entry->token.Is<token_type::Eof>();
+            } catch (...) {
+                entry->error = std::current_exception();
+                finished = true;
             }
-            for (const auto &t: line.tokens_) {
-                tokens_.emplace_back(t);
+            pipeline.Publish();
+            if (finished) {
+                return;
             }
         }
-        return tokens_.at(curr_pos_);
     }
 
+    const Token &Lexer::CurrentToken() const {
+        return window_[head_].token;
+    }
+
+    Token Lexer::NextToken() {
+        if (!CurrentToken().Is<token_type::Eof>()) {
+            // Ячейка текущей лексемы освобождается и заполняется самой дальней лексемой окна
+            ReadToken(window_[head_]);
+            head_ = (head_ + 1) % window_.size();
+        }
+        return CurrentToken();
+    }
+
+    const Token &Lexer::PeekToken(size_t distance) const {
+        if (distance >= window_.size()) {
+            throw std::out_of_range("Lookahead distance exceeds the lexer window"s);
+        }
+        return window_[(head_ + distance) % window_.size()].token;
+    }
+
+    size_t Lexer::GetLookahead() const {
+        return window_.size() - 1;
+    }
+
+    std::string_view Lexer::GetSource() const {
+        return {begin_, static_cast<size_t>(end_ - begin_)};
+    }
+
+    size_t Lexer::GetTokenOffset(size_t distance) const {
+        if (distance >= window_.size()) {
+            throw std::out_of_range("Lookahead distance exceeds the lexer window"s);
+        }
+        return window_[(head_ + distance) % window_.size()].offset;
+    }
+
+    namespace {
+        // Класс символа, определяющий переход сканера из начального состояния
+        enum class CharClass : std::uint8_t {
+            OTHER,       // односимвольная лексема Char
+            SPACE,
+            NEWLINE,
+            COMMENT,
+            QUOTE,
+            DIGIT,
+            ID_START,    // буква или _
+            COMPARISON,  // первый символ лексем ==, !=, <=, >=
+        };
+
+        constexpr std::array<CharClass, 256> MakeCharClasses() {
+            std::array<CharClass, 256> classes{};
+            for (int ch = '0'; ch <= '9'; ++ch) {
+                classes[ch] = CharClass::DIGIT;
+            }
+            for (int ch = 'a'; ch <= 'z'; ++ch) {
+                classes[ch] = CharClass::ID_START;
+                classes[ch - 'a' + 'A'] = CharClass::ID_START;
+            }
+            classes['_'] = CharClass::ID_START;
+            classes[' '] = CharClass::SPACE;
+            classes['\n'] = CharClass::NEWLINE;
+            classes['#'] = CharClass::COMMENT;
+            classes['\''] = CharClass::QUOTE;
+            classes['"'] = CharClass::QUOTE;
+            classes['!'] = CharClass::COMPARISON;
+            classes['='] = CharClass::COMPARISON;
+            classes['<'] = CharClass::COMPARISON;
+            classes['>'] = CharClass::COMPARISON;
+            return classes;
+        }
+
+        // Классы символов не зависят от локали, в отличие от isalpha и isdigit
+        constexpr std::array<CharClass, 256> CHAR_CLASSES = MakeCharClasses();
+
+        constexpr CharClass GetCharClass(char ch) {
+            return CHAR_CLASSES[static_cast<unsigned char>(ch)];
+        }
+
+        constexpr bool IsDigit(char ch) {
+            return GetCharClass(ch) == CharClass::DIGIT;
+        }
+
+        constexpr bool IsIdentifierChar(char ch) {
+            const CharClass cls = GetCharClass(ch);
+            return cls == CharClass::ID_START || cls == CharClass::DIGIT;
+        }
+
+        /*
+         * Поиск конца серии символов одного класса. При сборке с поддержкой SSE2 или AVX2 проверяется
+         * сразу 16 или 32 байта, остаток обрабатывается побайтно. Каждая функция возвращает указатель
+         * на первый символ в [pos, end), не принадлежащий серии, либо end
+         */
+#if defined(__AVX2__)
+        constexpr size_t SIMD_WIDTH = 32;
+        using SimdBlock = __m256i;
+
+        SimdBlock LoadBlock(const char *pos) {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+        }
+
+        SimdBlock Splat(char ch) {
+            return _mm256_set1_epi8(ch);
+        }
+
+        SimdBlock Equal(SimdBlock lhs, SimdBlock rhs) {
+            return _mm256_cmpeq_epi8(lhs, rhs);
+        }
+
+        SimdBlock Greater(SimdBlock lhs, SimdBlock rhs) {
+            return _mm256_cmpgt_epi8(lhs, rhs);
+        }
+
+        SimdBlock And(SimdBlock lhs, SimdBlock rhs) {
+            return _mm256_and_si256(lhs, rhs);
+        }
+
+        SimdBlock Or(SimdBlock lhs, SimdBlock rhs) {
+            return _mm256_or_si256(lhs, rhs);
+        }
+
+        // Возвращает битовую маску байтов блока, у которых установлен старший бит
+        std::uint32_t MoveMask(SimdBlock block) {
+            return static_cast<std::uint32_t>(_mm256_movemask_epi8(block));
+        }
+#elif defined(__SSE2__)
+        constexpr size_t SIMD_WIDTH = 16;
+        using SimdBlock = __m128i;
+
+        SimdBlock LoadBlock(const char *pos) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+        }
+
+        SimdBlock Splat(char ch) {
+            return _mm_set1_epi8(ch);
+        }
+
+        SimdBlock Equal(SimdBlock lhs, SimdBlock rhs) {
+            return _mm_cmpeq_epi8(lhs, rhs);
+        }
+
+        SimdBlock Greater(SimdBlock lhs, SimdBlock rhs) {
+            return _mm_cmpgt_epi8(lhs, rhs);
+        }
+
+        SimdBlock And(SimdBlock lhs, SimdBlock rhs) {
+            return _mm_and_si128(lhs, rhs);
+        }
+
+        SimdBlock Or(SimdBlock lhs, SimdBlock rhs) {
+            return _mm_or_si128(lhs, rhs);
+        }
 
-    Lexer::TextLine Lexer::TextLine::ReadLine(std::istream &in) {
-        TextLine line;
-        line.indent_ = SkipSpaces(in);
-
-        int ch;
-        do {
-            ch = in.get();
-            if (ch == ' ') {
-                SkipSpaces(in);
-            } else if (ch == '#') {
-                SkipComment(in);
-            } else if (ch == '\n') {
-                line.tokens_.emplace_back(token_type::Newline{});
-            } else if (ch == EOF) {
-                if (!line.IsEmpty() && !line.tokens_.back().Is<token_type::Newline>()) {
-                    line.tokens_.emplace_back(token_type::Newline{});
+        std::uint32_t MoveMask(SimdBlock block) {
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(block));
+        }
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+        constexpr std::uint32_t FULL_MASK = SIMD_WIDTH == 32 ? ~std::uint32_t{0} : (std::uint32_t{1} << SIMD_WIDTH) - 1;
+
+        // Проверяет блоки по SIMD_WIDTH байт. matches(block) возвращает маску байтов, принадлежащих серии.
+        // Возвращает позицию первого байта вне серии либо начало неполного блока в конце текста
+        template<typename Matcher>
+        const char *SkipBlocks(const char *pos, const char *end, Matcher matches) {
+            for (; static_cast<size_t>(end - pos) >= SIMD_WIDTH; pos += SIMD_WIDTH) {
+                const std::uint32_t stop = ~MoveMask(matches(LoadBlock(pos))) & FULL_MASK;
+                if (stop != 0) {
+                    return pos + __builtin_ctz(stop);
                 }
-                line.tokens_.emplace_back(token_type::Eof{});
-            } else if (ch == '"' || ch == '\'') {
-                line.ReadString(in, ch);
-            } else if (isdigit(ch)) {
-                line.ReadNumber(in, ch);
-            } else if (isalpha(ch) || ch == '_') {
-                line.ReadIdentifier(in, ch);
-            } else if ((ch == '!' || ch == '=' || ch == '<' || ch == '>') && in.peek() == '=') {
-                line.ReadComparison(in, ch);
-            } else {
-                line.tokens_.emplace_back(token_type::Char{static_cast<char>(ch)});
             }
-        } while (!(ch == '\n' || ch == EOF));
+            return pos;
+        }
+#endif
+
+        const char *SkipSpaceRun(const char *pos, const char *end) {
+#if defined(__AVX2__) || defined(__SSE2__)
+            const SimdBlock space = Splat(' ');
+            pos = SkipBlocks(pos, end, [&](SimdBlock block) {
+                return Equal(block, space);
+            });
+#endif
+            for (; pos != end && *pos == ' '; ++pos);
+            return pos;
+        }
+
+        const char *SkipIdentifierRun(const char *pos, const char *end) {
+#if defined(__AVX2__) || defined(__SSE2__)
+            // Байты вне ASCII отрицательны при знаковом сравнении, поэтому не попадают ни в один диапазон
+            const SimdBlock case_bit = Splat(0x20);
+            const SimdBlock before_a = Splat('a' - 1);
+            const SimdBlock after_z = Splat('z' + 1);
+            const SimdBlock before_0 = Splat('0' - 1);
+            const SimdBlock after_9 = Splat('9' + 1);
+            const SimdBlock underscore = Splat('_');
+            pos = SkipBlocks(pos, end, [&](SimdBlock block) {
+                const SimdBlock lower = Or(block, case_bit);
+                const SimdBlock letter = And(Greater(lower, before_a), Greater(after_z, lower));
+                const SimdBlock digit = And(Greater(block, before_0), Greater(after_9, block));
+                return Or(Or(letter, digit), Equal(block, underscore));
+            });
+#endif
+            for (; pos != end && IsIdentifierChar(*pos); ++pos);
+            return pos;
+        }
+
+        // Ищет символ, прерывающий обычное содержимое строковой константы: закрывающую кавычку,
+        // обратную косую черту или перевод строки
+        const char *SkipStringRun(const char *pos, const char *end, char quote) {
+#if defined(__AVX2__) || defined(__SSE2__)
+            const SimdBlock quote_block = Splat(quote);
+            const SimdBlock backslash = Splat('\\');
+            const SimdBlock newline = Splat('\n');
+            const SimdBlock carriage_return = Splat('\r');
+            const SimdBlock zero = Splat(0);
+            pos = SkipBlocks(pos, end, [&](SimdBlock block) {
+                const SimdBlock special = Or(Or(Equal(block, quote_block), Equal(block, backslash)),
+                                             Or(Equal(block, newline), Equal(block, carriage_return)));
+                return Equal(special, zero);
+            });
+#endif
+            for (; pos != end && *pos != quote && *pos != '\\' && *pos != '\n' && *pos != '\r'; ++pos);
+            return pos;
+        }
+
+        // Ищет конец комментария. memchr в стандартной библиотеке уже векторизован
+        const char *SkipCommentRun(const char *pos, const char *end) {
+            const void *newline = std::memchr(pos, '\n', end - pos);
+            return newline ? static_cast<const char *>(newline) : end;
+        }
 
-        return line;
+        /*
+         * Совершенная хеш-функция ключевых слов: различным ключевым словам соответствуют различные ячейки
+         * таблицы. Зависит от первого и последнего символов и длины слова, поэтому вычисляется за O(1)
+         */
+        constexpr size_t KEYWORD_TABLE_SIZE = 32;
+
+        constexpr size_t HashKeyword(std::string_view word, size_t seed) {
+            return (static_cast<unsigned char>(word.front()) * seed + static_cast<unsigned char>(word.back())
+                    + word.size()) % KEYWORD_TABLE_SIZE;
+        }
+
+        // Подбирает seed, при котором хеш-функция не имеет коллизий на KEYWORDS. Возвращает 0, если такого нет
+        constexpr size_t FindKeywordSeed() {
+            for (size_t seed = 1; seed < 1000; ++seed) {
+                std::array<bool, KEYWORD_TABLE_SIZE> used{};
+                bool collision = false;
+                for (const auto &keyword : KEYWORDS) {
+                    const size_t hash = HashKeyword(keyword.text, seed);
+                    collision = collision || used[hash];
+                    used[hash] = true;
+                }
+                if (!collision) {
+                    return seed;
+                }
+            }
+            return 0;
+        }
+
+        constexpr size_t KEYWORD_SEED = FindKeywordSeed();
+        static_assert(KEYWORD_SEED != 0, "No perfect hash for KEYWORDS, increase KEYWORD_TABLE_SIZE");
+
+        // Ячейка таблицы ключевых слов хранит индекс в KEYWORDS либо NO_KEYWORD
+        constexpr std::uint8_t NO_KEYWORD = std::numeric_limits<std::uint8_t>::max();
+
+        constexpr std::array<std::uint8_t, KEYWORD_TABLE_SIZE> MakeKeywordTable() {
+            std::array<std::uint8_t, KEYWORD_TABLE_SIZE> table{};
+            for (auto &cell : table) {
+                cell = NO_KEYWORD;
+            }
+            for (size_t i = 0; i < KEYWORDS.size(); ++i) {
+                table[HashKeyword(KEYWORDS[i].text, KEYWORD_SEED)] = static_cast<std::uint8_t>(i);
+            }
+            return table;
+        }
+
+        constexpr std::array<std::uint8_t, KEYWORD_TABLE_SIZE> KEYWORD_TABLE = MakeKeywordTable();
+
+        // Возвращает ключевое слово, совпадающее с word, либо nullptr
+        constexpr const Keyword *FindKeyword(std::string_view word) {
+            const std::uint8_t index = KEYWORD_TABLE[HashKeyword(word, KEYWORD_SEED)];
+            if (index == NO_KEYWORD || KEYWORDS[index].text != word) {
+                return nullptr;
+            }
+            return &KEYWORDS[index];
+        }
+
+        static_assert(FindKeyword("class"sv) == &KEYWORDS[0]);
+        static_assert(FindKeyword("False"sv) == &KEYWORDS[11]);
+        static_assert(FindKeyword("Class"sv) == nullptr);
+    }  // namespace
+
+    Token Lexer::ScanTokenAt(size_t &offset, std::string &escaped) {
+        offset = pos_ - begin_;
+        try {
+            return ScanToken(escaped);
+        } catch (LexerError &e) {
+            e.offset = offset;
+            throw;
+        }
+    }
+
+    Token Lexer::ScanToken(std::string &escaped) {
+        if (at_line_start_ && !StartLine()) {
+            // В конце файла закрываем все открытые блоки
+            if (current_indent_ > 0) {
+                current_indent_ -= 2;
+                return token_type::Dedent{};
+            }
+            return token_type::Eof{};
+        }
+        if (pending_indents_ > 0) {
+            --pending_indents_;
+            return token_type::Indent{};
+        }
+        if (pending_dedents_ > 0) {
+            --pending_dedents_;
+            return token_type::Dedent{};
+        }
+
+        while (true) {
+            // Непустая строка всегда завершается лексемой Newline, даже в конце файла
+            if (pos_ == end_) {
+                at_line_start_ = true;
+                return token_type::Newline{};
+            }
+            const char *current = pos_++;
+            const char ch = *current;
+            switch (GetCharClass(ch)) {
+                case CharClass::SPACE:
+                    SkipSpaces();
+                    break;
+                case CharClass::COMMENT:
+                    SkipComment();
+                    break;
+                case CharClass::NEWLINE:
+                    at_line_start_ = true;
+                    return token_type::Newline{};
+                case CharClass::QUOTE:
+                    return ReadString(ch, escaped);
+                case CharClass::DIGIT:
+                    return ReadNumber(current);
+                case CharClass::ID_START:
+                    return ReadIdentifier(current);
+                case CharClass::COMPARISON:
+                    if (pos_ != end_ && *pos_ == '=') {
+                        return ReadComparison(ch);
+                    }
+                    return token_type::Char{ch};
+                case CharClass::OTHER:
+                    return token_type::Char{ch};
+            }
+        }
     }
 
-    int Lexer::TextLine::SkipSpaces(std::istream &in) {
-        int space_count = 0;
-        for (; in.get() == ' '; ++space_count);
-        in.unget();    // вернем последний считанный символ (не пробельный) в поток
-        return space_count;
+    bool Lexer::StartLine() {
+        while (true) {
+            const int indent = SkipSpaces();
+            if (pos_ != end_ && *pos_ == '#') {
+                SkipComment();
+            }
+            if (pos_ == end_) {
+                return false;
+            }
+            if (*pos_ == '\n') {
+                // Пустые строки и строки из одних комментариев не влияют на отступы
+                ++pos_;
+                continue;
+            }
+            if (indent % 2 != 0) {
+                throw LexerError("Bad indent size.");
+            }
+            if (indent > current_indent_) {
+                pending_indents_ = (indent - current_indent_) / 2;
+            } else {
+                pending_dedents_ = (current_indent_ - indent) / 2;
+            }
+            current_indent_ = indent;
+            at_line_start_ = false;
+            return true;
+        }
     }
 
-    void Lexer::TextLine::SkipComment(std::istream &in) {
-        for (; !(in.get() == '\n' || in.eof()););
-        in.unget();    // вернем последний считанный символ (\n) в поток
+    int Lexer::SkipSpaces() {
+        const char *begin = pos_;
+        pos_ = SkipSpaceRun(pos_, end_);
+        return static_cast<int>(pos_ - begin);
     }
 
-    void Lexer::TextLine::ReadString(std::istream &in, const int begin_quote) {
+    void Lexer::SkipComment() {
+        // Символ \n остаётся непрочитанным и завершает строку
+        pos_ = SkipCommentRun(pos_, end_);
+    }
 
-        auto it = std::istreambuf_iterator<char>(in);
-        auto end = std::istreambuf_iterator<char>();
-        std::string s;
+    Token Lexer::ReadString(const char begin_quote, std::string &escaped) {
+        const char *begin = pos_;
+        // Строка без escape-последовательностей передаётся срезом исходного текста
+        bool has_escapes = false;
         while (true) {
-            if (it == end) {
+            const char *run_end = SkipStringRun(pos_, end_, begin_quote);
+            if (has_escapes) {
+                escaped.append(pos_, run_end);
+            }
+            pos_ = run_end;
+            if (pos_ == end_) {
                 throw LexerError("String parsing error");
             }
-            const char ch = *it;
+            const char ch = *pos_;
             if (ch == begin_quote) {
-                ++it;
                 break;
             } else if (ch == '\\') {
-                ++it;
-                if (it == end) {
+                if (!has_escapes) {
+                    escaped.assign(begin, pos_);
+                    has_escapes = true;
+                }
+                if (++pos_ == end_) {
                     throw LexerError("String parsing error");
                 }
-                const char escaped_char = *(it);
+                const char escaped_char = *pos_;
                 switch (escaped_char) {
                     case 'n':
-                        s.push_back('\n');
+                        escaped.push_back('\n');
                         break;
                     case 't':
-                        s.push_back('\t');
+                        escaped.push_back('\t');
                         break;
                     case 'r':
-                        s.push_back('\r');
+                        escaped.push_back('\r');
                         break;
                     case '"':
-                        s.push_back('"');
+                        escaped.push_back('"');
                         break;
                     case '\'':
-                        s.push_back('\'');
+                        escaped.push_back('\'');
                         break;
                     case '\\':
-                        s.push_back('\\');
+                        escaped.push_back('\\');
                         break;
                     default:
                         throw LexerError("Unrecognized escape sequence \\"s + escaped_char);
                 }
-            } else if (ch == '\n' || ch == '\r') {
-                throw LexerError("Unexpected end of line"s);
             } else {
-                s.push_back(ch);
+                throw LexerError("Unexpected end of line"s);
             }
-            ++it;
+            ++pos_;
         }
 
-        tokens_.emplace_back(token_type::String{std::move(s)});
+        const std::string_view value = has_escapes ? std::string_view(escaped) : std::string_view(begin, pos_ - begin);
+        ++pos_;  // пропускаем закрывающую кавычку
+        return token_type::String{value};
     }
 
-    void Lexer::TextLine::ReadNumber(std::istream &in, const int first_dig) {
-        std::string s{static_cast<char>(first_dig)};
-        for (int ch = in.get(); in && isdigit(ch); ch = in.get()) {
-            s += static_cast<char>(ch);
+    Token Lexer::ReadNumber(const char *first_dig) {
+        for (; pos_ != end_ && IsDigit(*pos_); ++pos_);
+        int value = 0;
+        if (std::from_chars(first_dig, pos_, value).ec != std::errc{}) {
+            throw LexerError("Number is out of range: "s + std::string(first_dig, pos_));
         }
-        in.unget();    // вернем последний считанный символ (не цифру) в поток
-        tokens_.emplace_back(token_type::Number{stoi(s)});
+        return token_type::Number{value};
     }
 
-    void Lexer::TextLine::ReadIdentifier(std::istream &in, const int first_sym) {
-        std::string s{static_cast<char>(first_sym)};
-        for (int ch = in.get();
-             in && (isalpha(ch) || ch == '_' || isdigit(ch));
-             ch = in.get()) {
-            s += static_cast<char>(ch);
-        }
-        in.unget();    // вернем последний считанный символ в поток
-
-        if (s == "class"sv) {
-            tokens_.emplace_back(token_type::Class{});
-        } else if (s == "return"sv) {
-            tokens_.emplace_back(token_type::Return{});
-        } else if (s == "if"sv) {
-            tokens_.emplace_back(token_type::If{});
-        } else if (s == "else"sv) {
-            tokens_.emplace_back(token_type::Else{});
-        } else if (s == "def"sv) {
-            tokens_.emplace_back(token_type::Def{});
-        } else if (s == "print"sv) {
-            tokens_.emplace_back(token_type::Print{});
-        } else if (s == "and"sv) {
-            tokens_.emplace_back(token_type::And{});
-        } else if (s == "or"sv) {
-            tokens_.emplace_back(token_type::Or{});
-        } else if (s == "not"sv) {
-            tokens_.emplace_back(token_type::Not{});
-        } else if (s == "None"sv) {
-            tokens_.emplace_back(token_type::None{});
-        } else if (s == "True"sv) {
-            tokens_.emplace_back(token_type::True{});
-        } else if (s == "False"sv) {
-            tokens_.emplace_back(token_type::False{});
-        } else {
-            tokens_.emplace_back(token_type::Id{std::move(s)});
+    Token Lexer::ReadIdentifier(const char *first_sym) {
+        pos_ = SkipIdentifierRun(pos_, end_);
+        const std::string_view s(first_sym, pos_ - first_sym);
+        if (const Keyword *keyword = FindKeyword(s)) {
+            return keyword->token;
+        }
+        // Пустой символ в незаполненной ячейке не совпадает ни с одним идентификатором
+        runtime::Symbol &recent = recent_ids_[(s.front() * 31U + s.back() + s.size()) % RECENT_ID_COUNT];
+        if (recent.GetText() != s) {
+            recent = runtime::Symbol(s);
         }
+        return token_type::Id{recent};
     }
 
-    void Lexer::TextLine::ReadComparison(std::istream &in, const int ch) {
+    Token Lexer::ReadComparison(const char ch) {
+        ++pos_; // пропускаем второй символ
         if (ch == '!') {
-            tokens_.emplace_back(token_type::NotEq{});
+            return token_type::NotEq{};
         } else if (ch == '=') {
-            tokens_.emplace_back(token_type::Eq{});
+            return token_type::Eq{};
         } else if (ch == '<') {
-            tokens_.emplace_back(token_type::LessOrEq{});
-        } else if (ch == '>') {
-            tokens_.emplace_back(token_type::GreaterOrEq{});
+            return token_type::LessOrEq{};
         }
-        in.get(); // считаем второй символ
-    }
-
-    bool Lexer::TextLine::IsEmpty() const {
-        return tokens_.empty()
-               || std::all_of(tokens_.cbegin(), tokens_.cend(), [](const auto &t) {
-            return t.template Is<token_type::Newline>();
-        });
-    }
-
-    bool Lexer::TextLine::IsEofOnly() const {
-        return tokens_.empty()
-               || std::all_of(tokens_.cbegin(), tokens_.cend(), [](const auto &t) {
-            return t.template Is<token_type::Eof>();
-        });
+        return token_type::GreaterOrEq{};
     }
 
 }  // namespace parse
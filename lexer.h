@@ -1,10 +1,15 @@
 #pragma once
 
+#include "symbol.h"
+
+#include <array>
 #include <iosfwd>
+#include <memory>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <variant>
 
@@ -15,16 +20,16 @@ namespace parse {
             int value;   // число
         };
 
-        struct Id {             // Лексема «идентификатор»
-            std::string value;  // Имя идентификатора
+        struct Id {                 // Лексема «идентификатор»
+            runtime::Symbol value;  // Интернированное имя идентификатора
         };
 
         struct Char {    // Лексема «символ»
             char value;  // код символа
         };
 
-        struct String {  // Лексема «строковая константа»
-            std::string value;
+        struct String {              // Лексема «строковая константа»
+            std::string_view value;  // Ссылается на исходный текст либо на раскрытую копию строки с escape-последовательностями
         };
 
         struct Class {
@@ -96,6 +101,28 @@ namespace parse {
         }
     };
 
+    // Ключевое слово языка и соответствующая ему лексема
+    struct Keyword {
+        std::string_view text;
+        Token token;
+    };
+
+    // Ключевые слова языка. По этому списку во время компиляции строится таблица для их распознавания
+    inline constexpr std::array<Keyword, 12> KEYWORDS = {{
+            {"class", token_type::Class{}},
+            {"return", token_type::Return{}},
+            {"if", token_type::If{}},
+            {"else", token_type::Else{}},
+            {"def", token_type::Def{}},
+            {"print", token_type::Print{}},
+            {"and", token_type::And{}},
+            {"or", token_type::Or{}},
+            {"not", token_type::Not{}},
+            {"None", token_type::None{}},
+            {"True", token_type::True{}},
+            {"False", token_type::False{}},
+    }};
+
     bool operator==(const Token &lhs, const Token &rhs);
 
     bool operator!=(const Token &lhs, const Token &rhs);
@@ -105,11 +132,82 @@ namespace parse {
     class LexerError : public std::runtime_error {
     public:
         using std::runtime_error::runtime_error;
+
+        // Смещение в тексте программы, на котором обнаружена ошибка, если оно известно.
+        // Ошибку чтения лексемы лексер отмечает смещением этой лексемы, остальные ошибки
+        // парсер отмечает смещением текущей лексемы
+        std::optional<size_t> offset;
+    };
+
+    /*
+     * Файл, отображённый в память только для чтения. Текст файла может быть передан в Lexer без копирования.
+     * На платформах без mmap содержимое файла считывается в память
+     */
+    class MappedFile {
+    public:
+        // Отображает файл path в память. Если файл не удаётся открыть, выбрасывает runtime_error
+        explicit MappedFile(const std::string &path);
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile();
+
+        [[nodiscard]] std::string_view GetText() const {
+            return text_;
+        }
+
+    private:
+        std::string_view text_;
+        // Используется, если файл не отображён в память
+        std::string contents_;
+    };
+
+    // Режим чтения лексем
+    enum class LexerMode {
+        SEQUENTIAL,  // лексемы читаются по требованию в потоке парсера
+        // Лексемы заранее читаются в отдельном потоке и передаются парсеру через очередь.
+        // Сокращает время разбора крупных программ, если для потока чтения есть свободное ядро
+        PIPELINED,
     };
 
+    /*
+     * Лексический анализатор. Работает над непрерывным буфером с исходным текстом программы.
+     * Имена идентификаторов интернируются. Значения лексем String не копируются, а ссылаются на этот буфер,
+     * поэтому действительны, пока жив Lexer и переданный ему буфер. В отдельные строки материализуются только
+     * строковые константы, содержащие escape-последовательности; значение такой лексемы
+     * действительно, пока она находится в окне лексера.
+     *
+     * Лексемы читаются по требованию и хранятся в кольцевом окне из текущей лексемы
+     * и lookahead следующих, поэтому память лексера не зависит от размера программы.
+     *
+     * В режиме LexerMode::PIPELINED текст разбирается в фоновом потоке, опережающем парсер.
+     * Ошибка разбора выбрасывается из того же вызова NextToken, что и в последовательном режиме
+     */
     class Lexer {
     public:
-        explicit Lexer(std::istream &input);
+        // Глубина просмотра вперёд по умолчанию. Парсеру достаточно текущей лексемы
+        static constexpr size_t DEFAULT_LOOKAHEAD = 1;
+
+        // Считывает поток input целиком во внутренний буфер
+        explicit Lexer(std::istream &input, size_t lookahead = DEFAULT_LOOKAHEAD,
+                       LexerMode mode = LexerMode::SEQUENTIAL);
+
+        // Разбирает текст source без копирования. Буфер должен пережить Lexer
+        explicit Lexer(std::string_view source, size_t lookahead = DEFAULT_LOOKAHEAD,
+                       LexerMode mode = LexerMode::SEQUENTIAL);
+
+        // Временная строка была бы разрушена раньше лексем, ссылающихся на неё
+        explicit Lexer(std::string &&source, size_t lookahead = DEFAULT_LOOKAHEAD,
+                       LexerMode mode = LexerMode::SEQUENTIAL) = delete;
+
+        Lexer(const Lexer &) = delete;
+
+        Lexer &operator=(const Lexer &) = delete;
+
+        // Останавливает фоновый поток чтения, если он запущен
+        ~Lexer();
 
         // Возвращает ссылку на текущий токен или token_type::Eof, если поток токенов закончился
         [[nodiscard]] const Token &CurrentToken() const;
@@ -117,6 +215,21 @@ namespace parse {
         // Возвращает следующий токен, либо token_type::Eof, если поток токенов закончился
         Token NextToken();
 
+        // Возвращает ссылку на токен, следующий за текущим через distance позиций, не сдвигая текущий токен.
+        // distance не должно превышать глубину просмотра вперёд, иначе выбрасывается out_of_range
+        const Token &PeekToken(size_t distance = 1) const;
+
+        // Возвращает глубину просмотра вперёд
+        [[nodiscard]] size_t GetLookahead() const;
+
+        // Возвращает весь разбираемый текст
+        [[nodiscard]] std::string_view GetSource() const;
+
+        // Возвращает смещение в тексте, с которого началось чтение токена, следующего за текущим
+        // через distance позиций. Для Indent и Dedent это начало строки либо позиция после отступа.
+        // distance не должно превышать глубину просмотра вперёд, иначе выбрасывается out_of_range
+        [[nodiscard]] size_t GetTokenOffset(size_t distance = 0) const;
+
         // Если текущий токен имеет тип T, метод возвращает ссылку на него.
         // В противном случае метод выбрасывает исключение LexerError
         template<typename T>
@@ -160,33 +273,73 @@ namespace parse {
         }
 
     private:
-        struct TextLine {
-            static Lexer::TextLine ReadLine(std::istream &in);
+        // Очередь лексем между фоновым потоком чтения и парсером
+        struct Pipeline;
+
+        // Ячейка кольцевого окна лексем
+        struct Slot {
+            Token token;
+            size_t offset = 0;
+            // Раскрытое значение строковой константы с escape-последовательностями.
+            // Переиспользуется при повторном заполнении ячейки
+            std::string escaped;
+        };
 
-            static int SkipSpaces(std::istream &in);
+        // Запускает чтение лексем в режиме mode и заполняет окно
+        void Start(LexerMode mode);
 
-            static void SkipComment(std::istream &in);
+        // Помещает в slot очередную лексему: читает её из текста либо забирает из очереди фонового потока
+        void ReadToken(Slot &slot);
 
-            void ReadString(std::istream &in, int begin_quote);
+        // Тело фонового потока: читает лексемы в очередь до конца файла, ошибки или остановки
+        void Produce();
 
-            void ReadNumber(std::istream &in, int first_dig);
+        // Читает из исходного текста очередную лексему и записывает в offset её смещение.
+        // Выброшенная LexerError отмечается тем же смещением
+        Token ScanTokenAt(size_t &offset, std::string &escaped);
 
-            void ReadIdentifier(std::istream &in, int first_sym);
+        // Читает из исходного текста очередную лексему. После конца файла возвращает token_type::Eof
+        Token ScanToken(std::string &escaped);
 
-            void ReadComparison(std::istream &in, int ch);
+        // Обрабатывает начало строки: пропускает пустые строки и строки из комментариев и вычисляет,
+        // сколько лексем Indent или Dedent нужно выдать. Возвращает false, если достигнут конец файла
+        bool StartLine();
 
-            bool IsEmpty() const;
+        int SkipSpaces();
 
-            bool IsEofOnly() const;
+        void SkipComment();
 
-            int indent_ = 0;
-            std::vector<Token> tokens_;
-        };
+        Token ReadString(char begin_quote, std::string &escaped);
+
+        Token ReadNumber(const char *first_dig);
+
+        Token ReadIdentifier(const char *first_sym);
+
+        Token ReadComparison(char ch);
+
+        // Владеет текстом программы, если он был считан из потока
+        std::string source_;
+        const char *begin_ = nullptr;
+        // Непрочитанная часть исходного текста
+        const char *pos_ = nullptr;
+        const char *end_ = nullptr;
 
-        std::istream &in_;
         int current_indent_ = 0;
-        int curr_pos_ = -1;
-        std::vector<Token> tokens_;
+        int pending_indents_ = 0;
+        int pending_dedents_ = 0;
+        bool at_line_start_ = true;
+
+        // Текущая лексема находится в window_[head_], следующие за ней - в последующих ячейках по кругу
+        std::vector<Slot> window_;
+        size_t head_ = 0;
+
+        // Недавно встреченные идентификаторы. Повторяющееся имя берётся отсюда,
+        // не обращаясь к глобальной таблице символов
+        static constexpr size_t RECENT_ID_COUNT = 64;
+        std::array<runtime::Symbol, RECENT_ID_COUNT> recent_ids_;
+
+        // Создаётся только в режиме LexerMode::PIPELINED
+        std::unique_ptr<Pipeline> pipeline_;
     };
 
 }  // namespace parse
@@ -2,6 +2,7 @@
 #include "parse.h"
 #include "runtime.h"
 #include "statement.h"
+#include "vm.h"
 #include "tests/test_runner_p.h"
 
 #include <iostream>
@@ -14,23 +15,53 @@ namespace parse {
 
 namespace ast {
     void RunUnitTests(TestRunner& tr);
+    void RunOptimizerTests(TestRunner& tr);
 }
 namespace runtime {
+    void RunSymbolTests(TestRunner& tr);
+    void RunArenaTests(TestRunner& tr);
     void RunObjectHolderTests(TestRunner& tr);
     void RunObjectsTests(TestRunner& tr);
+    void RunOutputTests(TestRunner& tr);
 }  // namespace runtime
+namespace vm {
+    void RunVirtualMachineTests(TestRunner& tr);
+}  // namespace vm
+namespace serialize {
+    void RunSerializeTests(TestRunner& tr);
+}  // namespace serialize
+namespace batch {
+    void RunBatchTests(TestRunner& tr);
+}  // namespace batch
 
 void TestParseProgram(TestRunner& tr);
 
 namespace {
 
-    void RunMythonProgram(istream& input, ostream& output) {
-        parse::Lexer lexer(input);
-        auto program = ParseProgram(lexer);
+    // Способ исполнения программы
+    enum class Engine {
+        AST,       // обход AST
+        BYTECODE,  // компиляция в байт-код и исполнение виртуальной машиной
+        STREAMING, // обход AST по мере разбора, по одной инструкции верхнего уровня
+    };
 
-        runtime::SimpleContext context{output};
+    void RunMythonProgram(istream& input, ostream& output, Engine engine = Engine::AST) {
+        parse::Lexer lexer(input);
+        // Вывод накапливается в буфере и передаётся в output крупными блоками
+        runtime::StreamSink sink{output};
+        runtime::SinkContext context{sink};
         runtime::Closure closure;
-        program->Execute(closure, context);
+        if (engine == Engine::STREAMING) {
+            ExecuteStreaming(lexer, closure, context);
+            return;
+        }
+
+        auto program = ParseProgram(lexer);
+        if (engine == Engine::BYTECODE) {
+            vm::VirtualMachine{}.Run(*program, closure, context);
+        } else {
+            program->Execute(closure, context);
+        }
     }
 
     void TestSimplePrints() {
@@ -111,18 +142,59 @@ print y.value
         ASSERT_EQUAL(output.str(), "2\n3\n");
     }
 
+    void TestBytecodeEngine() {
+        const string program = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(n):
+    self.value = self.value + n
+    return self.value
+
+class Tag:
+  def __str__():
+    return 'tag'
+
+x = Counter()
+y = 5
+print x.add(y), x.add(2) * 10, Tag(), y
+print y, str(x.value) + '!'
+        )";
+
+        istringstream ast_input(program);
+        ostringstream ast_output;
+        RunMythonProgram(ast_input, ast_output, Engine::AST);
+
+        istringstream bytecode_input(program);
+        ostringstream bytecode_output;
+        RunMythonProgram(bytecode_input, bytecode_output, Engine::BYTECODE);
+
+        ASSERT_EQUAL(ast_output.str(), "5 70 tag 5\n5 7!\n");
+        ASSERT_EQUAL(bytecode_output.str(), ast_output.str());
+
+        istringstream streaming_input(program);
+        ostringstream streaming_output;
+        RunMythonProgram(streaming_input, streaming_output, Engine::STREAMING);
+        ASSERT_EQUAL(streaming_output.str(), ast_output.str());
+    }
+
     void TestWithSelf() {
         istringstream input(R"(
 class X:
   def __init__(p):
     p.a = self
 
+  def __str__():
+    return 'X'
+
 class XHolder:
   def __init__():
     dummy = 0
 
 xh = XHolder()
 x = X(xh)
+x = None
 
 print xh.a
         )");
@@ -130,22 +202,31 @@ print xh.a
         ostringstream output;
         RunMythonProgram(input, output);
 
-        //ASSERT_EQUAL(output.str(), "57\nC++ black belt\nFalse\nNone False\n");
+        // Поле a продлевает жизнь объекту, на который больше не ссылается переменная x
+        ASSERT_EQUAL(output.str(), "X\n");
     }
 
     void TestAll() {
         TestRunner tr;
+        runtime::RunSymbolTests(tr);
         parse::RunOpenLexerTests(tr);
         runtime::RunObjectHolderTests(tr);
         runtime::RunObjectsTests(tr);
+        runtime::RunArenaTests(tr);
+        runtime::RunOutputTests(tr);
         ast::RunUnitTests(tr);
         TestParseProgram(tr);
+        ast::RunOptimizerTests(tr);
+        vm::RunVirtualMachineTests(tr);
+        serialize::RunSerializeTests(tr);
+        batch::RunBatchTests(tr);
 
         RUN_TEST(tr, TestSimplePrints);
         RUN_TEST(tr, TestAssignments);
         RUN_TEST(tr, TestArithmetics);
         RUN_TEST(tr, TestVariablesArePointers);
         RUN_TEST(tr, TestWithSelf);
+        RUN_TEST(tr, TestBytecodeEngine);
     }
 
 }  // namespace
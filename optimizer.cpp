@@ -0,0 +1,165 @@
+#include "optimizer.h"
+
+#include <limits>
+#include <optional>
+#include <ostream>
+
+using namespace std;
+
+namespace ast {
+
+    namespace {
+        using runtime::Number;
+        using runtime::String;
+
+        optional<int> GetNumber(const Statement &node) {
+            if (const auto *num = dynamic_cast<const NumericConst *>(&node)) {
+                return num->GetValue().GetValue();
+            }
+            return nullopt;
+        }
+
+        const string *GetString(const Statement &node) {
+            if (const auto *str = dynamic_cast<const StringConst *>(&node)) {
+                return &str->GetValue().GetValue();
+            }
+            return nullptr;
+        }
+
+        // Возвращает true, если вычисление node либо даёт число, либо выбрасывает исключение.
+        // Операции -, *, / определены только для чисел, а + - ещё и для строк и объектов
+        bool IsNumeric(const Statement &node) {
+            if (dynamic_cast<const NumericConst *>(&node) || dynamic_cast<const Sub *>(&node)
+                || dynamic_cast<const Mult *>(&node) || dynamic_cast<const Div *>(&node)) {
+                return true;
+            }
+            if (const auto *add = dynamic_cast<const Add *>(&node)) {
+                return IsNumeric(add->GetLhs()) && IsNumeric(add->GetRhs());
+            }
+            return false;
+        }
+
+        // Вычисляет lhs op rhs так же, как соответствующая инструкция.
+        // Возвращает nullopt, если при вычислении произошла бы ошибка либо переполнение
+        optional<int> Evaluate(const BinaryOperation &op, int lhs, int rhs) {
+            int result = 0;
+            if (dynamic_cast<const Add *>(&op)) {
+                if (__builtin_add_overflow(lhs, rhs, &result)) {
+                    return nullopt;
+                }
+            } else if (dynamic_cast<const Sub *>(&op)) {
+                if (__builtin_sub_overflow(lhs, rhs, &result)) {
+                    return nullopt;
+                }
+            } else if (dynamic_cast<const Mult *>(&op)) {
+                if (__builtin_mul_overflow(lhs, rhs, &result)) {
+                    return nullopt;
+                }
+            } else if (dynamic_cast<const Div *>(&op)) {
+                if (rhs == 0 || (lhs == numeric_limits<int>::min() && rhs == -1)) {
+                    return nullopt;
+                }
+                result = lhs / rhs;
+            } else {
+                return nullopt;
+            }
+            return result;
+        }
+
+        // Возвращает true, если значение константы value не меняет x в операции op с той стороны,
+        // где стоит константа (для - и / константа допустима только справа)
+        bool IsIdentity(const BinaryOperation &op, int value, bool on_right) {
+            if (dynamic_cast<const Add *>(&op)) {
+                return value == 0;
+            }
+            if (dynamic_cast<const Mult *>(&op)) {
+                return value == 1;
+            }
+            if (dynamic_cast<const Sub *>(&op)) {
+                return on_right && value == 0;
+            }
+            if (dynamic_cast<const Div *>(&op)) {
+                return on_right && value == 1;
+            }
+            return false;
+        }
+
+        bool IsArithmetic(const Statement &node) {
+            return dynamic_cast<const Add *>(&node) || dynamic_cast<const Sub *>(&node)
+                   || dynamic_cast<const Mult *>(&node) || dynamic_cast<const Div *>(&node);
+        }
+    }  // namespace
+
+    OptimizerStats &OptimizerStats::operator+=(const OptimizerStats &other) {
+        folded_constants += other.folded_constants;
+        folded_negations += other.folded_negations;
+        simplified_identities += other.simplified_identities;
+        return *this;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const OptimizerStats &stats) {
+        return os << "folded constants: "sv << stats.folded_constants << '\n'
+                  << "folded negations: "sv << stats.folded_negations << '\n'
+                  << "simplified identities: "sv << stats.simplified_identities << '\n';
+    }
+
+    void Optimizer::Optimize(std::unique_ptr<Statement> &node) {
+        node->ForEachChild([this](std::unique_ptr<runtime::Executable> &child) {
+            Optimize(child);
+        });
+        if (auto replacement = Simplify(*node)) {
+            node = std::move(replacement);
+        }
+    }
+
+    std::unique_ptr<Statement> Optimizer::Simplify(Statement &node) {
+        if (!IsArithmetic(node)) {
+            return nullptr;
+        }
+        auto &op = static_cast<BinaryOperation &>(node);
+        const optional<int> lhs = GetNumber(op.GetLhs());
+        const optional<int> rhs = GetNumber(op.GetRhs());
+
+        if (lhs && rhs) {
+            const optional<int> value = Evaluate(op, *lhs, *rhs);
+            if (!value) {
+                return nullptr;
+            }
+            // Унарный минус разбирается как умножение на -1
+            if (dynamic_cast<const Mult *>(&op) && *rhs == -1) {
+                ++stats_.folded_negations;
+            } else {
+                ++stats_.folded_constants;
+            }
+            return make_unique<NumericConst>(Number{*value});
+        }
+
+        if (dynamic_cast<const Add *>(&op)) {
+            const string *lhs_str = GetString(op.GetLhs());
+            const string *rhs_str = GetString(op.GetRhs());
+            if (lhs_str && rhs_str) {
+                ++stats_.folded_constants;
+                return make_unique<StringConst>(String{*lhs_str + *rhs_str});
+            }
+        }
+
+        // Узел op удаляется после замены, поэтому оставшийся операнд можно забрать из него
+        std::unique_ptr<Statement> result;
+        if (rhs && IsIdentity(op, *rhs, true) && IsNumeric(op.GetLhs())) {
+            op.ForEachChild([&result](std::unique_ptr<runtime::Executable> &child) {
+                if (!result) {
+                    result = std::move(child);
+                }
+            });
+        } else if (lhs && IsIdentity(op, *lhs, false) && IsNumeric(op.GetRhs())) {
+            op.ForEachChild([&result](std::unique_ptr<runtime::Executable> &child) {
+                result = std::move(child);
+            });
+        }
+        if (result) {
+            ++stats_.simplified_identities;
+        }
+        return result;
+    }
+
+}  // namespace ast
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "statement.h"
+
+#include <iosfwd>
+#include <memory>
+
+namespace ast {
+
+    // Статистика оптимизатора: сколько преобразований каждого вида было выполнено
+    struct OptimizerStats {
+        // Арифметические выражения над константами, заменённые их значением
+        size_t folded_constants = 0;
+        // Унарные минусы перед числовыми литералами, заменённые отрицательным литералом
+        size_t folded_negations = 0;
+        // Тождества x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1, заменённые на x
+        size_t simplified_identities = 0;
+
+        [[nodiscard]] size_t GetTotal() const {
+            return folded_constants + folded_negations + simplified_identities;
+        }
+
+        OptimizerStats &operator+=(const OptimizerStats &other);
+    };
+
+    // Выводит отчёт оптимизатора, по одной строке на вид преобразования
+    std::ostream &operator<<(std::ostream &os, const OptimizerStats &stats);
+
+    /*
+     * Оптимизирует AST после разбора: сворачивает константные подвыражения и упрощает
+     * арифметические тождества. Наблюдаемое поведение программы не меняется: выражения, которые
+     * при вычислении выбрасывают исключение (деление на ноль, переполнение), остаются как есть,
+     * а тождества применяются, только если x заведомо является числом.
+     * Вызывается до ResolveNames
+     */
+    class Optimizer {
+    public:
+        // Оптимизирует поддерево node, при необходимости заменяя его корень
+        void Optimize(std::unique_ptr<Statement> &node);
+
+        [[nodiscard]] const OptimizerStats &GetStats() const {
+            return stats_;
+        }
+
+    private:
+        // Возвращает упрощённую замену node либо nullptr. Дочерние узлы node уже оптимизированы
+        std::unique_ptr<Statement> Simplify(Statement &node);
+
+        OptimizerStats stats_;
+    };
+
+}  // namespace ast
@@ -0,0 +1,247 @@
+#include "output.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#endif
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        // Наибольшая длина десятичной записи int вместе со знаком
+        constexpr size_t MAX_NUMBER_LENGTH = numeric_limits<int>::digits10 + 2;
+
+        // Шаг, с которым растёт файл, отображённый в память
+        constexpr size_t MAPPED_FILE_GROWTH = 1 << 20;
+    }  // namespace
+
+    OutputSink::OutputSink(size_t capacity)
+            : buffer_(new char[std::max(capacity, MAX_NUMBER_LENGTH)]),
+              capacity_(std::max(capacity, MAX_NUMBER_LENGTH)),
+              stream_buffer_(*this),
+              stream_(&stream_buffer_) {
+    }
+
+    OutputSink::~OutputSink() = default;
+
+    void OutputSink::WriteNumber(int value) {
+        if (capacity_ - size_ < MAX_NUMBER_LENGTH) {
+            Flush();
+        }
+        char *begin = buffer_.get() + size_;
+        size_ = std::to_chars(begin, begin + MAX_NUMBER_LENGTH, value).ptr - buffer_.get();
+    }
+
+    void OutputSink::Flush() {
+        if (size_ > 0) {
+            // Размер сбрасывается заранее: если запись выбросит исключение, данные не будут записаны повторно
+            const size_t size = size_;
+            size_ = 0;
+            WriteOut({buffer_.get(), size}, {});
+        }
+    }
+
+    void OutputSink::WriteLarge(string_view text) {
+        if (text.size() < capacity_) {
+            Flush();
+            text.copy(buffer_.get(), text.size());
+            size_ = text.size();
+            return;
+        }
+        // Крупный фрагмент не копируется в буфер, а записывается вместе с ним одним вызовом
+        const size_t size = size_;
+        size_ = 0;
+        WriteOut({buffer_.get(), size}, text);
+    }
+
+    OutputSink::StreamBuffer::int_type OutputSink::StreamBuffer::overflow(int_type ch) {
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            sink_.Write(traits_type::to_char_type(ch));
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize OutputSink::StreamBuffer::xsputn(const char *s, std::streamsize count) {
+        sink_.Write(string_view(s, static_cast<size_t>(count)));
+        return count;
+    }
+
+    StreamSink::~StreamSink() {
+        Flush();
+    }
+
+    void StreamSink::WriteOut(string_view head, string_view tail) {
+        output_.write(head.data(), static_cast<streamsize>(head.size()));
+        output_.write(tail.data(), static_cast<streamsize>(tail.size()));
+    }
+
+    StringSink::~StringSink() {
+        Flush();
+    }
+
+    void StringSink::WriteOut(string_view head, string_view tail) {
+        output_.append(head).append(tail);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+
+    FileSink::FileSink(int fd, size_t capacity)
+            : OutputSink(capacity), fd_(fd) {
+    }
+
+    FileSink::~FileSink() {
+        try {
+            Flush();
+        } catch (const std::runtime_error &) {
+            // Деструктор не может сообщить об ошибке записи. Чтобы её обнаружить, следует вызвать Flush явно
+        }
+    }
+
+    void FileSink::WriteOut(string_view head, string_view tail) {
+        iovec parts[2] = {
+                {const_cast<char *>(head.data()), head.size()},
+                {const_cast<char *>(tail.data()), tail.size()},
+        };
+        iovec *part = parts;
+        int count = tail.empty() ? 1 : 2;
+        while (count > 0) {
+            const ssize_t written = writev(fd_, part, count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Cannot write output: "s + strerror(errno));
+            }
+            // Частичная запись продолжается с первого незаписанного байта
+            auto remaining = static_cast<size_t>(written);
+            while (count > 0 && remaining >= part->iov_len) {
+                remaining -= part->iov_len;
+                ++part;
+                --count;
+            }
+            if (count > 0) {
+                part->iov_base = static_cast<char *>(part->iov_base) + remaining;
+                part->iov_len -= remaining;
+            }
+        }
+    }
+
+    MappedFileSink::MappedFileSink(const std::string &path, size_t capacity)
+            : OutputSink(capacity) {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ == -1) {
+            throw std::runtime_error("Cannot open output file "s + path);
+        }
+    }
+
+    MappedFileSink::~MappedFileSink() {
+        try {
+            Close();
+        } catch (const std::runtime_error &) {
+            // Деструктор не может сообщить об ошибке записи. Чтобы её обнаружить, следует вызвать Close явно
+        }
+    }
+
+    void MappedFileSink::Close() {
+        if (fd_ == -1) {
+            return;
+        }
+        Flush();
+        if (mapping_) {
+            munmap(mapping_, mapped_size_);
+            mapping_ = nullptr;
+        }
+        // Файл рос блоками, лишний хвост отбрасывается
+        const int result = ftruncate(fd_, static_cast<off_t>(file_size_));
+        close(fd_);
+        fd_ = -1;
+        if (result == -1) {
+            throw std::runtime_error("Cannot truncate output file"s);
+        }
+    }
+
+    void MappedFileSink::WriteOut(string_view head, string_view tail) {
+        Append(head);
+        Append(tail);
+    }
+
+    void MappedFileSink::Append(string_view data) {
+        if (data.empty()) {
+            return;
+        }
+        if (mapped_size_ - file_size_ < data.size()) {
+            const size_t new_size = std::max(mapped_size_ * 2, file_size_ + data.size() + MAPPED_FILE_GROWTH);
+            if (ftruncate(fd_, static_cast<off_t>(new_size)) == -1) {
+                throw std::runtime_error("Cannot extend output file"s);
+            }
+            void *mapping = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (mapping == MAP_FAILED) {
+                throw std::runtime_error("Cannot map output file"s);
+            }
+            if (mapping_) {
+                munmap(mapping_, mapped_size_);
+            }
+            mapping_ = static_cast<char *>(mapping);
+            mapped_size_ = new_size;
+        }
+        std::memcpy(mapping_ + file_size_, data.data(), data.size());
+        file_size_ += data.size();
+    }
+
+#else
+
+    FileSink::FileSink(int fd, size_t capacity)
+            : OutputSink(capacity), fd_(fd) {
+        throw std::runtime_error("File descriptor output is not supported on this platform"s);
+    }
+
+    FileSink::~FileSink() = default;
+
+    void FileSink::WriteOut(string_view, string_view) {
+    }
+
+    MappedFileSink::MappedFileSink(const std::string &path, size_t capacity)
+            : OutputSink(capacity), fallback_(std::make_unique<std::ofstream>(path, std::ios::binary | std::ios::trunc)) {
+        if (!*fallback_) {
+            throw std::runtime_error("Cannot open output file "s + path);
+        }
+    }
+
+    MappedFileSink::~MappedFileSink() {
+        Close();
+    }
+
+    void MappedFileSink::Close() {
+        if (fallback_) {
+            Flush();
+            fallback_.reset();
+        }
+    }
+
+    void MappedFileSink::WriteOut(string_view head, string_view tail) {
+        Append(head);
+        Append(tail);
+    }
+
+    void MappedFileSink::Append(string_view data) {
+        fallback_->write(data.data(), static_cast<streamsize>(data.size()));
+        file_size_ += data.size();
+    }
+
+#endif
+
+}  // namespace runtime
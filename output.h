@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+
+    /*
+     * Буферизованный приёмник вывода команды print. Данные накапливаются в буфере и передаются
+     * наследнику крупными блоками. Фрагмент, не меньший буфера, передаётся вместе с содержимым буфера
+     * за один вызов WriteOut без копирования. Наследник должен вызвать Flush в своём деструкторе,
+     * так как деструктор базового класса уже не может вызвать WriteOut
+     */
+    class OutputSink {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+        explicit OutputSink(size_t capacity = DEFAULT_CAPACITY);
+
+        OutputSink(const OutputSink &) = delete;
+
+        OutputSink &operator=(const OutputSink &) = delete;
+
+        virtual ~OutputSink();
+
+        void Write(std::string_view text) {
+            if (text.size() <= capacity_ - size_) {
+                text.copy(buffer_.get() + size_, text.size());
+                size_ += text.size();
+            } else {
+                WriteLarge(text);
+            }
+        }
+
+        void Write(char c) {
+            if (size_ == capacity_) {
+                Flush();
+            }
+            buffer_[size_++] = c;
+        }
+
+        // Записывает десятичное представление числа без промежуточных строк
+        void WriteNumber(int value);
+
+        // Передаёт накопленные данные наследнику
+        void Flush();
+
+        // Возвращает поток, который пишет в этот приёмник. Позволяет вывести объект,
+        // умеющий печатать себя только в std::ostream, не нарушая порядок вывода
+        std::ostream &GetStream() {
+            return stream_;
+        }
+
+    protected:
+        // Записывает head, а затем tail. tail может быть пустым
+        virtual void WriteOut(std::string_view head, std::string_view tail) = 0;
+
+    private:
+        // Буфер потока, передающий данные в приёмник
+        class StreamBuffer : public std::streambuf {
+        public:
+            explicit StreamBuffer(OutputSink &sink)
+                    : sink_(sink) {
+            }
+
+        protected:
+            int_type overflow(int_type ch) override;
+
+            std::streamsize xsputn(const char *s, std::streamsize count) override;
+
+        private:
+            OutputSink &sink_;
+        };
+
+        void WriteLarge(std::string_view text);
+
+        std::unique_ptr<char[]> buffer_;
+        size_t capacity_;
+        size_t size_ = 0;
+        StreamBuffer stream_buffer_;
+        std::ostream stream_;
+    };
+
+    // Приёмник, записывающий вывод в поток std::ostream
+    class StreamSink : public OutputSink {
+    public:
+        explicit StreamSink(std::ostream &output, size_t capacity = DEFAULT_CAPACITY)
+                : OutputSink(capacity), output_(output) {
+        }
+
+        ~StreamSink() override;
+
+    protected:
+        void WriteOut(std::string_view head, std::string_view tail) override;
+
+    private:
+        std::ostream &output_;
+    };
+
+    // Приёмник, дописывающий вывод в конец строки output
+    class StringSink : public OutputSink {
+    public:
+        explicit StringSink(std::string &output, size_t capacity = DEFAULT_CAPACITY)
+                : OutputSink(capacity), output_(output) {
+        }
+
+        ~StringSink() override;
+
+    protected:
+        void WriteOut(std::string_view head, std::string_view tail) override;
+
+    private:
+        std::string &output_;
+    };
+
+    /*
+     * Приёмник, записывающий вывод в открытый файловый дескриптор вызовами write(2) и writev(2).
+     * Дескриптор не закрывается. Ошибка записи выбрасывается как runtime_error.
+     * Доступен только на платформах POSIX, на остальных конструктор выбрасывает runtime_error
+     */
+    class FileSink : public OutputSink {
+    public:
+        explicit FileSink(int fd, size_t capacity = DEFAULT_CAPACITY);
+
+        ~FileSink() override;
+
+    protected:
+        void WriteOut(std::string_view head, std::string_view tail) override;
+
+    private:
+        int fd_;
+    };
+
+    /*
+     * Приёмник, записывающий вывод в файл path, отображённый в память. Файл создаётся заново,
+     * увеличивается по мере записи и усекается до размера вывода при закрытии.
+     * На платформах без mmap вывод записывается в файл обычным образом
+     */
+    class MappedFileSink : public OutputSink {
+    public:
+        explicit MappedFileSink(const std::string &path, size_t capacity = DEFAULT_CAPACITY);
+
+        ~MappedFileSink() override;
+
+        // Записывает накопленные данные и закрывает файл. Повторный вызов ничего не делает
+        void Close();
+
+    protected:
+        void WriteOut(std::string_view head, std::string_view tail) override;
+
+    private:
+        void Append(std::string_view data);
+
+        int fd_ = -1;
+        char *mapping_ = nullptr;
+        size_t mapped_size_ = 0;
+        size_t file_size_ = 0;
+        // Используется на платформах без mmap
+        std::unique_ptr<std::ostream> fallback_;
+    };
+
+}  // namespace runtime
@@ -1,8 +1,14 @@
 #include "parse.h"
 
+#include "frozen_program.h"
 #include "lexer.h"
+#include "optimizer.h"
 #include "statement.h"
 
+#include <limits>
+#include <mutex>
+#include <utility>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -17,30 +23,191 @@ namespace {
         return !(token == c);
     }
 
+    // Класс, объявленный в программе, и порядковый номер его объявления
+    struct DeclaredClass {
+        size_t order;
+        const runtime::Class* cls;
+    };
+
+    using DeclaredClasses = unordered_map<runtime::Symbol, DeclaredClass>;
+
+    /*
+     * Тело метода, разбор которого отложен до первого вызова. Хранит текст тела, его смещение и отступ
+     * в тексте программы и классы программы. При разборе видны только классы, объявленные раньше метода,
+     * как и при обычном разборе
+     */
+    class LazyMethodBody : public runtime::Executable {
+    public:
+        LazyMethodBody(string source, size_t offset, size_t indent,
+                       shared_ptr<const DeclaredClasses> declared_classes, size_t visible_classes)
+        : source_(std::move(source))
+        , offset_(offset)
+        , indent_(indent)
+        , declared_classes_(std::move(declared_classes))
+        , visible_classes_(visible_classes) {
+        }
+
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override {
+            return Prepare().Execute(closure, context);
+        }
+
+        // Схема запоминается, а имена разрешаются после разбора тела
+        void ResolveNames(runtime::ClosureLayout& layout) override {
+            layout_ = &layout;
+        }
+
+        runtime::Executable& Prepare() override;
+
+    private:
+        string source_;
+        size_t offset_;
+        size_t indent_;
+        shared_ptr<const DeclaredClasses> declared_classes_;
+        size_t visible_classes_;
+        runtime::ClosureLayout* layout_ = nullptr;
+        once_flag parsed_;
+        unique_ptr<runtime::Executable> body_;
+    };
+
+    // Вызывает visitor(line_begin, line_end, spaces) для каждой строки text, где spaces - количество
+    // пробелов, которые удаляются из начала строки при сдвиге на indent позиций влево
+    template <typename Visitor>
+    void ForEachShiftedLine(string_view text, size_t indent, Visitor visitor) {
+        for (size_t pos = 0; pos < text.size();) {
+            const size_t newline = text.find('\n', pos);
+            const size_t line_end = newline == string_view::npos ? text.size() : newline + 1;
+            size_t spaces = 0;
+            while (spaces < indent && pos + spaces < line_end && text[pos + spaces] == ' ') {
+                ++spaces;
+            }
+            visitor(pos, line_end, spaces);
+            pos = line_end;
+        }
+    }
+
+    // Сдвигает строки тела метода на indent позиций влево, так что тело начинается с начала строки.
+    // Пустые строки и комментарии с меньшим отступом сдвигаются до начала строки
+    string ShiftLeft(string_view text, size_t indent) {
+        string result;
+        result.reserve(text.size());
+        ForEachShiftedLine(text, indent, [&](size_t begin, size_t end, size_t spaces) {
+            result.append(text.substr(begin + spaces, end - begin - spaces));
+        });
+        return result;
+    }
+
+    // Переводит смещение в сдвинутом тексте (см. ShiftLeft) в смещение в исходном тексте text.
+    // Начало строки переходит в начало строки, как и смещение лексемы, чтение которой началось с отступа
+    size_t UnshiftOffset(string_view text, size_t indent, size_t shifted_offset) {
+        size_t result = text.size();
+        size_t shifted_begin = 0;
+        bool found = false;
+        ForEachShiftedLine(text, indent, [&](size_t begin, size_t end, size_t spaces) {
+            const size_t shifted_end = shifted_begin + (end - begin - spaces);
+            if (!found && shifted_offset < shifted_end) {
+                result = shifted_offset == shifted_begin ? begin : begin + spaces + (shifted_offset - shifted_begin);
+                found = true;
+            }
+            shifted_begin = shifted_end;
+        });
+        return result;
+    }
+
     class Parser {
     public:
-        explicit Parser(parse::Lexer& lexer)
-        : lexer_(lexer) {
+        explicit Parser(parse::Lexer& lexer, const ParseOptions& options = {})
+        : lexer_(lexer)
+        , options_(options)
+        , declared_classes_(make_shared<DeclaredClasses>()) {
+        }
+
+        // Парсер отложенного тела метода. Ему видны только первые visible_classes объявленных классов,
+        // а классы, объявленные в самом теле, добавляются в его собственную таблицу
+        Parser(parse::Lexer& lexer, shared_ptr<const DeclaredClasses> declared_classes, size_t visible_classes)
+        : lexer_(lexer)
+        , visible_classes_(visible_classes)
+        , shared_classes_(std::move(declared_classes))
+        , declared_classes_(make_shared<DeclaredClasses>()) {
         }
 
         // Program -> eps
         //          | Statement \n Program
         unique_ptr<ast::Statement> ParseProgram() {
             auto result = make_unique<ast::Compound>();
-            while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
-                result->AddStatement(ParseStatement());
+            while (auto statement = ParseTopLevelStatement()) {
+                result->AddStatement(std::move(statement));
             }
 
+            auto layout = make_shared<runtime::ClosureLayout>();
+            result->ResolveNames(*layout);
+            result->SetLayout(std::move(layout));
             return result;
         }
 
+        // Возвращает очередную оптимизированную инструкцию программы либо nullptr в конце программы
+        unique_ptr<ast::Statement> ParseTopLevelStatement() {
+            if (lexer_.CurrentToken().Is<TokenType::Eof>()) {
+                return nullptr;
+            }
+            try {
+                auto statement = ParseStatement();
+                optimizer_.Optimize(statement);
+                return statement;
+            } catch (ParseError& e) {
+                SetErrorOffset(e);
+                throw;
+            } catch (parse::LexerError& e) {
+                SetErrorOffset(e);
+                throw;
+            }
+        }
+
+        // DeferredMethodBody -> (Statement)+ EOF
+        // Отложенное тело метода разбирается из текста, сдвинутого к началу строки
+        unique_ptr<ast::Statement> ParseMethodBody() {
+            try {
+                in_method_body_ = true;
+                auto block = make_unique<ast::Compound>();
+                while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
+                    block->AddStatement(ParseStatement());
+                }
+                unique_ptr<ast::Statement> body = make_unique<ast::MethodBody>(std::move(block));
+                optimizer_.Optimize(body);
+                return body;
+            } catch (ParseError& e) {
+                SetErrorOffset(e);
+                throw;
+            } catch (parse::LexerError& e) {
+                SetErrorOffset(e);
+                throw;
+            }
+        }
+
+        [[nodiscard]] const ast::OptimizerStats& GetOptimizerStats() const {
+            return optimizer_.GetStats();
+        }
+
     private:
-        // Suite -> NEWLINE INDENT (Statement)+ DEDENT
+        // Запоминает в ошибке смещение текущей лексемы, если смещение ошибки ещё не известно
+        template <typename Error>
+        void SetErrorOffset(Error& error) const {
+            if (!error.offset) {
+                error.offset = lexer_.GetTokenOffset();
+            }
+        }
+
+        // Suite -> NEWLINE Block
         unique_ptr<ast::Statement> ParseSuite()  // NOLINT
         {
             lexer_.Expect<TokenType::Newline>();
-            lexer_.ExpectNext<TokenType::Indent>();
+            lexer_.NextToken();
+            return ParseBlock();
+        }
 
+        // Block -> INDENT (Statement)+ DEDENT
+        unique_ptr<ast::Statement> ParseBlock()  // NOLINT
+        {
+            lexer_.Expect<TokenType::Indent>();
             lexer_.NextToken();
 
             auto result = make_unique<ast::Compound>();
@@ -66,9 +233,9 @@ namespace {
                 lexer_.ExpectNext<TokenType::Char>('(');
 
                 if (lexer_.NextToken().Is<TokenType::Id>()) {
-                    m.formal_params.push_back(lexer_.Expect<TokenType::Id>().value);
+                    m.formal_params.emplace_back(lexer_.Expect<TokenType::Id>().value);
                     while (lexer_.NextToken() == ',') {
-                        m.formal_params.push_back(lexer_.ExpectNext<TokenType::Id>().value);
+                        m.formal_params.emplace_back(lexer_.ExpectNext<TokenType::Id>().value);
                     }
                 }
 
@@ -76,31 +243,87 @@ namespace {
                 lexer_.ExpectNext<TokenType::Char>(':');
                 lexer_.NextToken();
 
-                m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+                if (options_.lazy_method_bodies) {
+                    m.body = SkipMethodBody();
+                } else {
+                    const bool in_method_body = std::exchange(in_method_body_, true);
+                    m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+                    in_method_body_ = in_method_body;
+                    // Тело оптимизируется до создания класса, который разрешает в нём имена
+                    optimizer_.Optimize(m.body);
+                }
 
                 result.push_back(std::move(m));
             }
             return result;
         }
 
+        // Пропускает лексемы тела метода до парного Dedent, запоминая текст тела для отложенного разбора
+        unique_ptr<runtime::Executable> SkipMethodBody() {
+            lexer_.Expect<TokenType::Newline>();
+            lexer_.ExpectNext<TokenType::Indent>();
+            const size_t begin = lexer_.GetTokenOffset();
+            if (lexer_.NextToken().Is<TokenType::Indent>()) {
+                throw ParseError("Unexpected indent in method body"s);
+            }
+            // Отступ тела - отступ его первой лексемы, измеренный лексером
+            const string_view source = lexer_.GetSource();
+            const size_t code = lexer_.GetTokenOffset();
+            const size_t line_begin = source.rfind('\n', code - 1) + 1;
+            const size_t indent = code - line_begin;
+
+            size_t depth = 1;
+            while (true) {
+                const parse::Token& token = lexer_.CurrentToken();
+                if (token.Is<TokenType::Indent>()) {
+                    ++depth;
+                } else if (token.Is<TokenType::Dedent>()) {
+                    if (--depth == 0) {
+                        break;
+                    }
+                } else if (token.Is<TokenType::Eof>()) {
+                    throw ParseError("Unexpected end of method body"s);
+                }
+                lexer_.NextToken();
+            }
+            const size_t end = lexer_.GetTokenOffset();
+            lexer_.NextToken();
+
+            return make_unique<LazyMethodBody>(string(source.substr(begin, end - begin)), begin, indent,
+                                               declared_classes_, declared_classes_->size());
+        }
+
+        // Возвращает класс name, видимый в текущей точке программы, либо nullptr
+        [[nodiscard]] const runtime::Class* FindClass(runtime::Symbol name) const {
+            if (auto it = declared_classes_->find(name); it != declared_classes_->end()) {
+                return it->second.cls;
+            }
+            if (shared_classes_) {
+                auto it = shared_classes_->find(name);
+                if (it != shared_classes_->end() && it->second.order < visible_classes_) {
+                    return it->second.cls;
+                }
+            }
+            return nullptr;
+        }
+
         // ClassDefinition -> Id ['(' Id ')'] : new_line indent MethodList dedent
         unique_ptr<ast::Statement> ParseClassDefinition()  // NOLINT
         {
-            string class_name = lexer_.Expect<TokenType::Id>().value;
+            runtime::Symbol class_name = lexer_.Expect<TokenType::Id>().value;
 
             lexer_.NextToken();
 
             const runtime::Class* base_class = nullptr;
             if (lexer_.CurrentToken() == '(') {
-                auto name = lexer_.ExpectNext<TokenType::Id>().value;
+                runtime::Symbol name = lexer_.ExpectNext<TokenType::Id>().value;
                 lexer_.ExpectNext<TokenType::Char>(')');
                 lexer_.NextToken();
 
-                auto it = declared_classes_.find(name);
-                if (it == declared_classes_.end()) {
-                    throw ParseError("Base class "s + name + " not found for class "s + class_name);
+                base_class = FindClass(name);
+                if (!base_class) {
+                    throw ParseError("Base class "s + name.GetText() + " not found for class "s + class_name.GetText());
                 }
-                base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
             }
 
             lexer_.Expect<TokenType::Char>(':');
@@ -112,23 +335,22 @@ namespace {
             lexer_.Expect<TokenType::Dedent>();
             lexer_.NextToken();
 
-            auto [it, inserted] = declared_classes_.insert({
-                class_name,
-                runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class)),
-                });
-
-            if (!inserted) {
-                throw ParseError("Class "s + class_name + " already exists"s);
+            auto cls = runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class));
+            if (FindClass(class_name)) {
+                throw ParseError("Class "s + class_name.GetText() + " already exists"s);
             }
+            // Класс удерживается узлом ClassDefinition, таблица хранит только указатель на него
+            const auto order = declared_classes_->size();
+            declared_classes_->emplace(class_name, DeclaredClass{order, cls.TryAs<runtime::Class>()});
 
-            return make_unique<ast::ClassDefinition>(it->second);
+            return make_unique<ast::ClassDefinition>(std::move(cls));
         }
 
-        vector<string> ParseDottedIds() {
-            vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
+        vector<runtime::Symbol> ParseDottedIds() {
+            vector<runtime::Symbol> result(1, lexer_.Expect<TokenType::Id>().value);
 
             while (lexer_.NextToken() == '.') {
-                result.push_back(lexer_.ExpectNext<TokenType::Id>().value);
+                result.emplace_back(lexer_.ExpectNext<TokenType::Id>().value);
             }
 
             return result;
@@ -139,8 +361,8 @@ namespace {
         unique_ptr<ast::Statement> ParseAssignmentOrCall() {
             lexer_.Expect<TokenType::Id>();
 
-            vector<string> id_list = ParseDottedIds();
-            string last_name = id_list.back();
+            vector<runtime::Symbol> id_list = ParseDottedIds();
+            runtime::Symbol last_name = id_list.back();
             id_list.pop_back();
 
             if (lexer_.CurrentToken() == '=') {
@@ -156,7 +378,7 @@ namespace {
             lexer_.NextToken();
 
             if (id_list.empty()) {
-                throw ParseError("Mython doesn't support functions, only methods: "s + last_name);
+                throw ParseError("Mython doesn't support functions, only methods: "s + last_name.GetText());
             }
 
             vector<unique_ptr<ast::Statement>> args;
@@ -232,7 +454,7 @@ namespace {
                 return make_unique<ast::NumericConst>(result);
             }
             if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
-                string result = str->value;
+                string result(str->value);
                 lexer_.NextToken();
                 return make_unique<ast::StringConst>(std::move(result));
             }
@@ -253,7 +475,7 @@ namespace {
         }
 
         std::unique_ptr<ast::Statement> ParseDottedIdsInMultExpr() {
-            vector<string> names = ParseDottedIds();
+            vector<runtime::Symbol> names = ParseDottedIds();
 
             if (lexer_.CurrentToken() == '(') {
                 // various calls
@@ -272,17 +494,16 @@ namespace {
                             make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
                             std::move(args));
                 }
-                if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
-                    return make_unique<ast::NewInstance>(
-                            static_cast<const runtime::Class&>(*it->second), std::move(args));  // NOLINT
+                if (const runtime::Class* cls = FindClass(method_name)) {
+                    return make_unique<ast::NewInstance>(*cls, std::move(args));
                 }
-                if (method_name == "str"sv) {
+                if (method_name.GetText() == "str"sv) {
                     if (args.size() != 1) {
                         throw ParseError("Function str takes exactly one argument"s);
                     }
                     return make_unique<ast::Stringify>(std::move(args.front()));
                 }
-                throw ParseError("Unknown call to "s + method_name + "()"s);
+                throw ParseError("Unknown call to "s + method_name.GetText() + "()"s);
             }
             return make_unique<ast::VariableValue>(std::move(names));
         }
@@ -423,6 +644,9 @@ namespace {
             const auto& tok = lexer_.CurrentToken();
 
             if (tok.Is<TokenType::Return>()) {
+                if (!in_method_body_) {
+                    throw ParseError("Return outside of method body"s);
+                }
                 lexer_.NextToken();
                 return make_unique<ast::Return>(ParseTest());
             }
@@ -438,11 +662,115 @@ namespace {
         }
 
         parse::Lexer& lexer_;
-        runtime::Closure declared_classes_;
+        ParseOptions options_;
+        ast::Optimizer optimizer_;
+        // Классы программы, видимые отложенному телу метода
+        size_t visible_classes_ = 0;
+        shared_ptr<const DeclaredClasses> shared_classes_;
+        // Классы, объявленные этим парсером
+        shared_ptr<DeclaredClasses> declared_classes_;
+        // Разбирается тело метода: только в нём допустима инструкция return
+        bool in_method_body_ = false;
     };
 
+    runtime::Executable& LazyMethodBody::Prepare() {
+        call_once(parsed_, [this] {
+            const string text = ShiftLeft(source_, indent_);
+            runtime::AstArena::Scope arena;
+            unique_ptr<runtime::Executable> body;
+            // Смещения ошибок переводятся из сдвинутого текста тела в текст программы
+            auto unshift = [this](auto& error) {
+                if (error.offset) {
+                    error.offset = offset_ + UnshiftOffset(source_, indent_, *error.offset);
+                }
+            };
+            try {
+                parse::Lexer lexer(string_view{text});
+                body = Parser(lexer, declared_classes_, visible_classes_).ParseMethodBody();
+            } catch (ParseError& e) {
+                unshift(e);
+                throw;
+            } catch (parse::LexerError& e) {
+                unshift(e);
+                throw;
+            }
+            if (layout_) {
+                body->ResolveNames(*layout_);
+            }
+            body_ = std::move(body);
+            string().swap(source_);
+            // Классы программы нужны только для разбора
+            declared_classes_.reset();
+        });
+        return *body_;
+    }
+
 }  // namespace
 
-unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
-    return Parser{lexer}.ParseProgram();
+unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer, ast::OptimizerStats* stats) {
+    return ParseProgram(lexer, ParseOptions{}, stats);
+}
+
+unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer, const ParseOptions& options,
+                                             ast::OptimizerStats* stats) {
+    // Узлы дерева размещаются подряд в арене, которая освобождается вместе с последним из них
+    runtime::AstArena::Scope arena;
+    Parser parser{lexer, options};
+    auto program = parser.ParseProgram();
+    if (stats) {
+        *stats = parser.GetOptimizerStats();
+    }
+    return program;
+}
+
+shared_ptr<const runtime::FrozenProgram> ParseFrozenProgram(parse::Lexer& lexer, const ParseOptions& options) {
+    return make_shared<const runtime::FrozenProgram>(ParseProgram(lexer, options));
+}
+
+namespace {
+
+    // Сохраняет классы, объявленные в инструкции node, в том числе в ветках if
+    void CollectClasses(runtime::Executable& node, vector<runtime::ObjectHolder>& classes) {  // NOLINT
+        if (const auto* class_def = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+            classes.push_back(class_def->GetClass());
+        }
+        node.ForEachChild([&classes](unique_ptr<runtime::Executable>& child) {
+            if (child) {
+                CollectClasses(*child, classes);
+            }
+        });
+    }
+
+}  // namespace
+
+struct StatementParser::Impl {
+    Parser parser;
+    // Классы программы. Инструкции, объявившие их, уже удалены, но классы нужны следующим инструкциям
+    vector<runtime::ObjectHolder> classes;
+};
+
+StatementParser::StatementParser(parse::Lexer& lexer, const ParseOptions& options)
+: impl_(new Impl{Parser{lexer, options}, {}}) {
+}
+
+StatementParser::~StatementParser() = default;
+
+unique_ptr<runtime::Executable> StatementParser::Next() {
+    auto statement = impl_->parser.ParseTopLevelStatement();
+    if (statement) {
+        CollectClasses(*statement, impl_->classes);
+    }
+    return statement;
+}
+
+const ast::OptimizerStats& StatementParser::GetOptimizerStats() const {
+    return impl_->parser.GetOptimizerStats();
+}
+
+void ExecuteStreaming(parse::Lexer& lexer, runtime::Closure& globals, runtime::Context& context,
+                      const ParseOptions& options) {
+    StatementParser parser{lexer, options};
+    while (auto statement = parser.Next()) {
+        statement->Execute(globals, context);
+    }
 }
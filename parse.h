@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 
 namespace parse {
@@ -9,10 +11,68 @@ namespace parse {
 
 namespace runtime {
     class Executable;
+    class Closure;
+    class Context;
+    class FrozenProgram;
+}
+
+namespace ast {
+    struct OptimizerStats;
 }
 
 struct ParseError : std::runtime_error {
     using std::runtime_error::runtime_error;
+
+    // Смещение в тексте программы, на котором обнаружена ошибка, если оно известно.
+    // Для ошибки в отложенном теле метода это смещение в исходном тексте программы, как и при обычном разборе
+    std::optional<size_t> offset;
+};
+
+// Параметры разбора программы
+struct ParseOptions {
+    // Тело метода разбирается при первом вызове метода, а при разборе программы только пропускается.
+    // Ошибки в теле метода в этом режиме выбрасываются при его первом вызове
+    bool lazy_method_bodies = false;
+};
+
+// Разбирает и оптимизирует программу. Если stats не равен nullptr, в него записывается отчёт оптимизатора
+std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer, ast::OptimizerStats* stats = nullptr);
+
+std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer, const ParseOptions& options,
+                                                  ast::OptimizerStats* stats = nullptr);
+
+// Разбирает программу и замораживает её (см. runtime::FrozenProgram). Результат можно одновременно
+// выполнять из нескольких потоков
+std::shared_ptr<const runtime::FrozenProgram> ParseFrozenProgram(parse::Lexer& lexer, const ParseOptions& options = {});
+
+/*
+ * Разбирает программу по одной инструкции верхнего уровня. Инструкции не связываются со схемой
+ * глобальных переменных, так как следующие инструкции ещё не разобраны: глобальные переменные
+ * ищутся по имени. Узлы размещаются в куче, поэтому выполненную инструкцию можно сразу удалить.
+ * Объявленные классы удерживаются парсером до его уничтожения
+ */
+class StatementParser {
+public:
+    explicit StatementParser(parse::Lexer& lexer, const ParseOptions& options = {});
+
+    StatementParser(const StatementParser&) = delete;
+
+    StatementParser& operator=(const StatementParser&) = delete;
+
+    ~StatementParser();
+
+    // Возвращает следующую оптимизированную инструкцию верхнего уровня либо nullptr в конце программы
+    std::unique_ptr<runtime::Executable> Next();
+
+    [[nodiscard]] const ast::OptimizerStats& GetOptimizerStats() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
+// Выполняет программу по мере разбора: каждая инструкция верхнего уровня выполняется сразу после разбора
+// и удаляется после выполнения. Вывод начинается до окончания разбора, а память под дерево программы
+// не растёт с её длиной. Глобальные переменные программы хранятся в globals
+void ExecuteStreaming(parse::Lexer& lexer, runtime::Closure& globals, runtime::Context& context,
+                      const ParseOptions& options = {});
@@ -0,0 +1,89 @@
+#include "program_cache.h"
+
+#include "lexer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+using namespace std;
+
+namespace serialize {
+
+    namespace fs = std::filesystem;
+
+    ProgramCache::ProgramCache(fs::path directory)
+            : directory_(std::move(directory)) {
+    }
+
+    unique_ptr<runtime::Executable> ProgramCache::Load(string_view source, const ParseOptions &options) {
+        const SourceKey key = GetProgramKey(source, options);
+        const fs::path path = GetImagePath(key);
+
+        std::error_code ec;
+        if (fs::exists(path, ec)) {
+            try {
+                parse::MappedFile file(path.string());
+                if (ReadSourceKey(file.GetText()) == key) {
+                    auto program = DeserializeProgram(file.GetText());
+                    ++hits_;
+                    return program;
+                }
+            } catch (const std::runtime_error &) {
+                // Образ повреждён, имеет другую версию формата либо недоступен - программа разбирается заново
+            }
+        }
+
+        ++misses_;
+        parse::Lexer lexer(source);
+        auto program = ParseProgram(lexer, options);
+        string image;
+        try {
+            image = SerializeProgram(*program, key);
+        } catch (const std::runtime_error &) {
+            // Отложенное тело метода содержит ошибку разбора - программа возвращается без сохранения
+            return program;
+        }
+        Store(path, image);
+        return program;
+    }
+
+    SourceKey ProgramCache::GetProgramKey(string_view source, const ParseOptions &options) {
+        // Образы программы, разобранной с разными параметрами, не подменяют друг друга.
+        // Параметры по умолчанию дают нулевые флаги
+        const uint64_t flags = options.lazy_method_bodies ? 1U : 0U;
+        return GetSourceKey(source, flags);
+    }
+
+    fs::path ProgramCache::GetImagePath(const SourceKey &key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.myi", static_cast<unsigned long long>(key.hash));
+        return directory_ / name;
+    }
+
+    void ProgramCache::Store(const fs::path &path, const string &image) const {
+        std::error_code ec;
+        fs::create_directories(directory_, ec);
+        if (ec) {
+            return;
+        }
+
+        fs::path temp = path;
+        temp += ".tmp"s + to_string(std::random_device{}());
+        {
+            ofstream file(temp, ios::binary | ios::trunc);
+            file.write(image.data(), static_cast<streamsize>(image.size()));
+            if (!file) {
+                file.close();
+                fs::remove(temp, ec);
+                return;
+            }
+        }
+        // Переименование атомарно: другой процесс видит либо прежний образ, либо новый целиком
+        fs::rename(temp, path, ec);
+        if (ec) {
+            fs::remove(temp, ec);
+        }
+    }
+
+}  // namespace serialize
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "parse.h"
+#include "runtime.h"
+#include "serialize.h"
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+namespace serialize {
+
+    /*
+     * Кеш разобранных программ на диске. Образ программы (см. SerializeProgram) хранится в каталоге
+     * кеша в файле, имя которого - хеш исходного текста и параметров разбора. При повторном запуске неизменённой программы
+     * образ отображается в память и восстанавливается без лексического и синтаксического разбора.
+     * Повреждённый либо устаревший образ разбирается заново и перезаписывается. Образ записывается
+     * во временный файл и переименовывается, поэтому несколько процессов могут использовать один каталог.
+     * Объект кеша предназначен для использования из одного потока
+     */
+    class ProgramCache {
+    public:
+        explicit ProgramCache(std::filesystem::path directory);
+
+        // Возвращает программу с текстом source, разобранную с параметрами options: из образа в кеше
+        // либо, если образа нет, разбирает текст и сохраняет образ. Ошибки разбора программы выбрасываются
+        // как обычно, ошибки записи в каталог кеша игнорируются. Программа, отложенное тело метода которой
+        // содержит ошибку, не кешируется: ошибка должна выбрасываться при вызове метода
+        std::unique_ptr<runtime::Executable> Load(std::string_view source, const ParseOptions &options = {});
+
+        // Возвращает ключ образа программы с текстом source, разобранной с параметрами options
+        [[nodiscard]] static SourceKey GetProgramKey(std::string_view source, const ParseOptions &options = {});
+
+        // Возвращает путь к файлу образа программы с ключом key
+        [[nodiscard]] std::filesystem::path GetImagePath(const SourceKey &key) const;
+
+        // Количество программ, загруженных из кеша
+        [[nodiscard]] size_t GetHits() const {
+            return hits_;
+        }
+
+        // Количество программ, которые пришлось разобрать
+        [[nodiscard]] size_t GetMisses() const {
+            return misses_;
+        }
+
+    private:
+        void Store(const std::filesystem::path &path, const std::string &image) const;
+
+        std::filesystem::path directory_;
+        size_t hits_ = 0;
+        size_t misses_ = 0;
+    };
+
+}  // namespace serialize
@@ -1,6 +1,9 @@
 #include "runtime.h"
 
+#include <atomic>
 #include <cassert>
+#include <functional>
+#include <limits>
 #include <optional>
 #include <sstream>
 
@@ -8,21 +11,148 @@ using namespace std;
 
 namespace runtime {
 
+    //////////////////////////////////////////////////////////////////////////////
+    //
+    //  Object
+
+    void Object::AppendTo(std::string &out, Context &context) {
+        std::ostringstream ss;
+        Print(ss, context);
+        out += ss.str();
+    }
+
     //////////////////////////////////////////////////////////////////////////////
     //
     //  ObjectHolder
 
-    ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
-            : data_(std::move(data)) {
+    ObjectHolder::ObjectHolder(std::shared_ptr<Object> data) {
+        if (data) {
+            new(&storage_.heap) std::shared_ptr<Object>(std::move(data));
+            kind_ = Kind::HEAP;
+        }
+    }
+
+    ObjectHolder::ObjectHolder(const ObjectHolder &other) {
+        switch (other.kind_) {
+            case Kind::EMPTY:
+                break;
+            case Kind::NUMBER:
+                new(&storage_.number) Number(other.storage_.number);
+                break;
+            case Kind::BOOL:
+                new(&storage_.boolean) Bool(other.storage_.boolean);
+                break;
+            case Kind::HEAP:
+                new(&storage_.heap) std::shared_ptr<Object>(other.storage_.heap);
+                break;
+            case Kind::BORROWED:
+                storage_.borrowed = other.storage_.borrowed;
+                break;
+        }
+        kind_ = other.kind_;
+    }
+
+    ObjectHolder::ObjectHolder(ObjectHolder &&other) noexcept {
+        MoveFrom(other);
+    }
+
+    ObjectHolder &ObjectHolder::operator=(const ObjectHolder &other) {
+        if (this != &other) {
+            // other может принадлежать объекту, который будет разрушен при очистке *this,
+            // поэтому сначала делаем копию
+            ObjectHolder copy(other);
+            Reset();
+            MoveFrom(copy);
+        }
+        return *this;
+    }
+
+    ObjectHolder &ObjectHolder::operator=(ObjectHolder &&other) noexcept {
+        if (this != &other) {
+            ObjectHolder temp(std::move(other));
+            Reset();
+            MoveFrom(temp);
+        }
+        return *this;
+    }
+
+    ObjectHolder::~ObjectHolder() {
+        Reset();
+    }
+
+    void ObjectHolder::Reset() noexcept {
+        switch (kind_) {
+            case Kind::EMPTY:
+                break;
+            case Kind::NUMBER:
+                storage_.number.~Number();
+                break;
+            case Kind::BOOL:
+                storage_.boolean.~Bool();
+                break;
+            case Kind::HEAP:
+                storage_.heap.~shared_ptr();
+                break;
+            case Kind::BORROWED:
+                break;
+        }
+        kind_ = Kind::EMPTY;
+    }
+
+    void ObjectHolder::MoveFrom(ObjectHolder &other) noexcept {
+        switch (other.kind_) {
+            case Kind::EMPTY:
+                break;
+            case Kind::NUMBER:
+                new(&storage_.number) Number(other.storage_.number);
+                break;
+            case Kind::BOOL:
+                new(&storage_.boolean) Bool(other.storage_.boolean);
+                break;
+            case Kind::HEAP:
+                new(&storage_.heap) std::shared_ptr<Object>(std::move(other.storage_.heap));
+                break;
+            case Kind::BORROWED:
+                storage_.borrowed = other.storage_.borrowed;
+                break;
+        }
+        kind_ = other.kind_;
+        other.Reset();
     }
 
     void ObjectHolder::AssertIsValid() const {
-        assert(data_ != nullptr);
+        assert(kind_ != Kind::EMPTY);
     }
 
     ObjectHolder ObjectHolder::Share(Object &object) {
-        // Возвращаем невладеющий shared_ptr (его deleter ничего не делает)
-        return ObjectHolder(std::shared_ptr<Object>(&object, [](auto * /*p*/) { /* do nothing */ }));
+        ObjectHolder holder;
+        holder.storage_.borrowed = &object;
+        holder.kind_ = Kind::BORROWED;
+        return holder;
+    }
+
+    void ObjectHolder::RetainBorrowed() {
+        Object *object = storage_.borrowed;
+        switch (object->GetType()) {
+            // Значения Mython неизменяемы, поэтому копия неотличима от заимствованного значения
+            case ObjectType::NUMBER:
+                *this = Own(Number{static_cast<Number *>(object)->GetValue()});
+                break;
+            case ObjectType::BOOL:
+                *this = Own(Bool{static_cast<Bool *>(object)->GetValue()});
+                break;
+            case ObjectType::STRING:
+                *this = Own(String{static_cast<String *>(object)->GetValue()});
+                break;
+            case ObjectType::CLASS_INSTANCE:
+                // Пустой weak_ptr означает, что экземпляр не принадлежит shared_ptr (например, размещён на стеке)
+                if (auto owner = static_cast<ClassInstance *>(object)->weak_from_this().lock()) {
+                    *this = ObjectHolder(std::shared_ptr<Object>(std::move(owner)));
+                }
+                break;
+            default:
+                break;
+        }
     }
 
     ObjectHolder ObjectHolder::None() {
@@ -40,31 +170,394 @@ namespace runtime {
     }
 
     Object *ObjectHolder::Get() const {
-        return data_.get();
+        switch (kind_) {
+            case Kind::NUMBER:
+                return const_cast<Number *>(&storage_.number);
+            case Kind::BOOL:
+                return const_cast<Bool *>(&storage_.boolean);
+            case Kind::HEAP:
+                return storage_.heap.get();
+            case Kind::BORROWED:
+                return storage_.borrowed;
+            default:
+                return nullptr;
+        }
     }
 
     ObjectHolder::operator bool() const {
-        return Get() != nullptr;
+        return kind_ != Kind::EMPTY;
     }
 
+    namespace {
+        // Приводит объект к типу T. Тип объекта должен быть предварительно проверен по его метке
+        template<typename T>
+        const T &Cast(const ObjectHolder &object) {
+            return *static_cast<const T *>(object.Get());
+        }
+    }  // namespace
+
     bool IsTrue(const ObjectHolder &object) {
-        if (!object) {
-            return false;
-        } else {
-            if (object.TryAs<Bool>()) {
-                return object.TryAs<Bool>()->GetValue();
-            } else if (object.TryAs<Number>()) {
-                return object.TryAs<Number>()->GetValue() != 0;
-            } else if (object.TryAs<String>()) {
-                return !object.TryAs<String>()->GetValue().empty();
-            } else if (object.TryAs<Class>()) {
+        switch (object.GetType()) {
+            case ObjectType::NONE:
                 return false;
-            } else if (object.TryAs<ClassInstance>()) {
+            case ObjectType::BOOL:
+                return Cast<Bool>(object).GetValue();
+            case ObjectType::NUMBER:
+                return Cast<Number>(object).GetValue() != 0;
+            case ObjectType::STRING:
+                return !Cast<String>(object).GetValue().empty();
+            case ObjectType::CLASS:
+            case ObjectType::CLASS_INSTANCE:
                 return false;
+            default:
+                return true;
+        }
+    }
+
+    ObjectHolder ToString(const ObjectHolder &object, Context &context) {
+        // Строки неизменяемы, поэтому общие значения передаются заимствованными ссылками
+        static String none_string{"None"s};
+        static String true_string{"True"s};
+        static String false_string{"False"s};
+
+        switch (object.GetType()) {
+            case ObjectType::NONE:
+                return ObjectHolder::Share(none_string);
+            case ObjectType::BOOL:
+                return ObjectHolder::Share(Cast<Bool>(object).GetValue() ? true_string : false_string);
+            case ObjectType::STRING: {
+                // Результат может пережить аргумент, поэтому заимствованная константа копируется,
+                // а собственная строка разделяется без копирования
+                ObjectHolder result = object;
+                result.Retain();
+                return result;
+            }
+            default: {
+                std::string result;
+                object->AppendTo(result, context);
+                return ObjectHolder::Own(String{std::move(result)});
+            }
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////////
+    //
+    //  ClosureLayout
+
+    const ClosureLayout *ClosureLayout::GetEmptyShape() {
+        static const ClosureLayout empty_shape;
+        return &empty_shape;
+    }
+
+    namespace {
+        std::atomic<std::uint64_t> next_layout_id{0};
+    }  // namespace
+
+    ClosureLayout::ClosureLayout()
+            : id_(++next_layout_id) {
+    }
+
+    const ClosureLayout *ClosureLayout::AddTransition(Symbol name) const {
+        // Схема, полученная переходом, оканчивается добавленным полем
+        for (const auto &published : published_) {
+            const ClosureLayout *transition = published.load(std::memory_order_acquire);
+            if (!transition) {
+                break;
+            }
+            if (transition->names_.back() == name) {
+                return transition;
+            }
+        }
+
+        std::lock_guard guard(transitions_mutex_);
+        auto &transition = transitions_[name];
+        if (!transition) {
+            auto shape = std::make_unique<ClosureLayout>();
+            shape->parent_ = this;
+            shape->names_ = names_;
+            shape->slots_ = slots_;
+            shape->AddName(name);
+            const size_t size = shape->GetSize();
+            shape->max_shape_size_.store(size, std::memory_order_relaxed);
+            for (const ClosureLayout *ancestor = this; ancestor; ancestor = ancestor->parent_) {
+                size_t max_size = ancestor->max_shape_size_.load(std::memory_order_relaxed);
+                while (max_size < size && !ancestor->max_shape_size_.compare_exchange_weak(
+                        max_size, size, std::memory_order_relaxed)) {
+                }
+            }
+            transition = std::move(shape);
+            for (auto &published : published_) {
+                if (!published.load(std::memory_order_relaxed)) {
+                    published.store(transition.get(), std::memory_order_release);
+                    break;
+                }
+            }
+        }
+        return transition.get();
+    }
+
+    size_t ClosureLayout::AddName(Symbol name) {
+        auto [it, inserted] = slots_.emplace(name, names_.size());
+        if (inserted) {
+            names_.push_back(name);
+        }
+        return it->second;
+    }
+
+    size_t ClosureLayout::FindSlot(Symbol name) const {
+        auto it = slots_.find(name);
+        return it == slots_.end() ? NO_SLOT : it->second;
+    }
+
+    Symbol ClosureLayout::GetName(size_t slot) const {
+        return names_.at(slot);
+    }
+
+    size_t ClosureLayout::GetSize() const {
+        return names_.size();
+    }
+
+    //////////////////////////////////////////////////////////////////////////////
+    //
+    //  Closure
+
+    Closure::Closure(std::shared_ptr<const ClosureLayout> layout)
+            : layout_(layout.get()), layout_owner_(std::move(layout)) {
+        if (layout_) {
+            slots_.resize(layout_->GetSize(), GetUnbound());
+        }
+    }
+
+    Closure::Closure(std::initializer_list<std::pair<const Symbol, ObjectHolder>> variables)
+            : dictionary_(std::make_unique<Dictionary>(variables)) {
+    }
+
+    Closure::Closure(const Closure &other)
+            : layout_(other.layout_),
+              layout_owner_(other.layout_owner_),
+              slots_(other.slots_),
+              dictionary_(other.dictionary_ ? std::make_unique<Dictionary>(*other.dictionary_) : nullptr),
+              with_shapes_(other.with_shapes_),
+              returned_(other.returned_) {
+    }
+
+    Closure::Closure(Closure &&other) noexcept
+            : layout_(std::exchange(other.layout_, nullptr)),
+              layout_owner_(std::move(other.layout_owner_)),
+              slots_(std::move(other.slots_)),
+              dictionary_(std::move(other.dictionary_)),
+              with_shapes_(std::exchange(other.with_shapes_, false)),
+              returned_(std::exchange(other.returned_, false)) {
+    }
+
+    Closure &Closure::operator=(const Closure &other) {
+        if (this != &other) {
+            *this = Closure(other);
+        }
+        return *this;
+    }
+
+    Closure &Closure::operator=(Closure &&other) noexcept {
+        if (this != &other) {
+            layout_ = std::exchange(other.layout_, nullptr);
+            layout_owner_ = std::move(other.layout_owner_);
+            slots_ = std::move(other.slots_);
+            dictionary_ = std::move(other.dictionary_);
+            with_shapes_ = std::exchange(other.with_shapes_, false);
+            returned_ = std::exchange(other.returned_, false);
+        }
+        return *this;
+    }
+
+    Closure Closure::WithShapes() {
+        Closure result;
+        result.layout_ = ClosureLayout::GetEmptyShape();
+        result.with_shapes_ = true;
+        return result;
+    }
+
+    const ClosureLayout *Closure::GetLayout() const {
+        return layout_;
+    }
+
+    void Closure::SetLayout(std::shared_ptr<const ClosureLayout> layout) {
+        Closure result(std::move(layout));
+        for (auto [name, value] : *this) {
+            result[name] = std::move(value);
+        }
+        *this = std::move(result);
+    }
+
+    ObjectHolder *Closure::GetSlot(size_t slot) {
+        auto &value = slots_[slot];
+        return IsBound(value) ? &value : nullptr;
+    }
+
+    ObjectHolder &Closure::SetSlot(size_t slot, ObjectHolder value) {
+        return slots_[slot] = std::move(value);
+    }
+
+    ObjectHolder *Closure::Find(Symbol name) {
+        return const_cast<ObjectHolder *>(std::as_const(*this).Find(name));
+    }
+
+    const ObjectHolder *Closure::Find(Symbol name) const {
+        if (layout_) {
+            if (size_t slot = layout_->FindSlot(name); slot != ClosureLayout::NO_SLOT) {
+                const auto &value = slots_[slot];
+                return IsBound(value) ? &value : nullptr;
+            }
+        }
+        if (!dictionary_) {
+            return nullptr;
+        }
+        auto it = dictionary_->find(name);
+        return it == dictionary_->end() ? nullptr : &it->second;
+    }
+
+    ObjectHolder *Closure::Find(Symbol name, SlotCache &cache) {
+        // Кешируются только слоты схем полей: схема определяется по её идентификатору
+        if (!with_shapes_) {
+            return Find(name);
+        }
+        const std::uint64_t cached = cache.layout_and_slot.load(std::memory_order_relaxed);
+        if ((cached >> SlotCache::SLOT_BITS) == layout_->GetId()) {
+            return &slots_[cached & SlotCache::SLOT_MASK];
+        }
+        const size_t slot = layout_->FindSlot(name);
+        if (slot == ClosureLayout::NO_SLOT) {
+            return nullptr;
+        }
+        if (slot <= SlotCache::SLOT_MASK) {
+            cache.layout_and_slot.store((layout_->GetId() << SlotCache::SLOT_BITS) | slot, std::memory_order_relaxed);
+        }
+        return &slots_[slot];
+    }
+
+    ObjectHolder &Closure::Assign(Symbol name, SlotCache &cache) {
+        if (auto *value = Find(name, cache)) {
+            return *value;
+        }
+        return (*this)[name];
+    }
+
+    void Closure::Reset(const ClosureLayout *layout) {
+        slots_.assign(layout ? layout->GetSize() : 0, GetUnbound());
+        layout_ = layout;
+        layout_owner_.reset();
+        dictionary_.reset();
+        with_shapes_ = false;
+        returned_ = false;
+    }
+
+    Closure::iterator Closure::find(Symbol name) {
+        if (layout_) {
+            if (size_t slot = layout_->FindSlot(name); slot != ClosureLayout::NO_SLOT) {
+                return IsBound(slots_[slot]) ? iterator{this, slot, GetDictionary().begin()} : end();
+            }
+        }
+        return {this, slots_.size(), GetDictionary().find(name)};
+    }
+
+    Closure::const_iterator Closure::find(Symbol name) const {
+        if (layout_) {
+            if (size_t slot = layout_->FindSlot(name); slot != ClosureLayout::NO_SLOT) {
+                return IsBound(slots_[slot]) ? const_iterator{this, slot, GetDictionary().begin()} : end();
             }
+        }
+        return {this, slots_.size(), GetDictionary().find(name)};
+    }
+
+    Closure::iterator Closure::begin() {
+        return {this, 0, GetDictionary().begin()};
+    }
+
+    Closure::iterator Closure::end() {
+        return {this, slots_.size(), GetDictionary().end()};
+    }
+
+    Closure::const_iterator Closure::begin() const {
+        return {this, 0, GetDictionary().begin()};
+    }
+
+    Closure::const_iterator Closure::end() const {
+        return {this, slots_.size(), GetDictionary().end()};
+    }
+
+    size_t Closure::count(Symbol name) const {
+        return Find(name) ? 1 : 0;
+    }
+
+    ObjectHolder &Closure::at(Symbol name) {
+        return const_cast<ObjectHolder &>(std::as_const(*this).at(name));
+    }
 
+    const ObjectHolder &Closure::at(Symbol name) const {
+        if (const auto *value = Find(name)) {
+            return *value;
+        }
+        throw std::out_of_range("Closure has no variable "s + name.GetText());
+    }
+
+    ObjectHolder &Closure::operator[](Symbol name) {
+        if (layout_) {
+            if (size_t slot = layout_->FindSlot(name); slot != ClosureLayout::NO_SLOT) {
+                auto &value = slots_[slot];
+                if (!IsBound(value)) {
+                    value = ObjectHolder::None();
+                }
+                return value;
+            }
+        }
+        if (with_shapes_) {
+            if (slots_.capacity() == 0) {
+                slots_.reserve(std::max<size_t>(layout_->GetMaxShapeSize(), 1));
+            }
+            layout_ = layout_->AddTransition(name);
+            return slots_.emplace_back();
+        }
+        if (!dictionary_) {
+            dictionary_ = std::make_unique<Dictionary>();
         }
-        return true;
+        return (*dictionary_)[name];
+    }
+
+    size_t Closure::size() const {
+        size_t result = dictionary_ ? dictionary_->size() : 0;
+        for (const auto &value : slots_) {
+            result += IsBound(value);
+        }
+        return result;
+    }
+
+    bool Closure::empty() const {
+        return size() == 0;
+    }
+
+    void Closure::clear() {
+        if (with_shapes_) {
+            layout_ = ClosureLayout::GetEmptyShape();
+            slots_.clear();
+        }
+        for (auto &value : slots_) {
+            value = GetUnbound();
+        }
+        dictionary_.reset();
+    }
+
+    Closure::Dictionary &Closure::GetEmptyDictionary() {
+        static Dictionary empty_dictionary;
+        return empty_dictionary;
+    }
+
+    const ObjectHolder &Closure::GetUnbound() {
+        static Bool unbound_marker{false};
+        static const ObjectHolder unbound = ObjectHolder::Share(unbound_marker);
+        return unbound;
+    }
+
+    Closure::Dictionary &Closure::GetDictionary() const {
+        return dictionary_ ? *dictionary_ : GetEmptyDictionary();
     }
 
     //////////////////////////////////////////////////////////////////////////////
@@ -72,23 +565,48 @@ namespace runtime {
     //  ClassInstance
 
     ClassInstance::ClassInstance(const Class &cls)
-            : cls_(cls) {
-        //self_ = std::shared_ptr<ClassInstance>(this, [](auto * /*p*/) { /* do nothing */ });
-        //p_locals_ = new Closure {};
+            : Object(ObjectType::CLASS_INSTANCE), cls_(cls), closure_(Closure::WithShapes()) {
     }
 
     void ClassInstance::Print(std::ostream &os, Context &context) {
-        const string STR_METHOD = "__str__"s;
-        if (HasMethod(STR_METHOD, 0)) {
-            Call(STR_METHOD, {}, context)->Print(os, context);
+        static const Symbol STR_METHOD{"__str__"};
+        if (const auto *method = cls_.FindMethod(STR_METHOD, 0)) {
+            Call(*method, nullptr, 0, context)->Print(os, context);
         } else {
             os << this;
         }
     }
 
-    bool ClassInstance::HasMethod(const std::string &method, size_t argument_count) const {
-        auto *p_method = cls_.GetMethod(method);
-        return p_method && p_method->formal_params.size() == argument_count;
+    void ClassInstance::PrintTo(OutputSink &sink, Context &context) {
+        static const Symbol STR_METHOD{"__str__"};
+        if (const auto *method = cls_.FindMethod(STR_METHOD, 0)) {
+            ObjectHolder result = Call(*method, nullptr, 0, context);
+            if (result) {
+                result->PrintTo(sink, context);
+            } else {
+                sink.Write("None"sv);
+            }
+        } else {
+            Object::PrintTo(sink, context);
+        }
+    }
+
+    void ClassInstance::AppendTo(std::string &out, Context &context) {
+        static const Symbol STR_METHOD{"__str__"};
+        if (const auto *method = cls_.FindMethod(STR_METHOD, 0)) {
+            ObjectHolder result = Call(*method, nullptr, 0, context);
+            if (result) {
+                result->AppendTo(out, context);
+            } else {
+                out += "None"sv;
+            }
+        } else {
+            Object::AppendTo(out, context);
+        }
+    }
+
+    bool ClassInstance::HasMethod(Symbol method, size_t argument_count) const {
+        return cls_.FindMethod(method, argument_count) != nullptr;
     }
 
     Closure &ClassInstance::Fields() {
@@ -99,43 +617,107 @@ namespace runtime {
         return closure_;
     }
 
-    ObjectHolder ClassInstance::Call(const std::string &method,
+    const Class &ClassInstance::GetClass() const {
+        return cls_;
+    }
+
+    ObjectHolder ClassInstance::Call(Symbol method,
                                      const std::vector<ObjectHolder> &actual_args,
                                      Context &context) {
-        if (!HasMethod(method, actual_args.size())) {
+        const auto *p_method = cls_.FindMethod(method, actual_args.size());
+        if (!p_method) {
             throw std::runtime_error("Method not found."s);
         }
-        auto *p_method = cls_.GetMethod(method);
-        Closure locals;
-        locals["self"s] = ObjectHolder::Share(*this);
-        //locals["self"s] = ObjectHolder::Share(*self_);
-        for (size_t i = 0; i < p_method->formal_params.size(); ++i) {
-            locals[p_method->formal_params.at(i)] = actual_args.at(i);
+        return Call(*p_method, actual_args.data(), actual_args.size(), context);
+    }
+
+    ObjectHolder ClassInstance::Call(const Method &method, const ObjectHolder *actual_args, size_t argument_count,
+                                     Context &context) {
+        Executable &body = method.body->Prepare();
+        auto frame = CallStack::GetInstance().PushFrame(method.layout.get());
+        Closure &locals = frame.GetClosure();
+        if (method.layout) {
+            // self и формальные параметры занимают первые слоты схемы
+            locals.SetSlot(0, ObjectHolder::Share(*this));
+            for (size_t i = 0; i < argument_count; ++i) {
+                locals.SetSlot(i + 1, actual_args[i]);
+            }
+        } else {
+            static const Symbol SELF{"self"};
+            locals[SELF] = ObjectHolder::Share(*this);
+            for (size_t i = 0; i < argument_count; ++i) {
+                locals[method.formal_params.at(i)] = actual_args[i];
+            }
         }
-        return p_method->body->Execute(locals, context);
+        return body.Execute(locals, context);
     }
 
     //////////////////////////////////////////////////////////////////////////////
     //
-    //  Class
+    //  CallStack
 
-    Class::Class(std::string name, std::vector<Method> methods, const Class *parent)
-            : name_(std::move(name)), methods_(std::move(methods)), parent_(parent) {
-        for (size_t i = 0; i < methods_.size(); ++i) {
-            methods_by_name_[methods_.at(i).name] = i;
+    CallStack &CallStack::GetInstance() {
+        thread_local CallStack call_stack;
+        return call_stack;
+    }
+
+    CallStack::Frame CallStack::PushFrame(const ClosureLayout *layout) {
+        if (depth_ == frames_.size()) {
+            frames_.push_back(std::make_unique<Closure>());
         }
+        frames_[depth_++]->Reset(layout);
+        return Frame(*this);
     }
 
-    const Method *Class::GetMethod(const std::string &name) const {
-        if (methods_by_name_.count(name)) {
-            return &methods_.at(methods_by_name_.at(name));
-        } else if (parent_) {
-            return parent_->GetMethod(name);
+    //////////////////////////////////////////////////////////////////////////////
+    //
+    //  Class
+
+    namespace {
+        std::atomic<std::uint64_t> next_class_id{0};
+    }  // namespace
+
+    Class::Class(Symbol name, std::vector<Method> methods, const Class *parent)
+            : Object(ObjectType::CLASS), id_(++next_class_id), name_(std::move(name)), methods_(std::move(methods)), parent_(parent) {
+        if (parent_) {
+            methods_by_name_ = parent_->methods_by_name_;
         }
-        return nullptr;
+        for (const auto &method : methods_) {
+            methods_by_name_[method.name] = &method;
+        }
+        for (const auto &[name, method] : methods_by_name_) {
+            methods_by_key_.emplace(MethodKey{name, method->formal_params.size()}, method_table_.size());
+            method_table_.push_back(method);
+        }
+        for (auto &method : methods_) {
+            auto layout = std::make_shared<ClosureLayout>();
+            layout->AddName("self");
+            for (const auto &param : method.formal_params) {
+                layout->AddName(param);
+            }
+            // Параметры с совпадающими именами не могут занимать отдельные слоты,
+            // такой метод выполняется с переменными в словаре
+            if (layout->GetSize() != method.formal_params.size() + 1) {
+                continue;
+            }
+            if (method.body) {
+                method.body->ResolveNames(*layout);
+            }
+            method.layout = std::move(layout);
+        }
+    }
+
+    const Method *Class::GetMethod(Symbol name) const {
+        auto it = methods_by_name_.find(name);
+        return it == methods_by_name_.end() ? nullptr : it->second;
+    }
+
+    size_t Class::FindMethodIndex(Symbol name, size_t argument_count) const {
+        auto it = methods_by_key_.find(MethodKey{name, argument_count});
+        return it == methods_by_key_.end() ? NO_METHOD : it->second;
     }
 
-    [[nodiscard]] const std::string &Class::GetName() const {   // inline ?
+    [[nodiscard]] Symbol Class::GetName() const {   // inline ?
         return name_;
     }
 
@@ -143,6 +725,16 @@ namespace runtime {
         os << "Class "sv << name_;
     }
 
+    void Class::PrintTo(OutputSink &sink, [[maybe_unused]] Context &context) {
+        sink.Write("Class "sv);
+        sink.Write(name_.GetText());
+    }
+
+    void Class::AppendTo(std::string &out, [[maybe_unused]] Context &context) {
+        out += "Class "sv;
+        out += name_.GetText();
+    }
+
     //////////////////////////////////////////////////////////////////////////////
     //
     //  Bool
@@ -151,43 +743,86 @@ namespace runtime {
         os << (GetValue() ? "True"sv : "False"sv);
     }
 
+    void Bool::PrintTo(OutputSink &sink, [[maybe_unused]] Context &context) {
+        sink.Write(GetValue() ? "True"sv : "False"sv);
+    }
+
+    void Bool::AppendTo(std::string &out, [[maybe_unused]] Context &context) {
+        out += GetValue() ? "True"sv : "False"sv;
+    }
+
     //////////////////////////////////////////////////////////////////////////////
     //
     //  Globals
 
-    bool Equal(const ObjectHolder &lhs, const ObjectHolder &rhs, Context &context) {
-        if (lhs.TryAs<Bool>() && rhs.TryAs<Bool>()) {
-            return lhs.TryAs<Bool>()->GetValue() == rhs.TryAs<Bool>()->GetValue();
-        }
-        if (lhs.TryAs<Number>() && rhs.TryAs<Number>()) {
-            return lhs.TryAs<Number>()->GetValue() == rhs.TryAs<Number>()->GetValue();
+    namespace {
+        // Сравнивает значения одного типа с помощью Compare. Возвращает пустой optional,
+        // если значения данного типа не сравниваются встроенным образом
+        template<typename Compare>
+        std::optional<bool> CompareValues(const ObjectHolder &lhs, const ObjectHolder &rhs, Compare compare) {
+            switch (lhs.GetType()) {
+                case ObjectType::BOOL:
+                    return compare(Cast<Bool>(lhs).GetValue(), Cast<Bool>(rhs).GetValue());
+                case ObjectType::NUMBER:
+                    return compare(Cast<Number>(lhs).GetValue(), Cast<Number>(rhs).GetValue());
+                case ObjectType::STRING:
+                    return compare(Cast<String>(lhs).GetValue(), Cast<String>(rhs).GetValue());
+                default:
+                    return std::nullopt;
+            }
         }
-        if (lhs.TryAs<String>() && rhs.TryAs<String>()) {
-            return lhs.TryAs<String>()->GetValue() == rhs.TryAs<String>()->GetValue();
+
+        // Вызывает у lhs метод сравнения method, если lhs - объект с таким методом
+        std::optional<bool> CallCompareMethod(const ObjectHolder &lhs, const ObjectHolder &rhs,
+                                              Symbol method, MethodCache &cache, Context &context) {
+            if (lhs.GetType() != ObjectType::CLASS_INSTANCE) {
+                return std::nullopt;
+            }
+            auto &instance = const_cast<ClassInstance &>(Cast<ClassInstance>(lhs));
+            const auto *p_method = cache.Find(instance.GetClass(), method, 1);
+            if (!p_method) {
+                return std::nullopt;
+            }
+            return instance.Call(*p_method, &rhs, 1, context).TryAs<Bool>()->GetValue();
         }
-        const string EQ_METHOD = "__eq__"s;
-        if (lhs.TryAs<ClassInstance>() && lhs.TryAs<ClassInstance>()->HasMethod(EQ_METHOD, 1)) {
-            return lhs.TryAs<ClassInstance>()->Call(EQ_METHOD, {rhs}, context).TryAs<Bool>()->GetValue();
+    }  // namespace
+
+    MethodCache &GetEqualMethodCache() {
+        static MethodCache cache;
+        return cache;
+    }
+
+    MethodCache &GetLessMethodCache() {
+        static MethodCache cache;
+        return cache;
+    }
+
+    bool Equal(const ObjectHolder &lhs, const ObjectHolder &rhs, Context &context) {
+        const ObjectType lhs_type = lhs.GetType();
+        if (lhs_type == rhs.GetType()) {
+            if (lhs_type == ObjectType::NONE) {
+                return true;
+            }
+            if (auto result = CompareValues(lhs, rhs, std::equal_to<>{})) {
+                return *result;
+            }
         }
-        if (!lhs.operator bool() && !rhs.operator bool()) {
-            return true;
+        static const Symbol EQ_METHOD{"__eq__"};
+        if (auto result = CallCompareMethod(lhs, rhs, EQ_METHOD, GetEqualMethodCache(), context)) {
+            return *result;
         }
         throw std::runtime_error("Cannot compare objects for equality"s);
     }
 
     bool Less(const ObjectHolder &lhs, const ObjectHolder &rhs, Context &context) {
-        if (lhs.TryAs<Bool>() && rhs.TryAs<Bool>()) {
-            return lhs.TryAs<Bool>()->GetValue() < rhs.TryAs<Bool>()->GetValue();
-        }
-        if (lhs.TryAs<Number>() && rhs.TryAs<Number>()) {
-            return lhs.TryAs<Number>()->GetValue() < rhs.TryAs<Number>()->GetValue();
-        }
-        if (lhs.TryAs<String>() && rhs.TryAs<String>()) {
-            return lhs.TryAs<String>()->GetValue() < rhs.TryAs<String>()->GetValue();
+        if (lhs.GetType() == rhs.GetType()) {
+            if (auto result = CompareValues(lhs, rhs, std::less<>{})) {
+                return *result;
+            }
         }
-        const string LT_METHOD = "__lt__"s;
-        if (lhs.TryAs<ClassInstance>() && lhs.TryAs<ClassInstance>()->HasMethod(LT_METHOD, 1)) {
-            return lhs.TryAs<ClassInstance>()->Call(LT_METHOD, {rhs}, context).TryAs<Bool>()->GetValue();
+        static const Symbol LT_METHOD{"__lt__"};
+        if (auto result = CallCompareMethod(lhs, rhs, LT_METHOD, GetLessMethodCache(), context)) {
+            return *result;
         }
         throw std::runtime_error("Cannot compare objects for less"s);
     }
@@ -208,4 +843,18 @@ namespace runtime {
         return !Less(lhs, rhs, context);
     }
 
+    void ThrowUnknownVariable(std::string_view name) {
+        throw std::runtime_error("Uncknown variable name: "s.append(name));
+    }
+
+    int Divide(int lhs, int rhs) {
+        if (rhs == 0) {
+            throw std::runtime_error("Division by zero"s);
+        }
+        if (lhs == std::numeric_limits<int>::min() && rhs == -1) {
+            throw std::runtime_error("Integer overflow in division"s);
+        }
+        return lhs / rhs;
+    }
+
 }  // namespace runtime
@@ -1,8 +1,24 @@
 #pragma once
 
+#include "arena.h"
+#include "output.h"
+#include "symbol.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -15,19 +31,63 @@ namespace runtime {
         // Возвращает поток вывода для команд print
         virtual std::ostream &GetOutputStream() = 0;
 
-        void SetSelfName(std::string self_name) {
-            self_name_ = std::move(self_name);
-        }
-
-        [[nodiscard]] const std::string &GetSelfName() const {
-            return self_name_;
+        // Возвращает буферизованный приёмник вывода либо nullptr, если вывод идёт только через поток.
+        // Если приёмник есть, поток вывода должен писать в него же, чтобы не нарушался порядок вывода
+        virtual OutputSink *GetOutputSink() {
+            return nullptr;
         }
 
     protected:
         ~Context() = default;
+    };
 
-    private:
-        std::string self_name_;
+    // Тип значения Mython. Позволяет определять тип объекта без RTTI
+    enum class ObjectType : std::uint8_t {
+        NONE,            // значение None (пустой ObjectHolder)
+        NUMBER,
+        STRING,
+        BOOL,
+        CLASS,
+        CLASS_INSTANCE,
+        OTHER,           // прочие наследники Object
+    };
+
+    template<typename T>
+    class ValueObject;
+
+    class Class;
+
+    class ClassInstance;
+
+    // Тип, которым помечаются объекты класса T
+    template<typename T>
+    struct ObjectTypeOf {
+        static constexpr ObjectType value = ObjectType::OTHER;
+    };
+
+    template<>
+    struct ObjectTypeOf<ValueObject<int>> {
+        static constexpr ObjectType value = ObjectType::NUMBER;
+    };
+
+    template<>
+    struct ObjectTypeOf<ValueObject<std::string>> {
+        static constexpr ObjectType value = ObjectType::STRING;
+    };
+
+    template<>
+    struct ObjectTypeOf<ValueObject<bool>> {
+        static constexpr ObjectType value = ObjectType::BOOL;
+    };
+
+    template<>
+    struct ObjectTypeOf<Class> {
+        static constexpr ObjectType value = ObjectType::CLASS;
+    };
+
+    template<>
+    struct ObjectTypeOf<ClassInstance> {
+        static constexpr ObjectType value = ObjectType::CLASS_INSTANCE;
     };
 
     // Базовый класс для всех объектов языка Mython
@@ -37,23 +97,147 @@ namespace runtime {
 
         // выводит в os своё представление в виде строки
         virtual void Print(std::ostream &os, Context &context) = 0;
+
+        // Выводит своё представление в приёмник sink. По умолчанию вызывает Print с потоком приёмника
+        virtual void PrintTo(OutputSink &sink, Context &context) {
+            Print(sink.GetStream(), context);
+        }
+
+        // Дописывает своё представление в конец строки out. По умолчанию выводит объект
+        // через Print во временный поток
+        virtual void AppendTo(std::string &out, Context &context);
+
+        [[nodiscard]] ObjectType GetType() const {
+            return type_;
+        }
+
+    protected:
+        explicit Object(ObjectType type = ObjectType::OTHER)
+                : type_(type) {
+        }
+
+    private:
+        ObjectType type_;
     };
 
-    // Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе
+    // Объект-значение, хранящий значение типа T
+    template<typename T>
+    class ValueObject : public Object {
+    public:
+        ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+                : Object(ObjectTypeOf<ValueObject<T>>::value), value_(v) {
+        }
+
+        void Print(std::ostream &os, [[maybe_unused]] Context &context) override {
+            if constexpr (std::is_same_v<T, int>) {
+                char buffer[MAX_NUMBER_LENGTH];
+                os.write(buffer, std::to_chars(buffer, buffer + MAX_NUMBER_LENGTH, value_).ptr - buffer);
+            } else {
+                os << value_;
+            }
+        }
+
+        void PrintTo(OutputSink &sink, Context &context) override {
+            if constexpr (std::is_same_v<T, int>) {
+                sink.WriteNumber(value_);
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                sink.Write(value_);
+            } else {
+                Object::PrintTo(sink, context);
+            }
+        }
+
+        void AppendTo(std::string &out, Context &context) override {
+            if constexpr (std::is_same_v<T, int>) {
+                char buffer[MAX_NUMBER_LENGTH];
+                out.append(buffer, std::to_chars(buffer, buffer + MAX_NUMBER_LENGTH, value_).ptr - buffer);
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                out += value_;
+            } else {
+                Object::AppendTo(out, context);
+            }
+        }
+
+        [[nodiscard]] const T &GetValue() const {
+            return value_;
+        }
+
+    private:
+        // Наибольшая длина десятичной записи int вместе со знаком
+        static constexpr size_t MAX_NUMBER_LENGTH = std::numeric_limits<int>::digits10 + 2;
+
+        T value_;
+    };
+
+    // Строковое значение
+    using String = ValueObject<std::string>;
+    // Числовое значение
+    using Number = ValueObject<int>;
+
+    // Логическое значение
+    class Bool : public ValueObject<bool> {
+    public:
+        using ValueObject<bool>::ValueObject;
+
+        void Print(std::ostream &os, Context &context) override;
+
+        void PrintTo(OutputSink &sink, Context &context) override;
+
+        void AppendTo(std::string &out, Context &context) override;
+    };
+
+    template<>
+    struct ObjectTypeOf<Bool> {
+        static constexpr ObjectType value = ObjectType::BOOL;
+    };
+
+    // Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе.
+    // Значения Number и Bool хранятся непосредственно внутри ObjectHolder и не требуют
+    // выделения памяти в куче, остальные объекты размещаются в куче
     class ObjectHolder {
     public:
         // Создаёт пустое значение
-        ObjectHolder() = default;
+        ObjectHolder() noexcept {
+        }
+
+        ObjectHolder(const ObjectHolder &other);
+
+        ObjectHolder(ObjectHolder &&other) noexcept;
+
+        ObjectHolder &operator=(const ObjectHolder &other);
+
+        ObjectHolder &operator=(ObjectHolder &&other) noexcept;
+
+        ~ObjectHolder();
 
         // Возвращает ObjectHolder, владеющий объектом типа T
         // Тип T - конкретный класс-наследник Object.
-        // object копируется или перемещается в кучу
+        // Number и Bool копируются внутрь ObjectHolder, остальные объекты копируются
+        // или перемещаются в кучу
         template<typename T>
         [[nodiscard]] static ObjectHolder Own(T &&object) {
-            return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+            using U = std::decay_t<T>;
+            ObjectHolder holder;
+            if constexpr (std::is_same_v<U, Number>) {
+                new(&holder.storage_.number) Number(std::forward<T>(object));
+                holder.kind_ = Kind::NUMBER;
+            } else if constexpr (std::is_same_v<U, Bool>) {
+                new(&holder.storage_.boolean) Bool(std::forward<T>(object));
+                holder.kind_ = Kind::BOOL;
+            } else {
+                new(&holder.storage_.heap) std::shared_ptr<Object>(std::make_shared<U>(std::forward<T>(object)));
+                holder.kind_ = Kind::HEAP;
+            }
+            return holder;
         }
 
-        // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки)
+        /*
+         * Создаёт ObjectHolder, не владеющий объектом (заимствованная ссылка).
+         * Такой ObjectHolder хранит лишь указатель на объект: создание и копирование заимствованной
+         * ссылки не выделяет память и не изменяет счётчики ссылок.
+         * Объект должен пережить все копии заимствованной ссылки. Значения, которые могут пережить
+         * вызов метода (поля объектов, переменные, результат метода), сохраняются через Retain
+         */
         [[nodiscard]] static ObjectHolder Share(Object &object);
 
         // Создаёт пустой ObjectHolder, соответствующий значению None
@@ -67,82 +251,446 @@ namespace runtime {
 
         [[nodiscard]] Object *Get() const;
 
+        // Возвращает тип хранимого значения. Для пустого ObjectHolder возвращает ObjectType::NONE
+        [[nodiscard]] ObjectType GetType() const {
+            switch (kind_) {
+                case Kind::NUMBER:
+                    return ObjectType::NUMBER;
+                case Kind::BOOL:
+                    return ObjectType::BOOL;
+                case Kind::HEAP:
+                    return storage_.heap->GetType();
+                case Kind::BORROWED:
+                    return storage_.borrowed->GetType();
+                default:
+                    return ObjectType::NONE;
+            }
+        }
+
         // Возвращает указатель на объект типа T либо nullptr, если внутри ObjectHolder не хранится
-        // объект данного типа
+        // объект данного типа.
+        // Для значений, хранящихся внутри ObjectHolder, указатель действителен, пока жив сам ObjectHolder.
+        // Типы значений Mython определяются по метке типа, для прочих используется dynamic_cast
         template<typename T>
         [[nodiscard]] T *TryAs() const {
-            return dynamic_cast<T *>(this->Get());
+            constexpr ObjectType type = ObjectTypeOf<T>::value;
+            if constexpr (type == ObjectType::NUMBER) {
+                if (kind_ == Kind::NUMBER) {
+                    return const_cast<Number *>(&storage_.number);
+                }
+            } else if constexpr (type == ObjectType::BOOL) {
+                if (kind_ == Kind::BOOL) {
+                    return const_cast<Bool *>(&storage_.boolean);
+                }
+            }
+            Object *object;
+            if (kind_ == Kind::HEAP) {
+                object = storage_.heap.get();
+            } else if (kind_ == Kind::BORROWED) {
+                object = storage_.borrowed;
+            } else {
+                return nullptr;
+            }
+            if constexpr (type == ObjectType::OTHER) {
+                return dynamic_cast<T *>(object);
+            } else {
+                return object->GetType() == type ? static_cast<T *>(object) : nullptr;
+            }
         }
 
         // Возвращает true, если ObjectHolder не пуст
         explicit operator bool() const;
 
+        // Возвращает true, если ObjectHolder хранит заимствованную ссылку (см. Share)
+        [[nodiscard]] bool IsBorrowed() const {
+            return kind_ == Kind::BORROWED;
+        }
+
+        /*
+         * Делает ссылку владеющей, если это возможно: заимствованная ссылка на экземпляр класса,
+         * размещённый в куче через Own, заменяется ссылкой, разделяющей владение этим экземпляром,
+         * а заимствованные число, строка или логическое значение (например, константа программы)
+         * копируются. Прочие заимствованные ссылки остаются заимствованными, их время жизни
+         * по-прежнему обеспечивает создатель объекта.
+         * Вызывается при сохранении значения туда, где оно может пережить текущий вызов метода
+         */
+        void Retain() {
+            if (kind_ == Kind::BORROWED) {
+                RetainBorrowed();
+            }
+        }
+
     private:
+        enum class Kind : std::uint8_t {
+            EMPTY,
+            NUMBER,
+            BOOL,
+            HEAP,
+            BORROWED,
+        };
+
+        union Storage {
+            Storage() noexcept {
+            }
+
+            ~Storage() {
+            }
+
+            Number number;
+            Bool boolean;
+            std::shared_ptr<Object> heap;
+            Object *borrowed;
+        };
+
         explicit ObjectHolder(std::shared_ptr<Object> data);
 
         void AssertIsValid() const;
 
-        std::shared_ptr<Object> data_;
+        void RetainBorrowed();
+
+        // Разрушает хранимое значение, ObjectHolder становится пустым
+        void Reset() noexcept;
+
+        // Перемещает значение из пустого other в пустой *this
+        void MoveFrom(ObjectHolder &other) noexcept;
+
+        Kind kind_ = Kind::EMPTY;
+        Storage storage_;
     };
 
-    // Объект-значение, хранящий значение типа T
-    template<typename T>
-    class ValueObject : public Object {
+    /*
+     * Схема размещения переменных: сопоставляет именам переменных номера слотов.
+     * Схема локальных переменных строится однократно при разрешении имён в теле метода либо программы.
+     * Схемы полей объектов (shapes) образуют дерево переходов от пустой схемы: объекты,
+     * поля которых добавлялись в одном порядке, разделяют одну и ту же схему.
+     * Схемы полей не уничтожаются до завершения программы. Переходы между схемами полей можно
+     * выполнять одновременно из нескольких потоков: первые PUBLISHED_TRANSITIONS переходов схемы
+     * находятся без блокировки
+     */
+    class ClosureLayout {
     public:
-        ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-                : value_(v) {
+        static constexpr size_t NO_SLOT = std::numeric_limits<size_t>::max();
+        static constexpr size_t PUBLISHED_TRANSITIONS = 8;
+
+        ClosureLayout();
+
+        ClosureLayout(const ClosureLayout &) = delete;
+
+        ClosureLayout &operator=(const ClosureLayout &) = delete;
+
+        // Возвращает пустую схему полей, от которой начинаются все переходы.
+        // Схемы полей образуют дерево переходов, которое не освобождается до завершения программы,
+        // поэтому на них ссылаются обычными указателями, не изменяя общих счётчиков ссылок
+        static const ClosureLayout *GetEmptyShape();
+
+        // Возвращает схему полей, полученную добавлением к этой схеме поля name
+        [[nodiscard]] const ClosureLayout *AddTransition(Symbol name) const;
+
+        // Возвращает номер слота переменной name, добавляя её в схему при необходимости
+        size_t AddName(Symbol name);
+
+        // Возвращает номер слота переменной name либо NO_SLOT, если её нет в схеме
+        [[nodiscard]] size_t FindSlot(Symbol name) const;
+
+        [[nodiscard]] Symbol GetName(size_t slot) const;
+
+        [[nodiscard]] size_t GetSize() const;
+
+        // Возвращает наибольший размер схемы, полученной из этой схемы переходами.
+        // Позволяет сразу выделить память под все поля, которые обычно получает объект
+        [[nodiscard]] size_t GetMaxShapeSize() const {
+            return max_shape_size_.load(std::memory_order_relaxed);
         }
 
-        void Print(std::ostream &os, [[maybe_unused]] Context &context) override {
-            os << value_;
+        // Возвращает уникальный идентификатор схемы. Идентификатор отличен от нуля
+        [[nodiscard]] std::uint64_t GetId() const {
+            return id_;
         }
 
-        [[nodiscard]] const T &GetValue() const {
-            return value_;
+    private:
+        std::uint64_t id_;
+        const ClosureLayout *parent_ = nullptr;
+        mutable std::atomic<size_t> max_shape_size_{0};
+        std::vector<Symbol> names_;
+        std::unordered_map<Symbol, size_t> slots_;
+        // Переходы к следующим схемам полей. Изменяются только под transitions_mutex_
+        mutable std::unordered_map<Symbol, std::unique_ptr<const ClosureLayout>> transitions_;
+        mutable std::mutex transitions_mutex_;
+        // Первые созданные переходы. Схемы не перемещаются и не удаляются, поэтому указатели на них
+        // читаются без блокировки
+        mutable std::array<std::atomic<const ClosureLayout *>, PUBLISHED_TRANSITIONS> published_{};
+    };
+
+    /*
+     * Таблица символов, связывающая имя объекта с его значением.
+     * Переменные, известные схеме ClosureLayout, хранятся в плоском массиве слотов и доступны
+     * по номеру без хеширования имени. Остальные переменные (например, поля объектов)
+     * хранятся в словаре, который создаётся при первом обращении. Closure полей объекта
+     * вместо словаря расширяет свою схему переходом к следующей схеме полей.
+     * Интерфейс по имени повторяет интерфейс std::unordered_map
+     */
+    class Closure {
+        template<bool IsConst>
+        class BasicIterator;
+
+    public:
+        using iterator = BasicIterator<false>;
+        using const_iterator = BasicIterator<true>;
+
+        Closure() = default;
+
+        explicit Closure(std::shared_ptr<const ClosureLayout> layout);
+
+        Closure(std::initializer_list<std::pair<const Symbol, ObjectHolder>> variables);
+
+        Closure(const Closure &other);
+
+        Closure(Closure &&other) noexcept;
+
+        Closure &operator=(const Closure &other);
+
+        Closure &operator=(Closure &&other) noexcept;
+
+        ~Closure() = default;
+
+        // Создаёт пустой Closure, схема которого расширяется при добавлении переменных
+        static Closure WithShapes();
+
+        // Номер слота переменной в схеме, где она была найдена последний раз.
+        // Позволяет точке доступа к полю не искать его по имени в объектах одной схемы.
+        // Идентификатор схемы и номер слота упакованы в одно слово, поэтому кеш читается
+        // и обновляется из нескольких потоков без блокировок
+        struct SlotCache {
+            static constexpr unsigned SLOT_BITS = 20;
+            static constexpr std::uint64_t SLOT_MASK = (std::uint64_t{1} << SLOT_BITS) - 1;
+
+            std::atomic<std::uint64_t> layout_and_slot{0};
+        };
+
+        // Возвращает схему, по которой размещены переменные, либо nullptr
+        [[nodiscard]] const ClosureLayout *GetLayout() const;
+
+        // Переводит Closure на схему layout, сохраняя значения всех переменных
+        void SetLayout(std::shared_ptr<const ClosureLayout> layout);
+
+        // Возвращает значение переменной из слота slot либо nullptr, если ей не присвоено значение
+        [[nodiscard]] ObjectHolder *GetSlot(size_t slot);
+
+        // Присваивает значение переменной из слота slot
+        ObjectHolder &SetSlot(size_t slot, ObjectHolder value);
+
+        // Возвращает значение переменной name либо nullptr, если ей не присвоено значение
+        [[nodiscard]] ObjectHolder *Find(Symbol name);
+
+        [[nodiscard]] const ObjectHolder *Find(Symbol name) const;
+
+        // Аналог Find, использующий и обновляющий кеш cache
+        [[nodiscard]] ObjectHolder *Find(Symbol name, SlotCache &cache);
+
+        // Возвращает ссылку на переменную name для присваивания, используя и обновляя кеш cache
+        ObjectHolder &Assign(Symbol name, SlotCache &cache);
+
+        // Удаляет все переменные и переводит Closure на схему layout, не владея ею: схема должна
+        // пережить использование Closure. Ранее выделенная под слоты память переиспользуется
+        void Reset(const ClosureLayout *layout);
+
+        [[nodiscard]] iterator find(Symbol name);
+
+        [[nodiscard]] const_iterator find(Symbol name) const;
+
+        [[nodiscard]] iterator begin();
+
+        [[nodiscard]] iterator end();
+
+        [[nodiscard]] const_iterator begin() const;
+
+        [[nodiscard]] const_iterator end() const;
+
+        [[nodiscard]] size_t count(Symbol name) const;
+
+        // Возвращает значение переменной name. Выбрасывает out_of_range, если переменной нет
+        ObjectHolder &at(Symbol name);
+
+        const ObjectHolder &at(Symbol name) const;
+
+        ObjectHolder &operator[](Symbol name);
+
+        [[nodiscard]] size_t size() const;
+
+        [[nodiscard]] bool empty() const;
+
+        void clear();
+
+        // Сигнал завершения метода. Инструкция return выставляет его, а составные инструкции
+        // прекращают выполнение, обнаружив его, и передают наверх результат return
+        void SetReturned(bool returned) {
+            returned_ = returned;
+        }
+
+        [[nodiscard]] bool HasReturned() const {
+            return returned_;
         }
 
     private:
-        T value_;
+        using Dictionary = std::unordered_map<Symbol, ObjectHolder>;
+
+        static Dictionary &GetEmptyDictionary();
+
+        // Возвращает значение незанятого слота. Оно отличается от любого значения Mython, включая None
+        static const ObjectHolder &GetUnbound();
+
+        static bool IsBound(const ObjectHolder &value) {
+            return value.Get() != GetUnbound().Get();
+        }
+
+        [[nodiscard]] Dictionary &GetDictionary() const;
+
+        const ClosureLayout *layout_ = nullptr;
+        // Владеет схемой layout_, если она передана через shared_ptr. Схемы полей и схемы локальных
+        // переменных методов живут дольше Closure и счётчиком ссылок не удерживаются
+        std::shared_ptr<const ClosureLayout> layout_owner_;
+        // Значения переменных. Слот переменной, которой не присвоено значение, содержит UNBOUND
+        std::vector<ObjectHolder> slots_;
+        // Переменные, отсутствующие в схеме
+        std::unique_ptr<Dictionary> dictionary_;
+        // Схема расширяется при добавлении переменных, словарь не используется
+        bool with_shapes_ = false;
+        bool returned_ = false;
     };
 
-    // Таблица символов, связывающая имя объекта с его значением
-    using Closure = std::unordered_map<std::string, ObjectHolder>;
+    // Итератор по переменным Closure: сначала по занятым слотам, затем по словарю
+    template<bool IsConst>
+    class Closure::BasicIterator {
+        using ClosurePtr = std::conditional_t<IsConst, const Closure *, Closure *>;
+        using Holder = std::conditional_t<IsConst, const ObjectHolder, ObjectHolder>;
+        using DictionaryIterator = std::conditional_t<IsConst, Dictionary::const_iterator, Dictionary::iterator>;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = std::pair<const std::string, ObjectHolder>;
+        using reference = std::pair<const std::string &, Holder &>;
+
+        struct pointer {
+            reference ref;
+
+            const reference *operator->() const {
+                return &ref;
+            }
+        };
+
+        BasicIterator(ClosurePtr closure, size_t slot, DictionaryIterator dictionary_it)
+                : closure_(closure), slot_(slot), dictionary_it_(dictionary_it) {
+            SkipEmptySlots();
+        }
+
+        reference operator*() const {
+            if (slot_ < closure_->slots_.size()) {
+                return {closure_->layout_->GetName(slot_).GetText(), closure_->slots_[slot_]};
+            }
+            return {dictionary_it_->first.GetText(), dictionary_it_->second};
+        }
+
+        pointer operator->() const {
+            return {**this};
+        }
+
+        BasicIterator &operator++() {
+            if (slot_ < closure_->slots_.size()) {
+                ++slot_;
+                SkipEmptySlots();
+            } else {
+                ++dictionary_it_;
+            }
+            return *this;
+        }
+
+        BasicIterator operator++(int) {
+            auto result = *this;
+            ++*this;
+            return result;
+        }
+
+        bool operator==(const BasicIterator &other) const {
+            return slot_ == other.slot_ && dictionary_it_ == other.dictionary_it_;
+        }
+
+        bool operator!=(const BasicIterator &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        void SkipEmptySlots() {
+            while (slot_ < closure_->slots_.size() && !IsBound(closure_->slots_[slot_])) {
+                ++slot_;
+            }
+        }
+
+        ClosurePtr closure_;
+        size_t slot_;
+        DictionaryIterator dictionary_it_;
+    };
 
     // Проверяет, содержится ли в object значение, приводимое к True
     // Для отличных от нуля чисел, True и непустых строк возвращается true. В остальных случаях - false.
     bool IsTrue(const ObjectHolder &object);
 
+    /*
+     * Возвращает строковое представление object, как его вычисляет str(object).
+     * Строка возвращается без изменений (заимствованная строка сохраняется через Retain), для None, True и False используются общие неизменяемые строки,
+     * а число записывается без промежуточных потоков, поэтому str от числа выделяет память не более одного раза.
+     * Результат метода __str__ дописывается прямо в итоговую строку
+     */
+    ObjectHolder ToString(const ObjectHolder &object, Context &context);
+
     // Интерфейс для выполнения действий над объектами Mython
     class Executable {
     public:
+        // Узлы, созданные при действующем AstArena::Scope, размещаются в арене
+        static void *operator new(size_t size) {
+            return AstArena::AllocateNode(size);
+        }
+
+        static void operator delete(void *node) noexcept {
+            AstArena::DeallocateNode(node);
+        }
+
         virtual ~Executable() = default;
 
         // Выполняет действие над объектами внутри closure, используя context
         // Возвращает результирующее значение либо None
         virtual ObjectHolder Execute(Closure &closure, Context &context) = 0;
-    };
 
-    // Строковое значение
-    using String = ValueObject<std::string>;
-    // Числовое значение
-    using Number = ValueObject<int>;
+        // Назначает используемым переменным слоты схемы layout.
+        // Вызывается однократно, до первого выполнения
+        virtual void ResolveNames(ClosureLayout & /*layout*/) {
+        }
 
-    // Логическое значение
-    class Bool : public ValueObject<bool> {
-    public:
-        using ValueObject<bool>::ValueObject;
+        using ChildVisitor = std::function<void(std::unique_ptr<Executable> &)>;
 
-        void Print(std::ostream &os, Context &context) override;
+        // Передаёт visitor ссылки на дочерние узлы в порядке их вычисления, позволяя заменить их
+        virtual void ForEachChild(const ChildVisitor & /*visitor*/) {
+        }
+
+        // Возвращает узел, который следует выполнять вместо этого. Узел с отложенным разбором
+        // (тело метода в ленивом режиме) разбирается при первом вызове. Вызывается перед созданием
+        // кадра метода, так как разбор может добавить локальные переменные в схему метода
+        virtual Executable &Prepare() {
+            return *this;
+        }
     };
 
     // Метод класса
     struct Method {
         // Имя метода
-        std::string name;
+        Symbol name;
         // Имена формальных параметров метода
-        std::vector<std::string> formal_params;
+        std::vector<Symbol> formal_params;
         // Тело метода
         std::unique_ptr<Executable> body;
+        // Схема переменных метода: self, затем формальные параметры, затем локальные переменные.
+        // Заполняется при создании класса
+        std::shared_ptr<const ClosureLayout> layout = nullptr;
     };
 
     // Класс
@@ -150,26 +698,168 @@ namespace runtime {
     public:
         // Создаёт класс с именем name и набором методов methods, унаследованный от класса parent
         // Если parent равен nullptr, то создаётся базовый класс
-        explicit Class(std::string name, std::vector<Method> methods, const Class *parent);
+        explicit Class(Symbol name, std::vector<Method> methods, const Class *parent);
 
         // Возвращает указатель на метод name или nullptr, если метод с таким именем отсутствует
-        [[nodiscard]] const Method *GetMethod(const std::string &name) const;
+        [[nodiscard]] const Method *GetMethod(Symbol name) const;
+
+        // Возвращает указатель на метод name, принимающий argument_count параметров, либо nullptr.
+        // Унаследованные методы находятся так же, за одно обращение к таблице методов
+        [[nodiscard]] const Method *FindMethod(Symbol name, size_t argument_count) const {
+            return GetMethodAt(FindMethodIndex(name, argument_count));
+        }
+
+        static constexpr size_t NO_METHOD = (size_t{1} << 24) - 1;
+
+        // Возвращает номер метода name, принимающего argument_count параметров, в таблице методов
+        // класса либо NO_METHOD. Номер позволяет кешировать метод одним машинным словом
+        [[nodiscard]] size_t FindMethodIndex(Symbol name, size_t argument_count) const;
+
+        // Возвращает метод с номером index из таблицы методов либо nullptr для NO_METHOD
+        [[nodiscard]] const Method *GetMethodAt(size_t index) const {
+            return index == NO_METHOD ? nullptr : method_table_[index];
+        }
 
         // Возвращает имя класса
-        [[nodiscard]] const std::string &GetName() const;
+        [[nodiscard]] Symbol GetName() const;
+
+        // Возвращает собственные методы класса, без унаследованных
+        [[nodiscard]] const std::vector<Method> &GetMethods() const {
+            return methods_;
+        }
+
+        // Возвращает родительский класс либо nullptr
+        [[nodiscard]] const Class *GetParent() const {
+            return parent_;
+        }
+
+        // Возвращает уникальный идентификатор класса. В отличие от адреса класса,
+        // идентификатор не может достаться другому классу после уничтожения этого
+        [[nodiscard]] std::uint64_t GetId() const {
+            return id_;
+        }
 
         // Выводит в os строку "Class <имя класса>", например "Class cat"
         void Print(std::ostream &os, Context &context) override;
 
+        void PrintTo(OutputSink &sink, Context &context) override;
+
+        void AppendTo(std::string &out, Context &context) override;
+
     private:
-        std::string name_;
+        std::uint64_t id_;
+        Symbol name_;
         std::vector<Method> methods_;
         const Class *parent_;
-        std::unordered_map<std::string_view, size_t> methods_by_name_;
+
+        // Ключ таблицы методов: имя метода и количество его параметров
+        struct MethodKey {
+            Symbol name;
+            size_t argument_count;
+
+            bool operator==(const MethodKey &other) const {
+                return argument_count == other.argument_count && name == other.name;
+            }
+        };
+
+        struct MethodKeyHasher {
+            size_t operator()(const MethodKey &key) const {
+                return key.name.GetHash() * 37 + key.argument_count;
+            }
+        };
+
+        // Методы класса вместе с унаследованными. Метод класса скрывает одноимённые методы родителей
+        std::unordered_map<Symbol, const Method *> methods_by_name_;
+        // Номера методов в таблице method_table_
+        std::unordered_map<MethodKey, size_t, MethodKeyHasher> methods_by_key_;
+        std::vector<const Method *> method_table_;
     };
 
+    /*
+     * Инлайн-кеш разрешения метода в точке вызова. Хранит до CAPACITY последних пар
+     * (класс, найденный метод): точка вызова с одним классом получателя мономорфна,
+     * с несколькими - полиморфна. При переполнении самая старая запись вытесняется.
+     * Отсутствие метода кешируется так же, как найденный метод.
+     *
+     * Запись кеша - одно машинное слово из идентификатора класса и номера метода в его таблице,
+     * поэтому кешем одной точки вызова могут одновременно пользоваться несколько потоков без блокировок.
+     * Счётчики статистики при этом приблизительны
+     */
+    class MethodCache {
+    public:
+        static constexpr size_t CAPACITY = 4;
+
+        struct Stats {
+            size_t hits = 0;
+            size_t misses = 0;
+        };
+
+        // Возвращает метод name класса cls, принимающий argument_count параметров, либо nullptr
+        const Method *Find(const Class &cls, Symbol name, size_t argument_count) {
+            const std::uint64_t key = cls.GetId() << INDEX_BITS;
+            for (const auto &entry : entries_) {
+                const std::uint64_t value = entry.load(std::memory_order_relaxed);
+                if ((value & ~INDEX_MASK) == key) {
+                    Count(hits_);
+                    return cls.GetMethodAt(value & INDEX_MASK);
+                }
+            }
+            Count(misses_);
+            const size_t index = cls.FindMethodIndex(name, argument_count);
+            const size_t next = next_.load(std::memory_order_relaxed);
+            entries_[next].store(key | index, std::memory_order_relaxed);
+            next_.store((next + 1) % CAPACITY, std::memory_order_relaxed);
+            return cls.GetMethodAt(index);
+        }
+
+        [[nodiscard]] Stats GetStats() const {
+            return {hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed)};
+        }
+
+        // Возвращает количество классов, для которых закеширован результат
+        [[nodiscard]] size_t GetSize() const {
+            return std::count_if(entries_.begin(), entries_.end(), [](const auto &entry) {
+                return entry.load(std::memory_order_relaxed) != 0;
+            });
+        }
+
+        void Clear() {
+            for (auto &entry : entries_) {
+                entry.store(0, std::memory_order_relaxed);
+            }
+            next_.store(0, std::memory_order_relaxed);
+            hits_.store(0, std::memory_order_relaxed);
+            misses_.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        // Номер метода занимает младшие биты записи, идентификатор класса - старшие.
+        // Идентификаторы классов отличны от нуля, поэтому нулевая запись пуста
+        static constexpr unsigned INDEX_BITS = 24;
+        static constexpr std::uint64_t INDEX_MASK = (std::uint64_t{1} << INDEX_BITS) - 1;
+        static_assert(Class::NO_METHOD == INDEX_MASK);
+
+        // Увеличивает счётчик без атомарного чтения-изменения-записи, которое было бы дорогим
+        // при одновременных вызовах из нескольких потоков
+        static void Count(std::atomic<size_t> &counter) {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        std::array<std::atomic<std::uint64_t>, CAPACITY> entries_{};
+        std::atomic<size_t> next_{0};
+        std::atomic<size_t> hits_{0};
+        std::atomic<size_t> misses_{0};
+    };
+
+    // Кеши разрешения методов __eq__ и __lt__, вызываемых функциями Equal и Less
+    MethodCache &GetEqualMethodCache();
+
+    MethodCache &GetLessMethodCache();
+
     // Экземпляр класса
-    class ClassInstance : public Object {
+    // Экземпляр класса знает о владеющем им shared_ptr, что позволяет ObjectHolder::Retain
+    // превратить заимствованную ссылку self во владеющую
+    class ClassInstance : public Object, public std::enable_shared_from_this<ClassInstance> {
     public:
         explicit ClassInstance(const Class &cls);
 
@@ -179,17 +869,29 @@ namespace runtime {
          */
         void Print(std::ostream &os, Context &context) override;
 
+        // Результат __str__ выводится в sink без промежуточной строки
+        void PrintTo(OutputSink &sink, Context &context) override;
+
+        // Результат __str__ дописывается в out без промежуточного потока
+        void AppendTo(std::string &out, Context &context) override;
+
         /*
          * Вызывает у объекта метод method, передавая ему actual_args параметров.
          * Параметр context задаёт контекст для выполнения метода.
          * Если ни сам класс, ни его родители не содержат метод method, метод выбрасывает исключение
          * runtime_error
          */
-        ObjectHolder Call(const std::string &method, const std::vector<ObjectHolder> &actual_args,
+        ObjectHolder Call(Symbol method, const std::vector<ObjectHolder> &actual_args,
+                          Context &context);
+
+        // Вызывает у объекта метод method, найденный заранее через Class::FindMethod.
+        // Аргументы копируются в кадр вызова до выполнения тела метода, поэтому actual_args
+        // может указывать на стек аргументов CallStack
+        ObjectHolder Call(const Method &method, const ObjectHolder *actual_args, size_t argument_count,
                           Context &context);
 
         // Возвращает true, если объект имеет метод method, принимающий argument_count параметров
-        [[nodiscard]] bool HasMethod(const std::string &method, size_t argument_count) const;
+        [[nodiscard]] bool HasMethod(Symbol method, size_t argument_count) const;
 
         // Возвращает ссылку на Closure, содержащий поля объекта
         [[nodiscard]] Closure &Fields();
@@ -197,11 +899,102 @@ namespace runtime {
         // Возвращает константную ссылку на Closure, содержащую поля объекта
         [[nodiscard]] const Closure &Fields() const;
 
+        // Возвращает класс, экземпляром которого является объект
+        [[nodiscard]] const Class &GetClass() const;
+
     private:
         const Class &cls_;
         Closure closure_;
     };
 
+    /*
+     * Стек вызовов методов. Переиспользует Closure локальных переменных и память под аргументы
+     * между вызовами, поэтому вызов метода в установившемся режиме не выделяет динамическую память.
+     * У каждого потока собственный стек вызовов
+     */
+    class CallStack {
+    public:
+        // Кадр вызова. Возвращает Closure в стек вызовов при уничтожении
+        class Frame {
+        public:
+            explicit Frame(CallStack &stack)
+                    : stack_(stack), closure_(*stack.frames_[stack.depth_ - 1]) {
+            }
+
+            Frame(const Frame &) = delete;
+
+            Frame &operator=(const Frame &) = delete;
+
+            ~Frame() {
+                closure_.clear();
+                --stack_.depth_;
+            }
+
+            [[nodiscard]] Closure &GetClosure() {
+                return closure_;
+            }
+
+        private:
+            CallStack &stack_;
+            Closure &closure_;
+        };
+
+        // Аргументы вызова, размещённые на вершине стека аргументов. Снимаются со стека при уничтожении
+        class Arguments {
+        public:
+            explicit Arguments(CallStack &stack)
+                    : arguments_(stack.arguments_), begin_(arguments_.size()) {
+            }
+
+            Arguments(const Arguments &) = delete;
+
+            Arguments &operator=(const Arguments &) = delete;
+
+            ~Arguments() {
+                arguments_.erase(arguments_.begin() + static_cast<std::ptrdiff_t>(begin_), arguments_.end());
+            }
+
+            void Push(ObjectHolder value) {
+                arguments_.push_back(std::move(value));
+            }
+
+            // Указатель действителен до следующего добавления аргументов в стек
+            [[nodiscard]] const ObjectHolder *GetData() const {
+                return arguments_.data() + begin_;
+            }
+
+            [[nodiscard]] size_t GetSize() const {
+                return arguments_.size() - begin_;
+            }
+
+        private:
+            std::vector<ObjectHolder> &arguments_;
+            size_t begin_;
+        };
+
+        // Возвращает стек вызовов текущего потока
+        static CallStack &GetInstance();
+
+        // Захватывает кадр для вызова метода с локальными переменными по схеме layout.
+        // Схема принадлежит методу и переживает вызов
+        Frame PushFrame(const ClosureLayout *layout);
+
+        // Начинает размещение аргументов очередного вызова
+        Arguments PushArguments() {
+            return Arguments(*this);
+        }
+
+        // Возвращает количество активных кадров
+        [[nodiscard]] size_t GetDepth() const {
+            return depth_;
+        }
+
+    private:
+        std::vector<std::unique_ptr<Closure>> frames_;
+        size_t depth_ = 0;
+        std::vector<ObjectHolder> arguments_;
+    };
+
     /*
      * Возвращает true, если lhs и rhs содержат одинаковые числа, строки или значения типа Bool.
      * Если lhs - объект с методом __eq__, функция возвращает результат вызова lhs.__eq__(rhs),
@@ -234,6 +1027,14 @@ namespace runtime {
     // Возвращает значение, противоположное Less(lhs, rhs, context)
     bool GreaterOrEqual(const ObjectHolder &lhs, const ObjectHolder &rhs, Context &context);
 
+    // Выбрасывает runtime_error об обращении к неизвестной переменной name.
+    // Текст ошибки общий для обхода AST и виртуальной машины
+    [[noreturn]] void ThrowUnknownVariable(std::string_view name);
+
+    // Возвращает частное целых чисел lhs и rhs.
+    // Деление на ноль и переполнение (наименьшее число, делённое на -1) выбрасывают runtime_error
+    int Divide(int lhs, int rhs);
+
     // Контекст-заглушка, применяется в тестах.
     // В этом контексте весь вывод перенаправляется в строковый поток вывода output
     struct DummyContext : Context {
@@ -259,4 +1060,23 @@ namespace runtime {
         std::ostream &output_;
     };
 
+    // Контекст, в котором вывод происходит через буферизованный приёмник sink
+    class SinkContext : public runtime::Context {
+    public:
+        explicit SinkContext(OutputSink &sink)
+                : sink_(sink) {
+        }
+
+        std::ostream &GetOutputStream() override {
+            return sink_.GetStream();
+        }
+
+        OutputSink *GetOutputSink() override {
+            return &sink_;
+        }
+
+    private:
+        OutputSink &sink_;
+    };
+
 }  // namespace runtime
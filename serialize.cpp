@@ -0,0 +1,570 @@
+#include "serialize.h"
+
+#include "arena.h"
+#include "statement.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace serialize {
+
+    namespace {
+        using ast::Statement;
+        using runtime::Symbol;
+
+        constexpr char MAGIC[4] = {'M', 'Y', 'T', 'I'};
+        // Сигнатура, версия формата, хеш и размер исходного текста
+        constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 8 + 8;
+
+        // Вид узла дерева в образе
+        enum class NodeTag : uint8_t {
+            EMPTY,  // отсутствующий узел: ветка else либо тело метода
+            NUMERIC_CONST,
+            STRING_CONST,
+            BOOL_CONST,
+            NONE,
+            VARIABLE_VALUE,
+            ASSIGNMENT,
+            FIELD_ASSIGNMENT,
+            PRINT,
+            METHOD_CALL,
+            NEW_INSTANCE,
+            STRINGIFY,
+            NOT,
+            ADD,
+            SUB,
+            MULT,
+            DIV,
+            OR,
+            AND,
+            COMPARISON,
+            COMPOUND,
+            METHOD_BODY,
+            RETURN,
+            CLASS_DEFINITION,
+            IF_ELSE,
+        };
+
+        using ComparatorFn = bool (*)(const runtime::ObjectHolder &, const runtime::ObjectHolder &, runtime::Context &);
+
+        // Компараторы, которые создаёт парсер. В образе компаратор хранится номером в этой таблице
+        constexpr ComparatorFn COMPARATORS[] = {
+                runtime::Equal,
+                runtime::NotEqual,
+                runtime::Less,
+                runtime::Greater,
+                runtime::LessOrEqual,
+                runtime::GreaterOrEqual,
+        };
+
+        void AppendFixed(string &out, uint64_t value, size_t size) {
+            for (size_t i = 0; i < size; ++i) {
+                out.push_back(static_cast<char>(value >> (8 * i)));
+            }
+        }
+
+        uint64_t ReadFixed(string_view data, size_t pos, size_t size) {
+            uint64_t value = 0;
+            for (size_t i = 0; i < size; ++i) {
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(data[pos + i])) << (8 * i);
+            }
+            return value;
+        }
+
+        void AppendVarint(string &out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<char>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        class Writer {
+        public:
+            void WriteNode(const Statement *node) {
+                if (!node) {
+                    WriteTag(NodeTag::EMPTY);
+                } else if (const auto *num = dynamic_cast<const ast::NumericConst *>(node)) {
+                    WriteTag(NodeTag::NUMERIC_CONST);
+                    // Отрицательные числа кодируются зигзагом, чтобы занимать мало байт
+                    const auto value = static_cast<int64_t>(num->GetValue().GetValue());
+                    WriteVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+                } else if (const auto *str = dynamic_cast<const ast::StringConst *>(node)) {
+                    WriteTag(NodeTag::STRING_CONST);
+                    WriteString(str->GetValue().GetValue());
+                } else if (const auto *boolean = dynamic_cast<const ast::BoolConst *>(node)) {
+                    WriteTag(NodeTag::BOOL_CONST);
+                    WriteVarint(boolean->GetValue().GetValue() ? 1 : 0);
+                } else if (dynamic_cast<const ast::None *>(node)) {
+                    WriteTag(NodeTag::NONE);
+                } else if (const auto *var = dynamic_cast<const ast::VariableValue *>(node)) {
+                    WriteTag(NodeTag::VARIABLE_VALUE);
+                    WriteSymbols(var->GetDottedIds());
+                } else if (const auto *assign = dynamic_cast<const ast::Assignment *>(node)) {
+                    WriteTag(NodeTag::ASSIGNMENT);
+                    WriteSymbol(assign->GetVarName());
+                    WriteNode(&assign->GetRvalue());
+                } else if (const auto *field_assign = dynamic_cast<const ast::FieldAssignment *>(node)) {
+                    WriteTag(NodeTag::FIELD_ASSIGNMENT);
+                    WriteSymbols(field_assign->GetObject().GetDottedIds());
+                    WriteSymbol(field_assign->GetFieldName());
+                    WriteNode(&field_assign->GetRvalue());
+                } else if (const auto *print = dynamic_cast<const ast::Print *>(node)) {
+                    WriteTag(NodeTag::PRINT);
+                    WriteNodes(print->GetArgs());
+                } else if (const auto *call = dynamic_cast<const ast::MethodCall *>(node)) {
+                    WriteTag(NodeTag::METHOD_CALL);
+                    WriteNode(&call->GetObject());
+                    WriteSymbol(call->GetMethodName());
+                    WriteNodes(call->GetArgs());
+                } else if (const auto *new_instance = dynamic_cast<const ast::NewInstance *>(node)) {
+                    WriteTag(NodeTag::NEW_INSTANCE);
+                    WriteVarint(GetClassIndex(new_instance->GetClass()));
+                    WriteNodes(new_instance->GetArgs());
+                } else if (const auto *stringify = dynamic_cast<const ast::Stringify *>(node)) {
+                    WriteTag(NodeTag::STRINGIFY);
+                    WriteNode(&stringify->GetArgument());
+                } else if (const auto *not_op = dynamic_cast<const ast::Not *>(node)) {
+                    WriteTag(NodeTag::NOT);
+                    WriteNode(&not_op->GetArgument());
+                } else if (const auto *comparison = dynamic_cast<const ast::Comparison *>(node)) {
+                    WriteTag(NodeTag::COMPARISON);
+                    WriteVarint(GetComparatorIndex(comparison->GetComparator()));
+                    WriteNode(&comparison->GetLhs());
+                    WriteNode(&comparison->GetRhs());
+                } else if (const auto *binary = dynamic_cast<const ast::BinaryOperation *>(node)) {
+                    WriteTag(GetBinaryTag(*binary));
+                    WriteNode(&binary->GetLhs());
+                    WriteNode(&binary->GetRhs());
+                } else if (const auto *compound = dynamic_cast<const ast::Compound *>(node)) {
+                    WriteTag(NodeTag::COMPOUND);
+                    WriteNodes(compound->GetStatements());
+                } else if (const auto *body = dynamic_cast<const ast::MethodBody *>(node)) {
+                    WriteTag(NodeTag::METHOD_BODY);
+                    WriteNode(&body->GetBody());
+                } else if (const auto *ret = dynamic_cast<const ast::Return *>(node)) {
+                    WriteTag(NodeTag::RETURN);
+                    WriteNode(&ret->GetStatement());
+                } else if (const auto *class_def = dynamic_cast<const ast::ClassDefinition *>(node)) {
+                    WriteTag(NodeTag::CLASS_DEFINITION);
+                    WriteClass(*class_def->GetClass().TryAs<runtime::Class>());
+                } else if (const auto *if_else = dynamic_cast<const ast::IfElse *>(node)) {
+                    WriteTag(NodeTag::IF_ELSE);
+                    WriteNode(&if_else->GetCondition());
+                    WriteNode(&if_else->GetIfBody());
+                    WriteNode(if_else->GetElseBody());
+                } else {
+                    throw SerializeError("Unsupported AST node"s);
+                }
+            }
+
+            // Собирает образ: заголовок, таблицы имён и строк, затем дерево программы
+            string Finish(const SourceKey &key) {
+                string image;
+                image.reserve(HEADER_SIZE + body_.size() + symbols_.size() * 8 + strings_.size() * 16);
+                image.append(MAGIC, sizeof(MAGIC));
+                AppendFixed(image, FORMAT_VERSION, 4);
+                AppendFixed(image, key.hash, 8);
+                AppendFixed(image, key.size, 8);
+
+                AppendVarint(image, symbols_.size());
+                for (const Symbol symbol : symbols_) {
+                    AppendVarint(image, symbol.GetText().size());
+                    image.append(symbol.GetText());
+                }
+                AppendVarint(image, strings_.size());
+                for (const string_view str : strings_) {
+                    AppendVarint(image, str.size());
+                    image.append(str);
+                }
+                image.append(body_);
+                return image;
+            }
+
+        private:
+            void WriteTag(NodeTag tag) {
+                body_.push_back(static_cast<char>(tag));
+            }
+
+            void WriteVarint(uint64_t value) {
+                AppendVarint(body_, value);
+            }
+
+            void WriteSymbol(Symbol symbol) {
+                auto [it, inserted] = symbol_index_.emplace(symbol, symbols_.size());
+                if (inserted) {
+                    symbols_.push_back(symbol);
+                }
+                WriteVarint(it->second);
+            }
+
+            void WriteSymbols(const vector<Symbol> &symbols) {
+                WriteVarint(symbols.size());
+                for (const Symbol symbol : symbols) {
+                    WriteSymbol(symbol);
+                }
+            }
+
+            // Одинаковые строковые константы хранятся в образе один раз
+            void WriteString(const string &str) {
+                auto [it, inserted] = string_index_.emplace(str, strings_.size());
+                if (inserted) {
+                    strings_.push_back(str);
+                }
+                WriteVarint(it->second);
+            }
+
+            void WriteNodes(const vector<unique_ptr<Statement>> &nodes) {
+                WriteVarint(nodes.size());
+                for (const auto &node : nodes) {
+                    WriteNode(node.get());
+                }
+            }
+
+            // Класс получает номер после своих методов: так же он создаётся при чтении образа
+            void WriteClass(const runtime::Class &cls) {
+                WriteSymbol(cls.GetName());
+                WriteVarint(cls.GetParent() ? GetClassIndex(*cls.GetParent()) + 1 : 0);
+                WriteVarint(cls.GetMethods().size());
+                for (const auto &method : cls.GetMethods()) {
+                    WriteSymbol(method.name);
+                    WriteSymbols(method.formal_params);
+                    WriteNode(method.body ? &method.body->Prepare() : nullptr);
+                }
+                class_index_.emplace(&cls, class_index_.size());
+            }
+
+            size_t GetClassIndex(const runtime::Class &cls) const {
+                auto it = class_index_.find(&cls);
+                if (it == class_index_.end()) {
+                    throw SerializeError("Class "s + cls.GetName().GetText() + " is not defined in the program"s);
+                }
+                return it->second;
+            }
+
+            static size_t GetComparatorIndex(const ast::Comparison::Comparator &cmp) {
+                if (const auto *fn = cmp.target<ComparatorFn>()) {
+                    for (size_t i = 0; i < size(COMPARATORS); ++i) {
+                        if (*fn == COMPARATORS[i]) {
+                            return i;
+                        }
+                    }
+                }
+                throw SerializeError("Unsupported comparator"s);
+            }
+
+            static NodeTag GetBinaryTag(const ast::BinaryOperation &op) {
+                if (dynamic_cast<const ast::Add *>(&op)) {
+                    return NodeTag::ADD;
+                }
+                if (dynamic_cast<const ast::Sub *>(&op)) {
+                    return NodeTag::SUB;
+                }
+                if (dynamic_cast<const ast::Mult *>(&op)) {
+                    return NodeTag::MULT;
+                }
+                if (dynamic_cast<const ast::Div *>(&op)) {
+                    return NodeTag::DIV;
+                }
+                if (dynamic_cast<const ast::Or *>(&op)) {
+                    return NodeTag::OR;
+                }
+                if (dynamic_cast<const ast::And *>(&op)) {
+                    return NodeTag::AND;
+                }
+                throw SerializeError("Unsupported binary operation"s);
+            }
+
+            string body_;
+            vector<Symbol> symbols_;
+            unordered_map<Symbol, size_t> symbol_index_;
+            vector<string_view> strings_;
+            unordered_map<string_view, size_t> string_index_;
+            unordered_map<const runtime::Class *, size_t> class_index_;
+        };
+
+        class Reader {
+        public:
+            explicit Reader(string_view image)
+                    : data_(image) {
+                if (data_.size() < HEADER_SIZE || memcmp(data_.data(), MAGIC, sizeof(MAGIC)) != 0) {
+                    throw SerializeError("Not a program image"s);
+                }
+                if (ReadFixed(data_, sizeof(MAGIC), 4) != FORMAT_VERSION) {
+                    throw SerializeError("Unsupported program image version"s);
+                }
+                pos_ = HEADER_SIZE;
+
+                symbols_.resize(ReadCount());
+                for (Symbol &symbol : symbols_) {
+                    symbol = Symbol(ReadBytes());
+                }
+                strings_.resize(ReadCount());
+                for (string_view &str : strings_) {
+                    str = ReadBytes();
+                }
+            }
+
+            unique_ptr<Statement> ReadNode() {  // NOLINT(misc-no-recursion)
+                const auto tag = static_cast<NodeTag>(ReadByte());
+                switch (tag) {
+                    case NodeTag::EMPTY:
+                        return nullptr;
+                    case NodeTag::NUMERIC_CONST: {
+                        const uint64_t zigzag = ReadVarint();
+                        const auto value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+                        return make_unique<ast::NumericConst>(runtime::Number{static_cast<int>(value)});
+                    }
+                    case NodeTag::STRING_CONST:
+                        return make_unique<ast::StringConst>(runtime::String{string(ReadString())});
+                    case NodeTag::BOOL_CONST:
+                        return make_unique<ast::BoolConst>(runtime::Bool{ReadVarint() != 0});
+                    case NodeTag::NONE:
+                        return make_unique<ast::None>();
+                    case NodeTag::VARIABLE_VALUE:
+                        return make_unique<ast::VariableValue>(ReadSymbols());
+                    case NodeTag::ASSIGNMENT: {
+                        const Symbol name = ReadSymbol();
+                        return make_unique<ast::Assignment>(name, ReadRequiredNode());
+                    }
+                    case NodeTag::FIELD_ASSIGNMENT: {
+                        ast::VariableValue object(ReadSymbols());
+                        const Symbol field = ReadSymbol();
+                        return make_unique<ast::FieldAssignment>(std::move(object), field, ReadRequiredNode());
+                    }
+                    case NodeTag::PRINT:
+                        return make_unique<ast::Print>(ReadNodes());
+                    case NodeTag::METHOD_CALL: {
+                        auto object = ReadRequiredNode();
+                        const Symbol method = ReadSymbol();
+                        return make_unique<ast::MethodCall>(std::move(object), method, ReadNodes());
+                    }
+                    case NodeTag::NEW_INSTANCE: {
+                        const runtime::Class &cls = ReadClassRef();
+                        return make_unique<ast::NewInstance>(cls, ReadNodes());
+                    }
+                    case NodeTag::STRINGIFY:
+                        return make_unique<ast::Stringify>(ReadRequiredNode());
+                    case NodeTag::NOT:
+                        return make_unique<ast::Not>(ReadRequiredNode());
+                    case NodeTag::ADD:
+                        return ReadBinary<ast::Add>();
+                    case NodeTag::SUB:
+                        return ReadBinary<ast::Sub>();
+                    case NodeTag::MULT:
+                        return ReadBinary<ast::Mult>();
+                    case NodeTag::DIV:
+                        return ReadBinary<ast::Div>();
+                    case NodeTag::OR:
+                        return ReadBinary<ast::Or>();
+                    case NodeTag::AND:
+                        return ReadBinary<ast::And>();
+                    case NodeTag::COMPARISON: {
+                        const uint64_t index = ReadVarint();
+                        if (index >= size(COMPARATORS)) {
+                            throw SerializeError("Bad comparator in program image"s);
+                        }
+                        auto lhs = ReadRequiredNode();
+                        return make_unique<ast::Comparison>(COMPARATORS[index], std::move(lhs), ReadRequiredNode());
+                    }
+                    case NodeTag::COMPOUND: {
+                        auto compound = make_unique<ast::Compound>();
+                        for (auto &statement : ReadNodes()) {
+                            compound->AddStatement(std::move(statement));
+                        }
+                        return compound;
+                    }
+                    case NodeTag::METHOD_BODY:
+                        return make_unique<ast::MethodBody>(ReadRequiredNode());
+                    case NodeTag::RETURN:
+                        return make_unique<ast::Return>(ReadRequiredNode());
+                    case NodeTag::CLASS_DEFINITION:
+                        return make_unique<ast::ClassDefinition>(ReadClass());
+                    case NodeTag::IF_ELSE: {
+                        auto condition = ReadRequiredNode();
+                        auto if_body = ReadRequiredNode();
+                        return make_unique<ast::IfElse>(std::move(condition), std::move(if_body), ReadNode());
+                    }
+                }
+                throw SerializeError("Bad node in program image"s);
+            }
+
+            void ExpectEnd() const {
+                if (pos_ != data_.size()) {
+                    throw SerializeError("Unexpected data at the end of program image"s);
+                }
+            }
+
+        private:
+            uint8_t ReadByte() {
+                if (pos_ >= data_.size()) {
+                    throw SerializeError("Truncated program image"s);
+                }
+                return static_cast<uint8_t>(data_[pos_++]);
+            }
+
+            uint64_t ReadVarint() {
+                uint64_t value = 0;
+                for (unsigned shift = 0; shift < 64; shift += 7) {
+                    const uint8_t byte = ReadByte();
+                    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                    if ((byte & 0x80) == 0) {
+                        return value;
+                    }
+                }
+                throw SerializeError("Bad number in program image"s);
+            }
+
+            // Читает количество элементов. Каждый элемент занимает хотя бы байт,
+            // поэтому количество больше оставшегося размера образа означает повреждение
+            size_t ReadCount() {
+                const uint64_t count = ReadVarint();
+                if (count > data_.size() - pos_) {
+                    throw SerializeError("Truncated program image"s);
+                }
+                return static_cast<size_t>(count);
+            }
+
+            string_view ReadBytes() {
+                const uint64_t size = ReadVarint();
+                if (size > data_.size() - pos_) {
+                    throw SerializeError("Truncated program image"s);
+                }
+                const string_view result = data_.substr(pos_, size);
+                pos_ += size;
+                return result;
+            }
+
+            Symbol ReadSymbol() {
+                const uint64_t index = ReadVarint();
+                if (index >= symbols_.size()) {
+                    throw SerializeError("Bad name in program image"s);
+                }
+                return symbols_[index];
+            }
+
+            vector<Symbol> ReadSymbols() {
+                vector<Symbol> result(ReadCount());
+                for (Symbol &symbol : result) {
+                    symbol = ReadSymbol();
+                }
+                return result;
+            }
+
+            string_view ReadString() {
+                const uint64_t index = ReadVarint();
+                if (index >= strings_.size()) {
+                    throw SerializeError("Bad string constant in program image"s);
+                }
+                return strings_[index];
+            }
+
+            unique_ptr<Statement> ReadRequiredNode() {  // NOLINT(misc-no-recursion)
+                auto node = ReadNode();
+                if (!node) {
+                    throw SerializeError("Missing node in program image"s);
+                }
+                return node;
+            }
+
+            vector<unique_ptr<Statement>> ReadNodes() {  // NOLINT(misc-no-recursion)
+                vector<unique_ptr<Statement>> result(ReadCount());
+                for (auto &node : result) {
+                    node = ReadRequiredNode();
+                }
+                return result;
+            }
+
+            template<typename Operation>
+            unique_ptr<Statement> ReadBinary() {  // NOLINT(misc-no-recursion)
+                auto lhs = ReadRequiredNode();
+                return make_unique<Operation>(std::move(lhs), ReadRequiredNode());
+            }
+
+            const runtime::Class &ReadClassRef() {
+                const uint64_t index = ReadVarint();
+                if (index >= classes_.size()) {
+                    throw SerializeError("Bad class in program image"s);
+                }
+                return *classes_[index];
+            }
+
+            // Класс создаётся так же, как при разборе: конструктор класса разрешает имена в методах
+            runtime::ObjectHolder ReadClass() {  // NOLINT(misc-no-recursion)
+                const Symbol name = ReadSymbol();
+                const runtime::Class *parent = nullptr;
+                if (const uint64_t parent_index = ReadVarint(); parent_index > 0) {
+                    if (parent_index > classes_.size()) {
+                        throw SerializeError("Bad base class in program image"s);
+                    }
+                    parent = classes_[parent_index - 1];
+                }
+
+                vector<runtime::Method> methods(ReadCount());
+                for (auto &method : methods) {
+                    method.name = ReadSymbol();
+                    method.formal_params = ReadSymbols();
+                    method.body = ReadNode();
+                }
+
+                auto cls = runtime::ObjectHolder::Own(runtime::Class(name, std::move(methods), parent));
+                classes_.push_back(cls.TryAs<runtime::Class>());
+                return cls;
+            }
+
+            string_view data_;
+            size_t pos_ = 0;
+            vector<Symbol> symbols_;
+            vector<string_view> strings_;
+            // Классы в порядке их определения. Классы удерживаются узлами ClassDefinition
+            vector<const runtime::Class *> classes_;
+        };
+    }  // namespace
+
+    SourceKey GetSourceKey(string_view source, uint64_t flags) {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ULL;
+        for (const char c : source) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+        }
+        for (int byte = 0; byte < 8; ++byte) {
+            hash = (hash ^ static_cast<uint8_t>(flags >> (byte * 8))) * 1099511628211ULL;
+        }
+        return {hash, source.size()};
+    }
+
+    string SerializeProgram(const runtime::Executable &program, const SourceKey &key) {
+        Writer writer;
+        writer.WriteNode(&program);
+        return writer.Finish(key);
+    }
+
+    SourceKey ReadSourceKey(string_view image) {
+        if (image.size() < HEADER_SIZE || memcmp(image.data(), MAGIC, sizeof(MAGIC)) != 0) {
+            throw SerializeError("Not a program image"s);
+        }
+        return {ReadFixed(image, sizeof(MAGIC) + 4, 8), ReadFixed(image, sizeof(MAGIC) + 12, 8)};
+    }
+
+    unique_ptr<runtime::Executable> DeserializeProgram(string_view image) {
+        // Узлы размещаются в арене, как и при разборе программы
+        runtime::AstArena::Scope arena;
+        Reader reader(image);
+        auto program = reader.ReadNode();
+        if (!program) {
+            throw SerializeError("Empty program image"s);
+        }
+        reader.ExpectEnd();
+
+        if (auto *compound = dynamic_cast<ast::Compound *>(program.get())) {
+            auto layout = make_shared<runtime::ClosureLayout>();
+            compound->ResolveNames(*layout);
+            compound->SetLayout(std::move(layout));
+        }
+        return program;
+    }
+
+}  // namespace serialize
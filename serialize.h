@@ -0,0 +1,56 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace serialize {
+
+    // Версия формата образа. Образ другой версии не загружается
+    inline constexpr std::uint32_t FORMAT_VERSION = 1;
+
+    // Выбрасывается, если программу невозможно сохранить в образ либо образ повреждён
+    class SerializeError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Ключ исходного текста программы: его хеш и размер
+    struct SourceKey {
+        std::uint64_t hash = 0;
+        std::uint64_t size = 0;
+
+        bool operator==(const SourceKey &other) const {
+            return hash == other.hash && size == other.size;
+        }
+
+        bool operator!=(const SourceKey &other) const {
+            return !(*this == other);
+        }
+    };
+
+    // Вычисляет ключ текста source. Ключ не зависит от платформы и сборки интерпретатора.
+    // flags - параметры, от которых зависит образ (например, параметры разбора), они хешируются вслед за текстом
+    SourceKey GetSourceKey(std::string_view source, std::uint64_t flags = 0);
+
+    /*
+     * Сохраняет разобранную программу в компактный двоичный образ: заголовок с ключом исходного
+     * текста, таблицу имён, таблицу строковых констант и дерево программы вместе с определениями
+     * классов. Числа записываются в формате LEB128. Отложенные тела методов перед сохранением
+     * разбираются. Если дерево содержит узел, не порождаемый парсером, выбрасывает SerializeError
+     */
+    std::string SerializeProgram(const runtime::Executable &program, const SourceKey &key = {});
+
+    // Возвращает ключ исходного текста, записанный в заголовке образа
+    SourceKey ReadSourceKey(std::string_view image);
+
+    // Восстанавливает программу из образа так же, как её возвращает ParseProgram: имена разрешены,
+    // узлы размещены в арене. Образ после возврата не используется. Если образ повреждён либо
+    // имеет другую версию формата, выбрасывает SerializeError
+    std::unique_ptr<runtime::Executable> DeserializeProgram(std::string_view image);
+
+}  // namespace serialize
@@ -1,7 +1,6 @@
 #include "statement.h"
 
 #include <iostream>
-#include <sstream>
 
 using namespace std;
 
@@ -12,72 +11,135 @@ namespace ast {
     using runtime::ObjectHolder;
 
     namespace {
-        const string ADD_METHOD = "__add__"s;
-        const string INIT_METHOD = "__init__"s;
+        const runtime::Symbol ADD_METHOD{"__add__"};
+        const runtime::Symbol INIT_METHOD{"__init__"};
+
+        // Возвращает значение переменной name либо nullptr, если ей не присвоено значение.
+        // Если closure размещён по схеме layout, переменная берётся из слота slot без поиска по имени
+        ObjectHolder *FindVariable(Closure &closure, const runtime::ClosureLayout *layout, size_t slot,
+                                   runtime::Symbol name) {
+            if (layout && closure.GetLayout() == layout) {
+                return closure.GetSlot(slot);
+            }
+            return closure.Find(name);
+        }
+
+        // Присваивает значение value переменной name. Аналог FindVariable для записи
+        ObjectHolder &AssignVariable(Closure &closure, const runtime::ClosureLayout *layout, size_t slot,
+                                     runtime::Symbol name, ObjectHolder value) {
+            if (layout && closure.GetLayout() == layout) {
+                return closure.SetSlot(slot, std::move(value));
+            }
+            return closure[name] = std::move(value);
+        }
     }  // namespace
 
-    VariableValue::VariableValue(const std::string &var_name) {
+    VariableValue::VariableValue(runtime::Symbol var_name) {
         dotted_ids_.push_back(var_name);
     }
 
-    VariableValue::VariableValue(std::vector<std::string> dotted_ids)
-            : dotted_ids_(std::move(dotted_ids)) {
+    VariableValue::VariableValue(std::vector<runtime::Symbol> dotted_ids)
+            : dotted_ids_(std::move(dotted_ids)), field_caches_(dotted_ids_.empty() ? 0 : dotted_ids_.size() - 1) {
     }
 
     ObjectHolder VariableValue::Execute(Closure &closure, Context & /*context*/) {
-        ObjectHolder result;
-        Closure *p_closure = &closure;
-        for (const auto &id : dotted_ids_) {
-            if (!p_closure->count(id)) {
-                throw runtime_error("Uncknown variable name: " + GetName());
-            }
-            result = p_closure->at(id);
-            if (result.TryAs<runtime::ClassInstance>()) {
-                p_closure = &result.TryAs<runtime::ClassInstance>()->Fields();
-            }
+        const ObjectHolder *value = FindVariable(closure, layout_, slot_, dotted_ids_.front());
+        for (size_t i = 1; value && i < dotted_ids_.size(); ++i) {
+            auto *instance = value->TryAs<runtime::ClassInstance>();
+            value = instance ? instance->Fields().Find(dotted_ids_[i], field_caches_[i - 1]) : nullptr;
         }
-        return result;
+        if (!value) {
+            runtime::ThrowUnknownVariable(GetName());
+        }
+        return *value;
+    }
+
+    void VariableValue::ResolveNames(runtime::ClosureLayout &layout) {
+        layout_ = &layout;
+        slot_ = layout.AddName(dotted_ids_.front());
     }
 
     std::string VariableValue::GetName() const {
         std::string full_name;
         for (const auto &id: dotted_ids_) {
-            full_name += full_name.empty() ? id : '.' + id;
+            if (!full_name.empty()) {
+                full_name += '.';
+            }
+            full_name += id.GetText();
         }
         return full_name;
     }
 
-    const std::vector<std::string> &VariableValue::GetDottedIds() const {
+    const std::vector<runtime::Symbol> &VariableValue::GetDottedIds() const {
         return dotted_ids_;
     }
 
     ObjectHolder Assignment::Execute(Closure &closure, Context &context) {
-        context.SetSelfName(var_name_);
-        closure[var_name_] = rv_->Execute(closure, context);
-        return closure.at(var_name_);
+        auto value = rv_->Execute(closure, context);
+        value.Retain();
+        return AssignVariable(closure, layout_, slot_, var_name_, std::move(value));
     }
 
-    Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv)
+    void Assignment::ResolveNames(runtime::ClosureLayout &layout) {
+        rv_->ResolveNames(layout);
+        layout_ = &layout;
+        slot_ = layout.AddName(var_name_);
+    }
+
+    void Assignment::ForEachChild(const ChildVisitor &visitor) {
+        visitor(rv_);
+    }
+
+    Assignment::Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv)
             : var_name_(std::move(var)), rv_(std::move(rv)) {
     }
 
-    FieldAssignment::FieldAssignment(VariableValue object, std::string field_name,
+    runtime::Symbol Assignment::GetVarName() const {
+        return var_name_;
+    }
+
+    const Statement &Assignment::GetRvalue() const {
+        return *rv_;
+    }
+
+    FieldAssignment::FieldAssignment(VariableValue object, runtime::Symbol field_name,
                                      std::unique_ptr<Statement> rv)
             : object_(std::move(object)), field_name_(std::move(field_name)), rv_(std::move(rv)) {
     }
 
     ObjectHolder FieldAssignment::Execute(Closure &closure, Context &context) {
-        auto dotted_ids = object_.GetDottedIds();
-        Closure *p_closure = &closure;
-        for (const auto &id: dotted_ids) {
-            auto &val = p_closure->at(id);
-            p_closure = &val.TryAs<runtime::ClassInstance>()->Fields();
+        auto object = object_.Execute(closure, context);
+        auto *instance = object.TryAs<runtime::ClassInstance>();
+        if (!instance) {
+            throw runtime_error("Cannot set field " + field_name_.GetText() + " of non-object " + object_.GetName());
         }
-        (*p_closure)[field_name_] = std::move(rv_->Execute(closure, context));
-        return p_closure->at(field_name_);
+        auto value = rv_->Execute(closure, context);
+        value.Retain();
+        return instance->Fields().Assign(field_name_, field_cache_) = std::move(value);
+    }
+
+    void FieldAssignment::ResolveNames(runtime::ClosureLayout &layout) {
+        object_.ResolveNames(layout);
+        rv_->ResolveNames(layout);
+    }
+
+    void FieldAssignment::ForEachChild(const ChildVisitor &visitor) {
+        visitor(rv_);
+    }
+
+    const VariableValue &FieldAssignment::GetObject() const {
+        return object_;
+    }
+
+    runtime::Symbol FieldAssignment::GetFieldName() const {
+        return field_name_;
     }
 
-    unique_ptr<Print> Print::Variable(const std::string &name) {
+    const Statement &FieldAssignment::GetRvalue() const {
+        return *rv_;
+    }
+
+    unique_ptr<Print> Print::Variable(runtime::Symbol name) {
         return make_unique<Print>(Print(make_unique<VariableValue>(VariableValue(name))));
     }
 
@@ -90,6 +152,22 @@ namespace ast {
     }
 
     ObjectHolder Print::Execute(Closure &closure, Context &context) {
+        if (auto *sink = context.GetOutputSink()) {
+            for (auto it = args_.cbegin(); it != args_.cend(); ++it) {
+                auto holder = (*it)->Execute(closure, context);
+                if (it != args_.cbegin()) {
+                    sink->Write(' ');
+                }
+                if (holder) {
+                    holder->PrintTo(*sink, context);
+                } else {
+                    sink->Write("None"sv);
+                }
+            }
+            sink->Write('\n');
+            return {};
+        }
+
         auto &out = context.GetOutputStream();
         for (auto it = args_.cbegin(); it != args_.cend(); ++it) {
             auto holder = (*it)->Execute(closure, context);
@@ -104,7 +182,23 @@ namespace ast {
         return {};
     }
 
-    MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
+    void Print::ResolveNames(runtime::ClosureLayout &layout) {
+        for (const auto &arg : args_) {
+            arg->ResolveNames(layout);
+        }
+    }
+
+    void Print::ForEachChild(const ChildVisitor &visitor) {
+        for (auto &arg : args_) {
+            visitor(arg);
+        }
+    }
+
+    const std::vector<std::unique_ptr<Statement>> &Print::GetArgs() const {
+        return args_;
+    }
+
+    MethodCall::MethodCall(std::unique_ptr<Statement> object, runtime::Symbol method,
                            std::vector<std::unique_ptr<Statement>> args)
             : object_(std::move(object)), method_(std::move(method)), args_(std::move(args)) {
     }
@@ -112,27 +206,47 @@ namespace ast {
     ObjectHolder MethodCall::Execute(Closure &closure, Context &context) {
         auto holder = object_->Execute(closure, context);
         auto instance = holder.TryAs<runtime::ClassInstance>();
-        if (instance && instance->HasMethod(method_, args_.size())) {
-            std::vector<ObjectHolder> actual_args;
+        const auto *method = instance ? cache_.Find(instance->GetClass(), method_, args_.size()) : nullptr;
+        if (method) {
+            auto actual_args = runtime::CallStack::GetInstance().PushArguments();
             for (const auto &stmt: args_) {
-                actual_args.push_back(stmt->Execute(closure, context));
+                actual_args.Push(stmt->Execute(closure, context));
             }
-            return instance->Call(method_, actual_args, context);
+            return instance->Call(*method, actual_args.GetData(), actual_args.GetSize(), context);
         }
         return {};
     }
 
-    ObjectHolder Stringify::Execute(Closure &closure, Context &context) {
-        auto holder = argument_->Execute(closure, context);
-        if (holder) {
-            std::stringstream ss;
-            holder->Print(ss, context);
-            return ObjectHolder::Own(runtime::String(ss.str()));
-        } else {
-            return ObjectHolder::Own(runtime::String("None"));
+    void MethodCall::ResolveNames(runtime::ClosureLayout &layout) {
+        object_->ResolveNames(layout);
+        for (const auto &arg : args_) {
+            arg->ResolveNames(layout);
+        }
+    }
+
+    void MethodCall::ForEachChild(const ChildVisitor &visitor) {
+        visitor(object_);
+        for (auto &arg : args_) {
+            visitor(arg);
         }
     }
 
+    const Statement &MethodCall::GetObject() const {
+        return *object_;
+    }
+
+    runtime::Symbol MethodCall::GetMethodName() const {
+        return method_;
+    }
+
+    const std::vector<std::unique_ptr<Statement>> &MethodCall::GetArgs() const {
+        return args_;
+    }
+
+    ObjectHolder Stringify::Execute(Closure &closure, Context &context) {
+        return runtime::ToString(argument_->Execute(closure, context), context);
+    }
+
     ObjectHolder Add::Execute(Closure &closure, Context &context) {
         auto lhs_holder = lhs_->Execute(closure, context);
         auto rhs_holder = rhs_->Execute(closure, context);
@@ -151,8 +265,10 @@ namespace ast {
             }
             // ClassInstance
             auto lhs_as_obj = lhs_holder.TryAs<runtime::ClassInstance>();
-            if (lhs_as_obj && lhs_as_obj->HasMethod(ADD_METHOD, 1)) {
-                return lhs_as_obj->Call(ADD_METHOD, {rhs_holder}, context);
+            if (lhs_as_obj) {
+                if (const auto *method = cache_.Find(lhs_as_obj->GetClass(), ADD_METHOD, 1)) {
+                    return lhs_as_obj->Call(*method, &rhs_holder, 1, context);
+                }
             }
         }
         throw runtime_error("Invalid arguments in Add");
@@ -191,22 +307,43 @@ namespace ast {
             auto lhs_as_num = lhs_holder.TryAs<runtime::Number>();
             auto rhs_as_num = rhs_holder.TryAs<runtime::Number>();
             if (lhs_as_num && rhs_as_num) {
-                return ObjectHolder::Own(runtime::Number{lhs_as_num->GetValue() / rhs_as_num->GetValue()});
+                return ObjectHolder::Own(runtime::Number{runtime::Divide(lhs_as_num->GetValue(), rhs_as_num->GetValue())});
             }
         }
         throw runtime_error("Invalid arguments in Div");
     }
 
     ObjectHolder Compound::Execute(Closure &closure, Context &context) {
+        if (layout_ && closure.GetLayout() != layout_.get()) {
+            closure.SetLayout(layout_);
+        }
         for (const auto &stmt: args_) {
-            stmt->Execute(closure, context);
+            auto result = stmt->Execute(closure, context);
+            if (closure.HasReturned()) {
+                return result;
+            }
         }
         return ObjectHolder::None();
     }
 
+    void Compound::ResolveNames(runtime::ClosureLayout &layout) {
+        for (const auto &stmt: args_) {
+            stmt->ResolveNames(layout);
+        }
+    }
+
+    void Compound::ForEachChild(const ChildVisitor &visitor) {
+        for (auto &stmt: args_) {
+            visitor(stmt);
+        }
+    }
+
     ObjectHolder Return::Execute(Closure &closure, Context &context) {
         auto holder = statement_->Execute(closure, context);
-        throw ReturnException(std::move(holder));
+        // Результат может пережить вызов метода, а с ним и заимствованную ссылку self
+        holder.Retain();
+        closure.SetReturned(true);
+        return holder;
     }
 
     ClassDefinition::ClassDefinition(ObjectHolder cls)
@@ -214,7 +351,15 @@ namespace ast {
     }
 
     ObjectHolder ClassDefinition::Execute(Closure &closure, Context &) {
-        closure[cls_.TryAs<runtime::Class>()->GetName()] = cls_;
+        return AssignVariable(closure, layout_, slot_, cls_.TryAs<runtime::Class>()->GetName(), cls_);
+    }
+
+    void ClassDefinition::ResolveNames(runtime::ClosureLayout &layout) {
+        layout_ = &layout;
+        slot_ = layout.AddName(cls_.TryAs<runtime::Class>()->GetName());
+    }
+
+    const ObjectHolder &ClassDefinition::GetClass() const {
         return cls_;
     }
 
@@ -235,6 +380,34 @@ namespace ast {
         return ObjectHolder::None();
     }
 
+    void IfElse::ResolveNames(runtime::ClosureLayout &layout) {
+        condition_->ResolveNames(layout);
+        if_body_->ResolveNames(layout);
+        if (else_body_) {
+            else_body_->ResolveNames(layout);
+        }
+    }
+
+    void IfElse::ForEachChild(const ChildVisitor &visitor) {
+        visitor(condition_);
+        visitor(if_body_);
+        if (else_body_) {
+            visitor(else_body_);
+        }
+    }
+
+    const Statement &IfElse::GetCondition() const {
+        return *condition_;
+    }
+
+    const Statement &IfElse::GetIfBody() const {
+        return *if_body_;
+    }
+
+    const Statement *IfElse::GetElseBody() const {
+        return else_body_.get();
+    }
+
     ObjectHolder Or::Execute(Closure &closure, Context &context) {
         auto lhs_holder = lhs_->Execute(closure, context);
         auto rhs_holder = rhs_->Execute(closure, context);
@@ -271,6 +444,10 @@ namespace ast {
         return ObjectHolder::Own(runtime::Bool{cmp_(lhs_holder, rhs_holder, context)});
     }
 
+    const Comparison::Comparator &Comparison::GetComparator() const {
+        return cmp_;
+    }
+
     NewInstance::NewInstance(const runtime::Class &cls, std::vector<std::unique_ptr<Statement>> args)
             : class_(cls), args_(std::move(args)) {
     }
@@ -280,20 +457,38 @@ namespace ast {
     }
 
     ObjectHolder NewInstance::Execute(Closure &closure, Context &context) {
-        std::string self_name = context.GetSelfName();
-        {
-            runtime::ClassInstance inst{class_};
-            closure[self_name] = ObjectHolder::Own(std::move(inst));
-        }
-        auto *instance = const_cast<runtime::ClassInstance *>(closure.at(self_name).TryAs<runtime::ClassInstance>());
-        if (instance->HasMethod(INIT_METHOD, args_.size())) {
-            std::vector<ObjectHolder> actual_args;
+        // Созданный объект удерживается локальным holder'ом, а не переменной из closure:
+        // выражение вида print Point(1, 2) не должно затирать ранее присвоенную переменную
+        auto holder = ObjectHolder::Own(runtime::ClassInstance{class_});
+        auto *instance = holder.TryAs<runtime::ClassInstance>();
+        if (const auto *init = cache_.Find(class_, INIT_METHOD, args_.size())) {
+            auto actual_args = runtime::CallStack::GetInstance().PushArguments();
             for (const auto &stmt: args_) {
-                actual_args.push_back(stmt->Execute(closure, context));
+                actual_args.Push(stmt->Execute(closure, context));
             }
-            instance->Call(INIT_METHOD, actual_args, context);
+            instance->Call(*init, actual_args.GetData(), actual_args.GetSize(), context);
+        }
+        return holder;
+    }
+
+    void NewInstance::ResolveNames(runtime::ClosureLayout &layout) {
+        for (const auto &arg : args_) {
+            arg->ResolveNames(layout);
+        }
+    }
+
+    void NewInstance::ForEachChild(const ChildVisitor &visitor) {
+        for (auto &arg : args_) {
+            visitor(arg);
         }
-        return closure.at(self_name);
+    }
+
+    const runtime::Class &NewInstance::GetClass() const {
+        return class_;
+    }
+
+    const std::vector<std::unique_ptr<Statement>> &NewInstance::GetArgs() const {
+        return args_;
     }
 
     MethodBody::MethodBody(std::unique_ptr<Statement> body)
@@ -301,18 +496,20 @@ namespace ast {
     }
 
     ObjectHolder MethodBody::Execute(Closure &closure, Context &context) {
-        try {
-            return body_->Execute(closure, context);
-        } catch (ReturnException &ex) {
-            return ex.GetResult();
-        }
+        auto result = body_->Execute(closure, context);
+        closure.SetReturned(false);
+        return result;
+    }
+
+    void MethodBody::ResolveNames(runtime::ClosureLayout &layout) {
+        body_->ResolveNames(layout);
     }
 
-    ReturnException::ReturnException(runtime::ObjectHolder result)
-            : result_(std::move(result)) {
+    void MethodBody::ForEachChild(const ChildVisitor &visitor) {
+        visitor(body_);
     }
 
-    runtime::ObjectHolder ReturnException::GetResult() {
-        return result_;
+    const Statement &MethodBody::GetBody() const {
+        return *body_;
     }
 }  // namespace ast
@@ -19,7 +19,18 @@ namespace ast {
 
         runtime::ObjectHolder Execute(runtime::Closure & /*closure*/,
                                       runtime::Context & /*context*/) override {
-            return runtime::ObjectHolder::Share(value_);
+            if constexpr (std::is_same_v<T, runtime::Number> || std::is_same_v<T, runtime::Bool>) {
+                // Числа и логические значения копируются внутрь ObjectHolder без выделения памяти
+                return runtime::ObjectHolder::Own(T(value_));
+            } else {
+                // Значения Mython не изменяются после создания, поэтому константа передаётся
+                // заимствованной ссылкой и может одновременно читаться из нескольких потоков
+                return runtime::ObjectHolder::Share(value_);
+            }
+        }
+
+        [[nodiscard]] const T &GetValue() const {
+            return value_;
         }
 
     private:
@@ -37,43 +48,71 @@ namespace ast {
     */
     class VariableValue : public Statement {
     public:
-        explicit VariableValue(const std::string &var_name);
+        explicit VariableValue(runtime::Symbol var_name);
 
-        explicit VariableValue(std::vector<std::string> dotted_ids);
+        explicit VariableValue(std::vector<runtime::Symbol> dotted_ids);
 
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
         [[nodiscard]] std::string GetName() const;
 
-        [[nodiscard]] const std::vector<std::string> &GetDottedIds() const;
+        [[nodiscard]] const std::vector<runtime::Symbol> &GetDottedIds() const;
 
     private:
-        std::vector<std::string> dotted_ids_;
+        std::vector<runtime::Symbol> dotted_ids_;
+        // Схема, по которой разрешено имя dotted_ids_[0], и номер его слота в этой схеме
+        const runtime::ClosureLayout *layout_ = nullptr;
+        size_t slot_ = 0;
+        // Расположение полей dotted_ids_[1], dotted_ids_[2], ... в объектах последней встреченной схемы
+        std::vector<runtime::Closure::SlotCache> field_caches_;
     };
 
     // Присваивает переменной, имя которой задано в параметре var, значение выражения rv
     class Assignment : public Statement {
     public:
-        Assignment(std::string var, std::unique_ptr<Statement> rv);
+        Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv);
 
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        void ForEachChild(const ChildVisitor &visitor) override;
+
+        [[nodiscard]] runtime::Symbol GetVarName() const;
+
+        [[nodiscard]] const Statement &GetRvalue() const;
+
     private:
-        const std::string var_name_;
+        const runtime::Symbol var_name_;
         std::unique_ptr<Statement> rv_;
+        const runtime::ClosureLayout *layout_ = nullptr;
+        size_t slot_ = 0;
     };
 
     // Присваивает полю object.field_name значение выражения rv
     class FieldAssignment : public Statement {
     public:
-        FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
+        FieldAssignment(VariableValue object, runtime::Symbol field_name, std::unique_ptr<Statement> rv);
 
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        void ForEachChild(const ChildVisitor &visitor) override;
+
+        [[nodiscard]] const VariableValue &GetObject() const;
+
+        [[nodiscard]] runtime::Symbol GetFieldName() const;
+
+        [[nodiscard]] const Statement &GetRvalue() const;
+
     private:
         VariableValue object_;
-        const std::string field_name_;
+        const runtime::Symbol field_name_;
         std::unique_ptr<Statement> rv_;
+        runtime::Closure::SlotCache field_cache_;
     };
 
     // Значение None
@@ -95,12 +134,18 @@ namespace ast {
         explicit Print(std::vector<std::unique_ptr<Statement>> args);
 
         // Инициализирует команду print для вывода значения переменной name
-        static std::unique_ptr<Print> Variable(const std::string &name);
+        static std::unique_ptr<Print> Variable(runtime::Symbol name);
 
-        // Во время выполнения команды print вывод должен осуществляться в поток, возвращаемый из
-        // context.GetOutputStream()
+        // Во время выполнения команды print вывод должен осуществляться в приёмник
+        // context.GetOutputSink(), если он есть, либо в поток, возвращаемый из context.GetOutputStream()
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        void ForEachChild(const ChildVisitor &visitor) override;
+
+        [[nodiscard]] const std::vector<std::unique_ptr<Statement>> &GetArgs() const;
+
     private:
         std::vector<std::unique_ptr<Statement>> args_;
     };
@@ -108,15 +153,31 @@ namespace ast {
     // Вызывает метод object.method со списком параметров args
     class MethodCall : public Statement {
     public:
-        MethodCall(std::unique_ptr<Statement> object, std::string method,
+        MethodCall(std::unique_ptr<Statement> object, runtime::Symbol method,
                    std::vector<std::unique_ptr<Statement>> args);
 
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        void ForEachChild(const ChildVisitor &visitor) override;
+
+        [[nodiscard]] const Statement &GetObject() const;
+
+        [[nodiscard]] runtime::Symbol GetMethodName() const;
+
+        [[nodiscard]] const std::vector<std::unique_ptr<Statement>> &GetArgs() const;
+
+        // Возвращает инлайн-кеш, разрешающий метод по классу получателя
+        [[nodiscard]] const runtime::MethodCache &GetCache() const {
+            return cache_;
+        }
+
     private:
         std::unique_ptr<Statement> object_;
-        std::string method_;
+        runtime::Symbol method_;
         std::vector<std::unique_ptr<Statement>> args_;
+        runtime::MethodCache cache_;
     };
 
     /*
@@ -141,9 +202,23 @@ namespace ast {
         // Возвращает объект, содержащий значение типа ClassInstance
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        void ForEachChild(const ChildVisitor &visitor) override;
+
+        [[nodiscard]] const runtime::Class &GetClass() const;
+
+        [[nodiscard]] const std::vector<std::unique_ptr<Statement>> &GetArgs() const;
+
+        // Возвращает кеш, разрешающий конструктор __init__
+        [[nodiscard]] const runtime::MethodCache &GetCache() const {
+            return cache_;
+        }
+
     private:
         const runtime::Class &class_;
         std::vector<std::unique_ptr<Statement>> args_;
+        runtime::MethodCache cache_;
     };
 
     // Базовый класс для унарных операций
@@ -153,6 +228,18 @@ namespace ast {
                 : argument_(std::move(argument)) {
         }
 
+        void ResolveNames(runtime::ClosureLayout &layout) override {
+            argument_->ResolveNames(layout);
+        }
+
+        void ForEachChild(const ChildVisitor &visitor) override {
+            visitor(argument_);
+        }
+
+        [[nodiscard]] const Statement &GetArgument() const {
+            return *argument_;
+        }
+
     protected:
         std::unique_ptr<Statement> argument_;
     };
@@ -172,6 +259,24 @@ namespace ast {
                 : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {
         }
 
+        void ResolveNames(runtime::ClosureLayout &layout) override {
+            lhs_->ResolveNames(layout);
+            rhs_->ResolveNames(layout);
+        }
+
+        void ForEachChild(const ChildVisitor &visitor) override {
+            visitor(lhs_);
+            visitor(rhs_);
+        }
+
+        [[nodiscard]] const Statement &GetLhs() const {
+            return *lhs_;
+        }
+
+        [[nodiscard]] const Statement &GetRhs() const {
+            return *rhs_;
+        }
+
     protected:
         std::unique_ptr<Statement> lhs_;
         std::unique_ptr<Statement> rhs_;
@@ -188,6 +293,14 @@ namespace ast {
         //  объект1 + объект2, если у объект1 - пользовательский класс с методом _add__(rhs)
         // В противном случае при вычислении выбрасывается runtime_error
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
+
+        // Возвращает кеш, разрешающий метод __add__ по классу левого аргумента
+        [[nodiscard]] const runtime::MethodCache &GetCache() const {
+            return cache_;
+        }
+
+    private:
+        runtime::MethodCache cache_;
     };
 
     // Возвращает результат вычитания аргументов lhs и rhs
@@ -269,6 +382,20 @@ namespace ast {
         // Последовательно выполняет добавленные инструкции. Возвращает None
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        void ForEachChild(const ChildVisitor &visitor) override;
+
+        // Задаёт схему переменных программы верхнего уровня. Перед выполнением инструкций
+        // closure переводится на эту схему
+        void SetLayout(std::shared_ptr<const runtime::ClosureLayout> layout) {
+            layout_ = std::move(layout);
+        }
+
+        [[nodiscard]] const std::vector<std::unique_ptr<Statement>> &GetStatements() const {
+            return args_;
+        }
+
     private:
         void ReqursiveMake() {
         }
@@ -280,6 +407,7 @@ namespace ast {
         }
 
         std::vector<std::unique_ptr<Statement>> args_;
+        std::shared_ptr<const runtime::ClosureLayout> layout_;
     };
 
     // Тело метода. Как правило, содержит составную инструкцию
@@ -292,6 +420,12 @@ namespace ast {
         // В противном случае возвращает None
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        void ForEachChild(const ChildVisitor &visitor) override;
+
+        [[nodiscard]] const Statement &GetBody() const;
+
     private:
         std::unique_ptr<Statement> body_;
     };
@@ -305,8 +439,21 @@ namespace ast {
 
         // Останавливает выполнение текущего метода. После выполнения инструкции return метод,
         // внутри которого она была исполнена, должен вернуть результат вычисления выражения statement.
+        // Возвращает этот результат и выставляет в closure сигнал завершения метода
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override {
+            statement_->ResolveNames(layout);
+        }
+
+        void ForEachChild(const ChildVisitor &visitor) override {
+            visitor(statement_);
+        }
+
+        [[nodiscard]] const Statement &GetStatement() const {
+            return *statement_;
+        }
+
     private:
         std::unique_ptr<Statement> statement_;
     };
@@ -321,8 +468,15 @@ namespace ast {
         // конструктор
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        // Имя класса становится переменной. Методы класса разрешаются при его создании
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        [[nodiscard]] const runtime::ObjectHolder &GetClass() const;
+
     private:
         runtime::ObjectHolder cls_;
+        const runtime::ClosureLayout *layout_ = nullptr;
+        size_t slot_ = 0;
     };
 
     // Инструкция if <condition> <if_body> else <else_body>
@@ -334,6 +488,17 @@ namespace ast {
 
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
+        void ResolveNames(runtime::ClosureLayout &layout) override;
+
+        void ForEachChild(const ChildVisitor &visitor) override;
+
+        [[nodiscard]] const Statement &GetCondition() const;
+
+        [[nodiscard]] const Statement &GetIfBody() const;
+
+        // Возвращает nullptr, если ветка else отсутствует
+        [[nodiscard]] const Statement *GetElseBody() const;
+
     private:
         std::unique_ptr<Statement> condition_;
         std::unique_ptr<Statement> if_body_;
@@ -353,16 +518,10 @@ namespace ast {
         // приведённый к типу runtime::Bool
         runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context &context) override;
 
-    private:
-        Comparator cmp_;
-    };
+        [[nodiscard]] const Comparator &GetComparator() const;
 
-    class ReturnException: public std::exception {
-    public:
-        explicit ReturnException(runtime::ObjectHolder result);
-        runtime::ObjectHolder GetResult();
     private:
-        runtime::ObjectHolder result_;
+        Comparator cmp_;
     };
 
 }  // namespace ast
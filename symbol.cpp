@@ -0,0 +1,59 @@
+#include "symbol.h"
+
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace runtime {
+
+    Symbol::Symbol()
+            : Symbol(std::string_view{}) {
+    }
+
+    Symbol::Symbol(std::string_view text)
+            : entry_(Intern(text)) {
+    }
+
+    Symbol::Symbol(const std::string &text)
+            : entry_(Intern(text)) {
+    }
+
+    Symbol::Symbol(const char *text)
+            : entry_(Intern(text)) {
+    }
+
+    const Symbol::Entry *Symbol::Intern(std::string_view text) {
+        // Поток сначала ищет символ в собственной копии таблицы, не захватывая мьютекс.
+        // Ключи обеих таблиц ссылаются на текст записей, который не перемещается
+        using SymbolTable = std::unordered_map<std::string_view, const Entry *>;
+        thread_local SymbolTable local_symbols;
+        if (auto it = local_symbols.find(text); it != local_symbols.end()) {
+            return it->second;
+        }
+
+        // Таблица и записи намеренно не освобождаются: символы действительны до завершения программы,
+        // в том числе в деструкторах статических объектов
+        static std::mutex mutex;
+        static auto *symbols = new SymbolTable;
+        const Entry *entry;
+        {
+            std::lock_guard guard(mutex);
+            auto it = symbols->find(text);
+            if (it == symbols->end()) {
+                auto *new_entry = new Entry{std::string(text), std::hash<std::string_view>{}(text)};
+                it = symbols->emplace(new_entry->text, new_entry).first;
+            }
+            entry = it->second;
+        }
+        local_symbols.emplace(entry->text, entry);
+        return entry;
+    }
+
+    std::ostream &operator<<(std::ostream &os, Symbol symbol) {
+        return os << symbol.GetText();
+    }
+
+}  // namespace runtime
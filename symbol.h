@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+
+    /*
+     * Интернированное имя (идентификатор). Все символы с одинаковым текстом ссылаются на одну
+     * запись в глобальной таблице символов, поэтому сравнение символов сводится к сравнению указателей,
+     * а хеш вычисляется однократно при интернировании.
+     * Записи таблицы символов не удаляются до завершения программы. Интернирование потокобезопасно
+     */
+    class Symbol {
+    public:
+        // Создаёт символ, соответствующий пустой строке
+        Symbol();
+
+        // Интернирует текст text. Конструкторы неявные, чтобы имя можно было передать
+        // туда, где ожидается символ
+        Symbol(std::string_view text);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+
+        Symbol(const std::string &text);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+
+        Symbol(const char *text);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+
+        [[nodiscard]] const std::string &GetText() const {
+            return entry_->text;
+        }
+
+        [[nodiscard]] size_t GetHash() const {
+            return entry_->hash;
+        }
+
+        bool operator==(Symbol other) const {
+            return entry_ == other.entry_;
+        }
+
+        bool operator!=(Symbol other) const {
+            return entry_ != other.entry_;
+        }
+
+    private:
+        struct Entry {
+            std::string text;
+            size_t hash;
+        };
+
+        static const Entry *Intern(std::string_view text);
+
+        const Entry *entry_;
+    };
+
+    std::ostream &operator<<(std::ostream &os, Symbol symbol);
+
+    // Хешер символа, использующий вычисленный при интернировании хеш
+    struct SymbolHasher {
+        size_t operator()(Symbol symbol) const {
+            return symbol.GetHash();
+        }
+    };
+
+}  // namespace runtime
+
+namespace std {
+    template<>
+    struct hash<runtime::Symbol> : runtime::SymbolHasher {
+    };
+}  // namespace std
@@ -0,0 +1,35 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<std::size_t> allocation_count{0};
+    std::atomic<std::size_t> allocated_bytes{0};
+}  // namespace
+
+std::size_t GetAllocationCount() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+std::size_t GetAllocatedBytes() {
+    return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+void *operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t /*size*/) noexcept {
+    std::free(p);
+}
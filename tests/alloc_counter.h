@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+
+// Возвращает количество выделений динамической памяти, выполненных с момента запуска программы
+std::size_t GetAllocationCount();
+
+// Возвращает суммарный объём динамической памяти в байтах, запрошенный с момента запуска программы
+std::size_t GetAllocatedBytes();
@@ -0,0 +1,85 @@
+#include "../arena.h"
+#include "../lexer.h"
+#include "../parse.h"
+#include "../statement.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        void TestNodesArePlacedInParseOrder() {
+            vector<unique_ptr<ast::Statement>> nodes;
+            {
+                AstArena::Scope scope;
+                for (int i = 0; i < 10000; ++i) {
+                    nodes.push_back(make_unique<ast::NumericConst>(i));
+                }
+                const AstArena &arena = scope.GetArena();
+                ASSERT(arena.GetBlockCount() > 1U);
+                for (const auto &node : nodes) {
+                    ASSERT(arena.Contains(node.get()));
+                }
+                // Узлы одного блока следуют друг за другом
+                ASSERT(nodes[0].get() < nodes[1].get());
+                ASSERT(nodes[1].get() < nodes[2].get());
+
+                auto outside = unique_ptr<ast::Statement>(nullptr);
+                {
+                    AstArena::Scope nested;
+                    outside = make_unique<ast::None>();
+                    ASSERT(!arena.Contains(outside.get()));
+                    ASSERT(nested.GetArena().Contains(outside.get()));
+                }
+            }
+
+            // Узлы переживают Scope, пока не удалены
+            DummyContext context;
+            Closure closure;
+            ASSERT_EQUAL(nodes.back()->Execute(closure, context).TryAs<Number>()->GetValue(), 9999);
+            nodes.clear();
+
+            // Без Scope узлы размещаются в куче
+            auto node = make_unique<ast::NumericConst>(1);
+            AstArena::Scope scope;
+            ASSERT(!scope.GetArena().Contains(node.get()));
+        }
+
+        void TestClassesOutliveProgramTree() {
+            istringstream input(R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(x):
+    self.value = self.value + x
+    return self.value
+
+counter = Counter()
+)"s);
+            parse::Lexer lexer(input);
+            auto program = ParseProgram(lexer);
+
+            DummyContext context;
+            Closure closure;
+            program->Execute(closure, context);
+            program.reset();
+
+            // Тела методов размещены в той же арене, что и удалённое дерево программы
+            auto *counter = closure.at("counter"s).TryAs<ClassInstance>();
+            ASSERT(counter != nullptr);
+            ASSERT_EQUAL(counter->Call("add"s, {ObjectHolder::Own(Number{5})}, context).TryAs<Number>()->GetValue(), 5);
+            ASSERT_EQUAL(counter->Call("add"s, {ObjectHolder::Own(Number{2})}, context).TryAs<Number>()->GetValue(), 7);
+        }
+
+    }  // namespace
+
+    void RunArenaTests(TestRunner &tr) {
+        RUN_TEST(tr, runtime::TestNodesArePlacedInParseOrder);
+        RUN_TEST(tr, runtime::TestClassesOutliveProgramTree);
+    }
+
+}  // namespace runtime
@@ -0,0 +1,172 @@
+#include "../batch.h"
+#include "test_runner_p.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace batch {
+
+    namespace {
+        namespace fs = std::filesystem;
+
+        // Каталог со сценариями, удаляемый вместе с объектом
+        class ScriptDirectory {
+        public:
+            ScriptDirectory()
+                    : path_(fs::temp_directory_path() / "mython_batch_test"s) {
+                fs::remove_all(path_);
+                fs::create_directories(path_);
+            }
+
+            ~ScriptDirectory() {
+                std::error_code ec;
+                fs::remove_all(path_, ec);
+            }
+
+            // Создаёт сценарий name с текстом text и возвращает путь к нему
+            string Add(const string &name, const string &text) {
+                const fs::path path = path_ / name;
+                ofstream(path) << text;
+                return path.string();
+            }
+
+        private:
+            fs::path path_;
+        };
+
+        void TestPoolRunsEveryTaskOnce() {
+            WorkStealingPool pool(4);
+            ASSERT_EQUAL(pool.GetThreadCount(), 4U);
+            for (size_t count : {0U, 1U, 3U, 1000U}) {
+                vector<atomic<int>> runs(count);
+                pool.ForEach(count, [&runs](size_t index, size_t worker) {
+                    ASSERT(worker < 4U);
+                    runs[index].fetch_add(1);
+                });
+                for (const auto &run : runs) {
+                    ASSERT_EQUAL(run.load(), 1);
+                }
+            }
+        }
+
+        void TestPoolStealsWork() {
+            // Первая задача первого потока ждёт, пока не будут выполнены все остальные.
+            // Это возможно, только если второй поток заберёт оставшиеся задачи первого
+            constexpr size_t COUNT = 100;
+            WorkStealingPool pool(2);
+            atomic<size_t> finished{0};
+            pool.ForEach(COUNT, [&finished](size_t index, [[maybe_unused]] size_t worker) {
+                if (index == 0) {
+                    const auto deadline = chrono::steady_clock::now() + 10s;
+                    while (finished.load() < COUNT - 1 && chrono::steady_clock::now() < deadline) {
+                        this_thread::sleep_for(1ms);
+                    }
+                }
+                finished.fetch_add(1);
+            });
+            ASSERT_EQUAL(finished.load(), COUNT);
+            ASSERT(pool.GetStolenCount() >= COUNT / 2 - 1);
+        }
+
+        void TestPoolRethrowsErrors() {
+            WorkStealingPool pool(3);
+            atomic<size_t> finished{0};
+            ASSERT_THROWS(pool.ForEach(50, [&finished](size_t index, [[maybe_unused]] size_t worker) {
+                finished.fetch_add(1);
+                if (index == 7) {
+                    throw std::runtime_error("task failed"s);
+                }
+            }), std::runtime_error);
+            // Ошибка одной задачи не отменяет остальные, а пул остаётся работоспособным
+            ASSERT_EQUAL(finished.load(), 50U);
+            pool.ForEach(10, [&finished](size_t, size_t) {
+                finished.fetch_add(1);
+            });
+            ASSERT_EQUAL(finished.load(), 60U);
+        }
+
+        void TestBatchKeepsInputOrder() {
+            ScriptDirectory directory;
+            vector<string> paths;
+            string expected;
+            for (int i = 0; i < 40; ++i) {
+                ostringstream script;
+                // Сценарии разной длины выполняются разное время
+                script << "class Counter:\n"
+                          "  def count(n):\n"
+                          "    if n == 0:\n"
+                          "      return 0\n"
+                          "    return 1 + self.count(n - 1)\n"
+                          "\n"
+                          "c = Counter()\n"
+                          "print 'script', " << i << ", c.count(" << (i % 7) * 50 << ")\n";
+                paths.push_back(directory.Add("script"s + to_string(i) + ".my"s, script.str()));
+                expected += "script "s + to_string(i) + ' ' + to_string((i % 7) * 50) + '\n';
+            }
+
+            for (size_t thread_count : {1U, 4U}) {
+                const auto results = RunBatch(paths, {thread_count, {}});
+                ASSERT_EQUAL(results.size(), paths.size());
+                ostringstream output;
+                WriteOutputs(results, output);
+                ASSERT_EQUAL(output.str(), expected);
+                for (size_t i = 0; i < results.size(); ++i) {
+                    ASSERT_EQUAL(results[i].path, paths[i]);
+                    ASSERT(results[i].Succeeded());
+                    ASSERT(results[i].worker < thread_count);
+                    ASSERT(results[i].parse_time.count() > 0);
+                    ASSERT(results[i].run_time.count() > 0);
+                }
+            }
+        }
+
+        void TestBatchIsolatesErrors() {
+            ScriptDirectory directory;
+            const vector<string> paths = {
+                    directory.Add("ok.my"s, "x = 1\nprint x\n"s),
+                    directory.Add("runtime_error.my"s, "print 'before'\nprint unknown\nprint 'after'\n"s),
+                    directory.Add("parse_error.my"s, "print Unknown()\n"s),
+                    (fs::path(directory.Add("unused.my"s, ""s)).parent_path() / "missing.my"s).string(),
+                    // Переменные сценариев не видны друг другу
+                    directory.Add("isolated.my"s, "print x\n"s),
+                    directory.Add("division.my"s, "print 'before'\nprint 1 / 0\n"s),
+                    directory.Add("overflow.my"s, "x = 0 - 2147483647 - 1\nprint 'before'\nprint x / (0 - 1)\n"s),
+            };
+            const auto results = RunBatch(paths, {2, {}});
+
+            ASSERT(results[0].Succeeded());
+            ASSERT_EQUAL(results[0].output, "1\n"s);
+            ASSERT(!results[1].Succeeded());
+            ASSERT_EQUAL(results[1].output, "before\n"s);
+            ASSERT(!results[2].Succeeded());
+            ASSERT_EQUAL(results[2].run_time.count(), 0);
+            ASSERT(!results[3].Succeeded());
+            ASSERT(!results[4].Succeeded());
+            // Деление на ноль завершает только свой сценарий
+            ASSERT(!results[5].Succeeded());
+            ASSERT_EQUAL(results[5].output, "before\n"s);
+            ASSERT(!results[6].Succeeded());
+            ASSERT_EQUAL(results[6].output, "before\n"s);
+
+            ostringstream report;
+            WriteTimingReport(results, report);
+            const string text = report.str();
+            ASSERT(text.find(paths[0] + ": parse "s) == 0);
+            ASSERT(text.find(paths[1] + ": parse "s) != string::npos);
+            ASSERT(text.find(", error: "s) != string::npos);
+            ASSERT(text.find("total: 7 scripts, 6 failed, parse "s) != string::npos);
+        }
+    }  // namespace
+
+    void RunBatchTests(TestRunner &tr) {
+        RUN_TEST(tr, batch::TestPoolRunsEveryTaskOnce);
+        RUN_TEST(tr, batch::TestPoolStealsWork);
+        RUN_TEST(tr, batch::TestPoolRethrowsErrors);
+        RUN_TEST(tr, batch::TestBatchKeepsInputOrder);
+        RUN_TEST(tr, batch::TestBatchIsolatesErrors);
+    }
+
+}  // namespace batch
@@ -1,6 +1,10 @@
 #include "../lexer.h"
+#include "alloc_counter.h"
 #include "test_runner_p.h"
 
+#include <cstdio>
+#include <fstream>
+#include <optional>
 #include <sstream>
 #include <string>
 
@@ -362,6 +366,252 @@ abc#
             ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"two \\\\\" words"s}));
             ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{""s}));
         }
+
+        void TestBufferTokensReferenceSource() {
+            const string source = "x = 'plain'\ny = 'esc\\'aped'\n"s;
+            Lexer lexer(string_view{source});
+            auto in_source = [&source](string_view value) {
+                return value.data() >= source.data() && value.data() + value.size() <= source.data() + source.size();
+            };
+
+            // Идентификаторы интернируются, одинаковые имена разделяют один символ
+            ASSERT(lexer.CurrentToken().As<token_type::Id>().value == runtime::Symbol("x"sv));
+            lexer.NextToken();
+            ASSERT(in_source(lexer.NextToken().As<token_type::String>().value));
+            ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::String{"plain"s}));
+            lexer.NextToken();
+            ASSERT_EQUAL(&lexer.NextToken().As<token_type::Id>().value.GetText(), &runtime::Symbol("y"s).GetText());
+            lexer.NextToken();
+            // Строка с escape-последовательностью материализуется отдельно от исходного текста
+            ASSERT(!in_source(lexer.NextToken().As<token_type::String>().value));
+            ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::String{"esc'aped"s}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+        }
+
+        void TestTokenOffsets() {
+            const string source = "if x:\n  y = 1\n\nz = 2\n"s;
+            Lexer lexer(string_view{source});
+            ASSERT_EQUAL(lexer.GetSource(), string_view{source});
+            // Смещение токена - позиция, с которой началось его чтение, включая пропущенные пробелы
+            ASSERT_EQUAL(lexer.GetTokenOffset(), 0U);
+            ASSERT_EQUAL(lexer.GetTokenOffset(1), 2U);
+            ASSERT_THROWS(static_cast<void>(lexer.GetTokenOffset(Lexer::DEFAULT_LOOKAHEAD + 1)), std::out_of_range);
+
+            while (!lexer.CurrentToken().Is<token_type::Indent>()) {
+                lexer.NextToken();
+            }
+            const size_t begin = lexer.GetTokenOffset();
+            while (!lexer.CurrentToken().Is<token_type::Dedent>()) {
+                lexer.NextToken();
+            }
+            ASSERT_EQUAL(source.substr(begin, lexer.GetTokenOffset() - begin), "  y = 1\n"s);
+        }
+
+        void TestKeywordTable() {
+            for (const auto &keyword : KEYWORDS) {
+                const string text(keyword.text);
+                Lexer lexer(string_view{text});
+                ASSERT_EQUAL(lexer.CurrentToken(), keyword.token);
+
+                // Слово с теми же первым и последним символами и длиной попадает в ту же ячейку таблицы,
+                // но остаётся идентификатором
+                string id = text;
+                if (id.size() > 2) {
+                    id[1] = 'x';
+                } else {
+                    id += id.back();
+                }
+                Lexer id_lexer(string_view{id});
+                ASSERT_EQUAL(id_lexer.CurrentToken(), Token(token_type::Id{id}));
+            }
+            // Байты вне ASCII не являются буквами независимо от локали
+            Lexer lexer("\xE9t\xE9"sv);
+            ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Char{'\xE9'}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"t"s}));
+        }
+
+        void TestLongRuns() {
+            // Длины серий пересекают границы блоков, которые сканер проверяет целиком
+            for (size_t length = 1; length <= 100; ++length) {
+                string id(length, 'a');
+                id.back() = 'Z';
+                const string spaces(length, ' ');
+                string text(length, 'x');
+                text.back() = '\xE9';
+                const string source = "x" + spaces + id + "#" + spaces + "\n"
+                                      + "'" + text + "\\n" + text + "'\n"
+                                      + "\"" + text + "'\"";
+                Lexer lexer(string_view{source});
+
+                ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{id}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{text + "\n" + text}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{text + "'"}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+
+                const string unterminated = "'" + text + "\n'";
+                ASSERT_THROWS(Lexer(string_view{unterminated}), LexerError);
+            }
+        }
+
+        void TestLookahead() {
+            const string source = "class A:\n  def f():\n    return 1\n"s;
+            Lexer lexer(string_view{source}, 3);
+            ASSERT_EQUAL(lexer.GetLookahead(), 3U);
+
+            ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Class{}));
+            ASSERT_EQUAL(lexer.PeekToken(), Token(token_type::Id{"A"s}));
+            ASSERT_EQUAL(lexer.PeekToken(3), Token(token_type::Newline{}));
+            ASSERT_THROWS(lexer.PeekToken(4), std::out_of_range);
+
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"A"s}));
+            ASSERT_EQUAL(lexer.PeekToken(0), Token(token_type::Id{"A"s}));
+            ASSERT_EQUAL(lexer.PeekToken(3), Token(token_type::Indent{}));
+
+            // Окно за концом файла заполняется лексемами Eof
+            while (!lexer.CurrentToken().Is<token_type::Eof>()) {
+                lexer.NextToken();
+            }
+            ASSERT_EQUAL(lexer.PeekToken(3), Token(token_type::Eof{}));
+
+            Lexer no_lookahead(string_view{source}, 0);
+            ASSERT_EQUAL(no_lookahead.PeekToken(0), Token(token_type::Class{}));
+            ASSERT_THROWS(no_lookahead.PeekToken(1), std::out_of_range);
+        }
+
+        void TestLexerMemoryDoesNotGrow() {
+            string source;
+            for (int i = 0; i < 10000; ++i) {
+                source += "x = 'it\\'s' + y # comment\n"s;
+            }
+            Lexer lexer(string_view{source}, 2);
+
+            const size_t allocations_before = GetAllocationCount();
+            size_t token_count = 1;
+            for (; !lexer.CurrentToken().Is<token_type::Eof>(); lexer.NextToken()) {
+                ++token_count;
+            }
+            const size_t allocations = GetAllocationCount() - allocations_before;
+
+            ASSERT_EQUAL(token_count, 10000U * 6 + 1);
+            // Буферы раскрытых строк выделяются не более одного раза на ячейку окна
+            ASSERT(allocations <= lexer.GetLookahead() + 1);
+        }
+
+        // Программа длиннее очереди фонового потока, со строками с escape-последовательностями
+        string MakePipelineSource() {
+            string source;
+            for (int i = 0; i < 500; ++i) {
+                source += "class A"s + to_string(i) + ":\n  def f(x):\n    return 'it\\'s ' + \"plain\" + str(x)\n\n"s;
+            }
+            return source;
+        }
+
+        void TestPipelinedMatchesSequential() {
+            const string source = MakePipelineSource();
+            Lexer sequential(string_view{source}, 2);
+            Lexer pipelined(string_view{source}, 2, LexerMode::PIPELINED);
+
+            size_t token_count = 1;
+            while (true) {
+                ASSERT_EQUAL(pipelined.CurrentToken(), sequential.CurrentToken());
+                ASSERT_EQUAL(pipelined.PeekToken(2), sequential.PeekToken(2));
+                if (sequential.CurrentToken().Is<token_type::Eof>()) {
+                    break;
+                }
+                sequential.NextToken();
+                pipelined.NextToken();
+                ++token_count;
+            }
+            ASSERT(token_count > 10000U);
+
+            istringstream input(source);
+            Lexer from_stream(input, Lexer::DEFAULT_LOOKAHEAD, LexerMode::PIPELINED);
+            ASSERT_EQUAL(from_stream.CurrentToken(), Token(token_type::Class{}));
+            ASSERT_EQUAL(from_stream.NextToken(), Token(token_type::Id{"A0"s}));
+        }
+
+        void TestPipelinedErrorPosition() {
+            const string_view source = "x = 1\ny = 'it\\q'\nz = 2\n"sv;
+            for (LexerMode mode : {LexerMode::SEQUENTIAL, LexerMode::PIPELINED}) {
+                Lexer lexer(source, 0, mode);
+                // Лексемы до ошибочной строковой константы выдаются без ошибок
+                for (int i = 0; i < 5; ++i) {
+                    lexer.NextToken();
+                }
+                ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Char{'='}));
+                ASSERT_THROWS(lexer.NextToken(), LexerError);
+            }
+            // Ошибка при заполнении окна выбрасывается из конструктора
+            ASSERT_THROWS(Lexer(" x\n"sv, 0, LexerMode::PIPELINED), LexerError);
+            // Повторное чтение после ошибки снова выбрасывает её
+            Lexer lexer("x\n   y\n"sv, 0, LexerMode::PIPELINED);
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+            ASSERT_THROWS(lexer.NextToken(), LexerError);
+            ASSERT_THROWS(lexer.NextToken(), LexerError);
+
+            // Смещение ошибки не зависит от режима и размера окна и совпадает со смещением ошибочной лексемы
+            auto get_error_offset = [](string_view text, size_t lookahead, LexerMode mode) -> optional<size_t> {
+                try {
+                    Lexer lexer(text, lookahead, mode);
+                    while (!lexer.CurrentToken().Is<token_type::Eof>()) {
+                        lexer.NextToken();
+                    }
+                } catch (const LexerError &e) {
+                    return e.offset;
+                }
+                return nullopt;
+            };
+            for (LexerMode mode : {LexerMode::SEQUENTIAL, LexerMode::PIPELINED}) {
+                for (size_t lookahead : {size_t{0}, Lexer::DEFAULT_LOOKAHEAD, size_t{4}}) {
+                    const auto offset = get_error_offset("x = 1\ny = 2\nz = 'abc\n"sv, lookahead, mode);
+                    ASSERT(offset.has_value());
+                    ASSERT_EQUAL(*offset, 15u);
+                }
+            }
+        }
+
+        void TestPipelinedStopsWithLexer() {
+            const string source = MakePipelineSource();
+            // Парсер может прекратить чтение задолго до конца файла, фоновый поток должен завершиться
+            for (int i = 0; i < 10; ++i) {
+                Lexer lexer(string_view{source}, 1, LexerMode::PIPELINED);
+                lexer.NextToken();
+            }
+        }
+
+        void TestMappedFile() {
+            const string path = "mython_lexer_test.my"s;
+            {
+                ofstream file(path, ios::binary);
+                file << "class A:\n  def f():\n    return 'a'\n"s;
+            }
+            {
+                MappedFile file(path);
+                Lexer lexer(file.GetText());
+                ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Class{}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"A"s}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
+                ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Def{}));
+            }
+            {
+                ofstream file(path, ios::binary | ios::trunc);
+            }
+            {
+                MappedFile file(path);
+                ASSERT(file.GetText().empty());
+                Lexer lexer(file.GetText());
+                ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Eof{}));
+            }
+            std::remove(path.c_str());
+            ASSERT_THROWS(MappedFile("mython_missing_file.my"s), std::runtime_error);
+        }
     }  // namespace
 
     void RunOpenLexerTests(TestRunner& tr) {
@@ -380,6 +630,16 @@ abc#
         RUN_TEST(tr, parse::TestCommentsAreIgnored);
 
         RUN_TEST(tr, parse::MyTestStrings);
+        RUN_TEST(tr, parse::TestBufferTokensReferenceSource);
+        RUN_TEST(tr, parse::TestMappedFile);
+        RUN_TEST(tr, parse::TestTokenOffsets);
+        RUN_TEST(tr, parse::TestKeywordTable);
+        RUN_TEST(tr, parse::TestLongRuns);
+        RUN_TEST(tr, parse::TestLookahead);
+        RUN_TEST(tr, parse::TestLexerMemoryDoesNotGrow);
+        RUN_TEST(tr, parse::TestPipelinedMatchesSequential);
+        RUN_TEST(tr, parse::TestPipelinedErrorPosition);
+        RUN_TEST(tr, parse::TestPipelinedStopsWithLexer);
     }
 
 }  // namespace parse
@@ -0,0 +1,111 @@
+#include "../lexer.h"
+#include "../optimizer.h"
+#include "../parse.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace ast {
+
+    namespace {
+        struct OptimizedProgram {
+            unique_ptr<Statement> tree;
+            OptimizerStats stats;
+        };
+
+        OptimizedProgram Optimize(const string &program) {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            OptimizedProgram result;
+            result.tree = ParseProgram(lexer, &result.stats);
+            return result;
+        }
+
+        string Run(Statement &tree) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            tree.Execute(closure, context);
+            return context.output.str();
+        }
+
+        void TestFoldsConstants() {
+            auto program = Optimize("x = 2 + 3 * 4\nprint x, 'a' + 'b', -5, 7 / 2 - 1\n"s);
+            ASSERT_EQUAL(program.stats.folded_constants, 5U);
+            ASSERT_EQUAL(program.stats.folded_negations, 1U);
+            ASSERT_EQUAL(program.stats.simplified_identities, 0U);
+
+            const auto &statements = static_cast<const Compound &>(*program.tree).GetStatements();
+            const auto &assignment = static_cast<const Assignment &>(*statements.front());
+            const auto *value = dynamic_cast<const NumericConst *>(&assignment.GetRvalue());
+            ASSERT(value != nullptr);
+            ASSERT_EQUAL(value->GetValue().GetValue(), 14);
+
+            ASSERT_EQUAL(Run(*program.tree), "14 ab -5 2\n"s);
+        }
+
+        void TestSimplifiesNumericIdentities() {
+            auto program = Optimize(R"(
+class A:
+  def f(x):
+    return (x - 1) * 1 + 0
+
+  def g(x):
+    return 0 + x / 1
+
+a = A()
+print a.f(5), a.g(8)
+)"s);
+            // x / 1 не упрощается: тип параметра x неизвестен, а 0 + (x / 1) - упрощается, так как деление даёт число
+            ASSERT_EQUAL(program.stats.simplified_identities, 3U);
+            ASSERT_EQUAL(Run(*program.tree), "4 8\n"s);
+        }
+
+        void TestKeepsObservableBehavior() {
+            // Тип переменной неизвестен: x * 1 для строки должно по-прежнему выбрасывать исключение,
+            // а x + 0 для объекта - вызывать __add__
+            auto program = Optimize(R"(
+class Counter:
+  def __add__(other):
+    return 'called'
+
+s = 'text'
+c = Counter()
+print c + 0
+x = s * 1
+)"s);
+            ASSERT_EQUAL(program.stats.GetTotal(), 0U);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            ASSERT_THROWS(program.tree->Execute(closure, context), std::runtime_error);
+            ASSERT_EQUAL(context.output.str(), "called\n"s);
+
+            // Ошибки и переполнения остаются на время выполнения
+            ASSERT_EQUAL(Optimize("x = 1 / 0\ny = 2147483647 + 1\nz = 'a' + 1\n"s).stats.GetTotal(), 0U);
+        }
+
+        void TestStatsReport() {
+            OptimizerStats stats;
+            stats.folded_constants = 3;
+            OptimizerStats other;
+            other.folded_negations = 2;
+            other.simplified_identities = 1;
+            stats += other;
+            ASSERT_EQUAL(stats.GetTotal(), 6U);
+
+            ostringstream report;
+            report << stats;
+            ASSERT_EQUAL(report.str(), "folded constants: 3\nfolded negations: 2\nsimplified identities: 1\n"s);
+        }
+
+    }  // namespace
+
+    void RunOptimizerTests(TestRunner &tr) {
+        RUN_TEST(tr, ast::TestFoldsConstants);
+        RUN_TEST(tr, ast::TestSimplifiesNumericIdentities);
+        RUN_TEST(tr, ast::TestKeepsObservableBehavior);
+        RUN_TEST(tr, ast::TestStatsReport);
+    }
+
+}  // namespace ast
@@ -0,0 +1,204 @@
+#include "../lexer.h"
+#include "../output.h"
+#include "../parse.h"
+#include "../runtime.h"
+#include "../vm.h"
+#include "test_runner_p.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <limits>
+#include <unistd.h>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        // Приёмник, запоминающий каждый вызов WriteOut
+        class RecordingSink : public OutputSink {
+        public:
+            using OutputSink::OutputSink;
+
+            ~RecordingSink() override {
+                Flush();
+            }
+
+            vector<pair<string, string>> calls;
+            string output;
+
+        protected:
+            void WriteOut(string_view head, string_view tail) override {
+                calls.emplace_back(head, tail);
+                output.append(head).append(tail);
+            }
+        };
+
+        string ReadFile(const string &path) {
+            ifstream file(path, ios::binary);
+            return {istreambuf_iterator<char>(file), istreambuf_iterator<char>()};
+        }
+
+        void TestSinkBatchesWrites() {
+            RecordingSink sink(64);
+            for (int i = 0; i < 10; ++i) {
+                sink.Write("ab"sv);
+                sink.Write(' ');
+            }
+            ASSERT(sink.calls.empty());
+            sink.Flush();
+            ASSERT_EQUAL(sink.calls.size(), 1U);
+            ASSERT_EQUAL(sink.output, "ab ab ab ab ab ab ab ab ab ab "s);
+
+            // Заполненный буфер передаётся целиком
+            sink.output.clear();
+            sink.calls.clear();
+            for (int i = 0; i < 100; ++i) {
+                sink.Write('x');
+            }
+            ASSERT_EQUAL(sink.calls.size(), 1U);
+            ASSERT_EQUAL(sink.calls[0].first.size(), 64U);
+            sink.Flush();
+            ASSERT_EQUAL(sink.output, string(100, 'x'));
+        }
+
+        void TestSinkPassesLargeTextThrough() {
+            RecordingSink sink(64);
+            sink.Write("head"sv);
+            const string large(1000, 'L');
+            sink.Write(large);
+            // Крупный фрагмент записывается вместе с буфером одним вызовом
+            ASSERT_EQUAL(sink.calls.size(), 1U);
+            ASSERT_EQUAL(sink.calls[0].first, "head"s);
+            ASSERT_EQUAL(sink.calls[0].second, large);
+        }
+
+        void TestSinkFormatsNumbers() {
+            RecordingSink sink(16);
+            for (int value : {0, 7, -7, 123456789, numeric_limits<int>::max(), numeric_limits<int>::min()}) {
+                sink.WriteNumber(value);
+                sink.Write(' ');
+            }
+            sink.Flush();
+            ASSERT_EQUAL(sink.output, "0 7 -7 123456789 2147483647 -2147483648 "s);
+        }
+
+        void TestSinkStreamKeepsOrder() {
+            RecordingSink sink;
+            sink.Write("a"sv);
+            sink.GetStream() << 'b' << 42 << "cd"s;
+            sink.WriteNumber(5);
+            sink.Flush();
+            ASSERT_EQUAL(sink.output, "ab42cd5"s);
+        }
+
+        // Объект, который умеет печатать себя только в поток
+        class StreamOnly : public Object {
+        public:
+            void Print(ostream &os, [[maybe_unused]] Context &context) override {
+                os << "stream-only"sv;
+            }
+        };
+
+        void TestPrintThroughSink() {
+            const string program = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ')'
+
+class Empty:
+  def __str__():
+    return None
+
+p = Point(-3, 40)
+print p, 'text', 12, True, False, None, Point, Empty()
+print
+print str(p) + '!'
+)"s;
+            auto run = [&program](Context &context, bool bytecode) {
+                parse::Lexer lexer(string_view{program});
+                auto tree = ParseProgram(lexer);
+                Closure closure;
+                if (bytecode) {
+                    vm::VirtualMachine{}.Run(*tree, closure, context);
+                } else {
+                    tree->Execute(closure, context);
+                }
+            };
+            const string expected = "(-3, 40) text 12 True False None Class Point None\n\n(-3, 40)!\n"s;
+
+            for (bool bytecode : {false, true}) {
+                RecordingSink sink;
+                SinkContext context{sink};
+                run(context, bytecode);
+                sink.Flush();
+                ASSERT_EQUAL(sink.output, expected);
+                ASSERT_EQUAL(sink.calls.size(), 1U);
+            }
+
+            RecordingSink sink;
+            SinkContext context{sink};
+            StreamOnly object;
+            sink.Write('<');
+            object.PrintTo(sink, context);
+            sink.Write('>');
+            sink.Flush();
+            ASSERT_EQUAL(sink.output, "<stream-only>"s);
+        }
+
+        void TestFileSinks() {
+            const string path = "mython_output_test.txt"s;
+            string expected;
+            for (int i = 0; i < 100000; ++i) {
+                expected += "line "s + to_string(i) + '\n';
+            }
+
+            {
+                const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                ASSERT(fd != -1);
+                {
+                    FileSink sink(fd, 4096);
+                    for (int i = 0; i < 100000; ++i) {
+                        sink.Write("line "sv);
+                        sink.WriteNumber(i);
+                        sink.Write('\n');
+                    }
+                }
+                close(fd);
+                ASSERT_EQUAL(ReadFile(path), expected);
+            }
+            {
+                MappedFileSink sink(path);
+                sink.Write(expected.substr(0, 10));
+                sink.Write(expected.substr(10));
+                sink.Close();
+                ASSERT_EQUAL(ReadFile(path), expected);
+            }
+            {
+                // Пустой вывод даёт пустой файл
+                MappedFileSink sink(path);
+            }
+            ASSERT(ReadFile(path).empty());
+            std::remove(path.c_str());
+
+            FileSink bad_sink(-1);
+            bad_sink.Write("x"sv);
+            ASSERT_THROWS(bad_sink.Flush(), std::runtime_error);
+        }
+    }  // namespace
+
+    void RunOutputTests(TestRunner &tr) {
+        RUN_TEST(tr, runtime::TestSinkBatchesWrites);
+        RUN_TEST(tr, runtime::TestSinkPassesLargeTextThrough);
+        RUN_TEST(tr, runtime::TestSinkFormatsNumbers);
+        RUN_TEST(tr, runtime::TestSinkStreamKeepsOrder);
+        RUN_TEST(tr, runtime::TestPrintThroughSink);
+        RUN_TEST(tr, runtime::TestFileSinks);
+    }
+
+}  // namespace runtime
@@ -1,8 +1,11 @@
+#include "../frozen_program.h"
 #include "../lexer.h"
 #include "../parse.h"
 #include "../statement.h"
 #include "test_runner_p.h"
 
+#include <thread>
+
 using namespace std;
 
 namespace parse {
@@ -245,6 +248,308 @@ print r, c, t1, t2
                      "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n"s);
     }
 
+    string RunProgram(const string& program, const ParseOptions& options) {
+        istringstream is(program);
+        parse::Lexer lexer(is);
+        auto tree = ParseProgram(lexer, options);
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        tree->Execute(closure, context);
+        return context.output.str();
+    }
+
+    void TestLazyMethodBodies() {
+        const string program = R"(
+class Counter:
+  def __init__(start):
+    self.value = start
+
+  def add(n):
+    # комментарий в теле метода
+    if n > 0:
+      total = self.value + n
+# комментарий без отступа
+
+      self.value = total
+    else:
+      self.value = self.value - 1
+    return self
+
+  def __str__():
+    return 'Counter(' + str(self.value) + ')'
+
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+c = Counter(5)
+f = Fib()
+c.add(3)
+c.add(0)
+print c, f.calc(10)
+)"s;
+
+        const string eager = RunProgram(program, {});
+        ASSERT_EQUAL(eager, "Counter(7) 55\n"s);
+        ASSERT_EQUAL(RunProgram(program, {true}), eager);
+    }
+
+    void TestLazyMethodBodyErrors() {
+        const string program = R"(
+class A:
+  def ok():
+    return 1
+
+  def broken():
+    return Unknown()
+
+a = A()
+print a.ok()
+)"s;
+
+        ASSERT_THROWS(RunProgram(program, {}), ParseError);
+        // Тело, которое не вызывается, не разбирается
+        ASSERT_EQUAL(RunProgram(program, {true}), "1\n"s);
+        // Ошибка разбора выбрасывается при каждом вызове метода
+        ASSERT_THROWS(RunProgram(program + "print a.broken()\n"s, {true}), ParseError);
+    }
+
+    // Возвращает смещение ошибки типа Error, выброшенной func
+    template <typename Error, typename Func>
+    optional<size_t> GetErrorOffset(Func func) {
+        try {
+            func();
+        } catch (const Error& e) {
+            ASSERT(e.offset.has_value());
+            return e.offset;
+        }
+        ASSERT(false);
+        return nullopt;
+    }
+
+    void TestLazyMethodBodyErrorOffsets() {
+        // Тело метода класса, объявленного внутри if, имеет отступ в три уровня
+        const string program = R"(
+if True:
+  class A:
+    def ok():
+      return 1
+
+    def broken():
+  # комментарий с меньшим отступом
+      x = 1
+      return Unknown()
+
+    def unclosed():
+      return (1
+
+  a = A()
+  print a.ok()
+)"s;
+        const size_t broken_line = program.find("      return Unknown()"s);
+        const size_t unclosed_line = program.find("      return (1"s);
+
+        const auto eager_broken = GetErrorOffset<ParseError>([&program] {
+            RunProgram(program, {});
+        });
+        const auto lazy_broken = GetErrorOffset<ParseError>([&program] {
+            RunProgram(program + "a.broken()\n"s, {true});
+        });
+        ASSERT_EQUAL(*lazy_broken, *eager_broken);
+        ASSERT(*lazy_broken > broken_line && *lazy_broken <= program.find('\n', broken_line));
+
+        const string without_broken = program.substr(0, program.find("    def broken"s)) +
+                                      program.substr(program.find("    def unclosed"s));
+        const size_t shift = program.size() - without_broken.size();
+        const auto eager_unclosed = GetErrorOffset<parse::LexerError>([&without_broken] {
+            RunProgram(without_broken, {});
+        });
+        const auto lazy_unclosed = GetErrorOffset<parse::LexerError>([&program] {
+            RunProgram(program + "a.unclosed()\n"s, {true});
+        });
+        ASSERT_EQUAL(*lazy_unclosed, *eager_unclosed + shift);
+        ASSERT(*lazy_unclosed > unclosed_line && *lazy_unclosed <= program.find('\n', unclosed_line));
+    }
+
+    void TestLazyMethodSeesPrecedingClasses() {
+        // В теле метода видны только классы, объявленные раньше метода, как и при обычном разборе
+        const string program = R"(
+class A:
+  def make():
+    return B()
+
+class B:
+  def __str__():
+    return 'B'
+
+class C:
+  def make():
+    return B()
+
+c = C()
+print c.make()
+)"s;
+
+        ASSERT_THROWS(RunProgram(program, {}), ParseError);
+        ASSERT_EQUAL(RunProgram(program, {true}), "B\n"s);
+        ASSERT_THROWS(RunProgram(program + "a = A()\nprint a.make()\n"s, {true}), ParseError);
+    }
+
+    void TestReturnOutsideMethod() {
+        // return допустим только в теле метода
+        ASSERT_THROWS(ParseProgramFromString("print 1\nreturn 2\nprint 3\n"s), ParseError);
+        ASSERT_THROWS(ParseProgramFromString("if True:\n  return 2\n"s), ParseError);
+
+        const string program = R"(
+class A:
+  def f():
+    return 1
+
+a = A()
+print a.f()
+)"s;
+        ASSERT_EQUAL(RunProgram(program, {}), "1\n"s);
+        ASSERT_EQUAL(RunProgram(program, {true}), "1\n"s);
+        // После тела метода return снова запрещён
+        ASSERT_THROWS(RunProgram(program + "return 2\n"s, {}), ParseError);
+        ASSERT_THROWS(RunProgram(program + "return 2\n"s, {true}), ParseError);
+    }
+
+    void TestStreamingExecution() {
+        const string program = R"(
+x = 1
+if x > 0:
+  class A:
+    def __str__():
+      return 'A'
+print x, A()
+A = 'shadowed'
+y = A()
+print y, A
+)"s;
+        runtime::DummyContext context;
+        runtime::Closure globals;
+        parse::Lexer lexer(string_view{program});
+        ExecuteStreaming(lexer, globals, context);
+
+        // Классы, объявленные в удалённых инструкциях, остаются доступны следующим инструкциям
+        ASSERT_EQUAL(context.output.str(), RunProgram(program, {}));
+        ASSERT_EQUAL(context.output.str(), "1 A\nA shadowed\n"s);
+        ASSERT_EQUAL(globals.at("x"s).TryAs<runtime::Number>()->GetValue(), 1);
+    }
+
+    void TestStreamingOutputPrecedesParsing() {
+        // Инструкции выполняются до того, как разобрана вся программа
+        const string program = "print 'first'\nx = 2\nprint x\nprint Unknown()\nprint 'never'\n"s;
+        runtime::DummyContext context;
+        runtime::Closure globals;
+        parse::Lexer lexer(string_view{program});
+        ASSERT_THROWS(ExecuteStreaming(lexer, globals, context), ParseError);
+        ASSERT_EQUAL(context.output.str(), "first\n2\n"s);
+    }
+
+    void TestFrozenProgramConcurrentRuns() {
+        const string program = R"(
+class Shape:
+  def __init__(name):
+    self.name = name
+
+  def area():
+    return 0
+
+  def __eq__(other):
+    return self.area() == other.area()
+
+  def __lt__(other):
+    return self.area() < other.area()
+
+  def __str__():
+    return self.name + '=' + str(self.area())
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.name = 'rect'
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+class Square(Rect):
+  def __init__(a):
+    self.name = 'square'
+    self.w = a
+    self.h = a
+
+class Report:
+  def __init__():
+    self.text = ''
+    self.count = 0
+
+  def add(shape):
+    self.text = self.text + str(shape) + ';'
+    self.count = self.count + 1
+
+r = Report()
+r.add(Shape('dot'))
+r.add(Rect(2, 3))
+r.add(Square(4))
+r.add(Rect(8, 2))
+r.add(Square(1))
+print r.text, r.count
+print Rect(2, 8) == Square(4), Square(2) < Rect(1, 5), Rect(3, 3) > Square(2)
+s = Square(3)
+q = Rect(2, 5)
+total = s.area() + q.area()
+)"s;
+        for (bool lazy : {false, true}) {
+            parse::Lexer lexer(string_view{program});
+            const auto frozen = ParseFrozenProgram(lexer, {lazy});
+            ASSERT_EQUAL(frozen->GetClassCount(), 4U);
+
+            runtime::DummyContext single_context;
+            const runtime::Closure globals = frozen->Run(single_context);
+            const string expected = single_context.output.str();
+            ASSERT_EQUAL(expected, "dot=0;rect=6;square=16;rect=16;square=1; 5\nTrue True True\n"s);
+            ASSERT_EQUAL(globals.at("total"s).TryAs<runtime::Number>()->GetValue(), 19);
+
+            // Каждое выполнение получает собственные глобальные переменные и контекст
+            constexpr size_t THREAD_COUNT = 8;
+            constexpr size_t RUN_COUNT = 25;
+            vector<string> outputs(THREAD_COUNT);
+            vector<thread> threads;
+            for (size_t i = 0; i < THREAD_COUNT; ++i) {
+                threads.emplace_back([&frozen, &output = outputs[i]] {
+                    for (size_t run = 0; run < RUN_COUNT; ++run) {
+                        runtime::DummyContext context;
+                        frozen->Run(context);
+                        output += context.output.str();
+                    }
+                });
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+
+            string expected_output;
+            for (size_t run = 0; run < RUN_COUNT; ++run) {
+                expected_output += expected;
+            }
+            for (const auto& output : outputs) {
+                ASSERT_EQUAL(output, expected_output);
+            }
+        }
+    }
+
+    void TestFrozenProgramParsesLazyBodies() {
+        // Отложенные тела методов разбираются при заморозке программы, а не при первом вызове
+        const string program = "class A:\n  def never_called():\n    return Unknown()\n\nprint 1\n"s;
+        parse::Lexer lexer(string_view{program});
+        ASSERT_THROWS(ParseFrozenProgram(lexer, {true}), ParseError);
+    }
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -256,4 +561,13 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestRecursion2);
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
+    RUN_TEST(tr, parse::TestLazyMethodBodies);
+    RUN_TEST(tr, parse::TestLazyMethodBodyErrors);
+    RUN_TEST(tr, parse::TestLazyMethodBodyErrorOffsets);
+    RUN_TEST(tr, parse::TestLazyMethodSeesPrecedingClasses);
+    RUN_TEST(tr, parse::TestReturnOutsideMethod);
+    RUN_TEST(tr, parse::TestStreamingExecution);
+    RUN_TEST(tr, parse::TestStreamingOutputPrecedesParsing);
+    RUN_TEST(tr, parse::TestFrozenProgramConcurrentRuns);
+    RUN_TEST(tr, parse::TestFrozenProgramParsesLazyBodies);
 }
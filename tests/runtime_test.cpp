@@ -1,4 +1,5 @@
 #include "../runtime.h"
+#include "alloc_counter.h"
 #include "test_runner_p.h"
 
 #include <functional>
@@ -19,13 +20,13 @@ namespace runtime {
             }
 
             Logger(const Logger &rhs)
-                    : id_(rhs.id_)  //
+                    : Object(rhs), id_(rhs.id_)  //
             {
                 ++instance_count;
             }
 
             Logger(Logger &&rhs) noexcept
-                    : id_(rhs.id_)  //
+                    : Object(rhs), id_(rhs.id_)  //
             {
                 ++instance_count;
             }
@@ -249,6 +250,142 @@ namespace runtime {
             ASSERT(!oh.Get());
         }
 
+        void TestBorrowed() {
+            Logger logger(5);
+            const size_t allocations_before = GetAllocationCount();
+            auto borrowed = ObjectHolder::Share(logger);
+            auto copy = borrowed;
+            ObjectHolder moved = std::move(copy);
+            moved = borrowed;
+            const size_t allocations = GetAllocationCount() - allocations_before;
+            ASSERT_EQUAL(allocations, 0U);
+            ASSERT(moved.IsBorrowed());
+            ASSERT_EQUAL(moved.TryAs<Logger>(), &logger);
+
+            // Объект, не принадлежащий shared_ptr, остаётся заимствованным
+            moved.Retain();
+            ASSERT(moved.IsBorrowed());
+
+            Class cls{"Cls"s, {}, nullptr};
+            ClassInstance local_instance{cls};
+            auto local_self = ObjectHolder::Share(local_instance);
+            local_self.Retain();
+            ASSERT(local_self.IsBorrowed());
+
+            // Заимствованная ссылка на экземпляр в куче становится владеющей
+            auto owner = ObjectHolder::Own(ClassInstance{cls});
+            auto *instance = owner.TryAs<ClassInstance>();
+            auto self = ObjectHolder::Share(*instance);
+            self.Retain();
+            ASSERT(!self.IsBorrowed());
+            owner = ObjectHolder::None();
+            ASSERT_EQUAL(self.TryAs<ClassInstance>(), instance);
+            ASSERT_EQUAL(&self.TryAs<ClassInstance>()->GetClass(), &cls);
+
+            // Заимствованная строка копируется и переживает исходное значение
+            ObjectHolder retained;
+            {
+                String constant{"constant"s};
+                retained = ObjectHolder::Share(constant);
+                retained.Retain();
+            }
+            ASSERT(!retained.IsBorrowed());
+            ASSERT_EQUAL(retained.TryAs<String>()->GetValue(), "constant"s);
+        }
+
+        void TestInlineValues() {
+            const size_t allocations_before = GetAllocationCount();
+            auto num = ObjectHolder::Own(Number{42});
+            auto copy = num;
+            ObjectHolder moved = std::move(copy);
+            auto flag = ObjectHolder::Own(Bool{true});
+            flag = num;
+            flag = ObjectHolder::Own(Bool{false});
+            const size_t allocations_after = GetAllocationCount();
+
+            ASSERT_EQUAL(allocations_after, allocations_before);
+            ASSERT(num && moved && flag);
+            ASSERT(!copy);  // NOLINT
+            ASSERT_EQUAL(num.TryAs<Number>()->GetValue(), 42);
+            ASSERT_EQUAL(moved.TryAs<Number>()->GetValue(), 42);
+            ASSERT(moved.TryAs<Number>() != num.TryAs<Number>());
+            ASSERT_EQUAL(num.Get(), num.TryAs<Number>());
+            ASSERT_EQUAL(flag.TryAs<Bool>()->GetValue(), false);
+            ASSERT(!num.TryAs<Bool>() && !num.TryAs<String>() && !flag.TryAs<Number>());
+
+            // Число, размещённое вне ObjectHolder, по-прежнему доступно через TryAs
+            Number external{7};
+            ASSERT_EQUAL(ObjectHolder::Share(external).TryAs<Number>(), &external);
+
+            DummyContext context;
+            num->Print(context.output, context);
+            ASSERT_EQUAL(context.output.str(), "42"s);
+        }
+
+        void TestTypeTags() {
+            Class cls{"Test"s, {}, nullptr};
+            ClassInstance instance{cls};
+            Logger logger;
+            String str{"str"s};
+
+            ASSERT(ObjectHolder::None().GetType() == ObjectType::NONE);
+            ASSERT(ObjectHolder::Own(Number{1}).GetType() == ObjectType::NUMBER);
+            ASSERT(ObjectHolder::Own(Bool{false}).GetType() == ObjectType::BOOL);
+            ASSERT(ObjectHolder::Share(str).GetType() == ObjectType::STRING);
+            ASSERT(ObjectHolder::Share(cls).GetType() == ObjectType::CLASS);
+            ASSERT(ObjectHolder::Share(instance).GetType() == ObjectType::CLASS_INSTANCE);
+            ASSERT(ObjectHolder::Share(logger).GetType() == ObjectType::OTHER);
+
+            ASSERT_EQUAL(ObjectHolder::Share(instance).TryAs<ClassInstance>(), &instance);
+            ASSERT(ObjectHolder::Share(cls).TryAs<ClassInstance>() == nullptr);
+            ASSERT(ObjectHolder::Share(instance).TryAs<Class>() == nullptr);
+            ASSERT_EQUAL(ObjectHolder::Share(logger).TryAs<Logger>(), &logger);
+            ASSERT(ObjectHolder::Share(logger).TryAs<String>() == nullptr);
+            ASSERT(ObjectHolder::Share(str).TryAs<Logger>() == nullptr);
+        }
+
+        void TestClosure() {
+            auto layout = make_shared<ClosureLayout>();
+            ASSERT_EQUAL(layout->AddName("a"s), 0U);
+            ASSERT_EQUAL(layout->AddName("b"s), 1U);
+            ASSERT_EQUAL(layout->AddName("a"s), 0U);
+            ASSERT_EQUAL(layout->FindSlot("c"s), ClosureLayout::NO_SLOT);
+
+            Closure closure(layout);
+            ASSERT(closure.empty());
+            ASSERT(closure.GetSlot(0) == nullptr);
+            ASSERT(closure.find("a"s) == closure.end());
+
+            closure["a"s] = ObjectHolder::Own(Number{1});
+            closure.SetSlot(1, ObjectHolder::None());
+            closure["c"s] = ObjectHolder::Own(Number{3});
+            ASSERT_EQUAL(closure.size(), 3U);
+            ASSERT_EQUAL(closure.GetSlot(0)->TryAs<Number>()->GetValue(), 1);
+            // Переменная со значением None считается присвоенной
+            ASSERT_EQUAL(closure.count("b"s), 1U);
+            ASSERT(!closure.at("b"s));
+            ASSERT_EQUAL(closure.find("c"s)->second.TryAs<Number>()->GetValue(), 3);
+            ASSERT_THROWS(closure.at("d"s), out_of_range);
+
+            vector<string> names;
+            for (const auto &[name, value] : closure) {
+                names.push_back(name);
+            }
+            ASSERT_EQUAL(names, (vector<string>{"a"s, "b"s, "c"s}));
+
+            auto other_layout = make_shared<ClosureLayout>();
+            other_layout->AddName("c"s);
+            closure.SetLayout(other_layout);
+            ASSERT(closure.GetLayout() == other_layout.get());
+            ASSERT_EQUAL(closure.size(), 3U);
+            ASSERT_EQUAL(closure.GetSlot(0)->TryAs<Number>()->GetValue(), 3);
+            ASSERT_EQUAL(closure.at("a"s).TryAs<Number>()->GetValue(), 1);
+
+            closure.clear();
+            ASSERT(closure.empty());
+            ASSERT(closure.begin() == closure.end());
+        }
+
         void TestIsTrue() {
             {
                 ASSERT(!IsTrue(ObjectHolder::Own(Bool{false})));
@@ -506,6 +643,145 @@ namespace runtime {
             ASSERT_EQUAL(out.str(), "Class Test"s);
         }
 
+        void TestMethodTable() {
+            auto make_method = [](const string &name, vector<Symbol> params, int result) {
+                return Method{name, std::move(params), make_unique<TestMethodBody>([result](Closure &, Context &) {
+                    return ObjectHolder::Own(Number{result});
+                })};
+            };
+
+            vector<Method> base_methods;
+            base_methods.push_back(make_method("f"s, {"a"s, "b"s}, 1));
+            base_methods.push_back(make_method("g"s, {}, 2));
+            Class base{"Base"s, std::move(base_methods), nullptr};
+
+            vector<Method> middle_methods;
+            middle_methods.push_back(make_method("f"s, {"a"s}, 3));
+            Class middle{"Middle"s, std::move(middle_methods), &base};
+
+            Class derived{"Derived"s, {}, &middle};
+
+            // Метод потомка скрывает одноимённый метод родителя независимо от числа параметров
+            ASSERT(derived.FindMethod("f"sv, 2) == nullptr);
+            ASSERT_EQUAL(derived.FindMethod("f"sv, 1), middle.GetMethod("f"sv));
+            ASSERT_EQUAL(derived.FindMethod("g"sv, 0), base.GetMethod("g"sv));
+            ASSERT_EQUAL(base.FindMethod("f"sv, 2), base.GetMethod("f"sv));
+            ASSERT(derived.FindMethod("g"sv, 1) == nullptr);
+            ASSERT(derived.GetMethod("h"sv) == nullptr);
+
+            DummyContext context;
+            ClassInstance instance{derived};
+            ASSERT(instance.HasMethod("g"s, 0) && !instance.HasMethod("f"s, 2));
+            ASSERT_EQUAL(instance.Call("g"s, {}, context).TryAs<Number>()->GetValue(), 2);
+            const auto arg = ObjectHolder::None();
+            ASSERT_EQUAL(instance.Call(*derived.FindMethod("f"sv, 1), &arg, 1, context).TryAs<Number>()->GetValue(), 3);
+        }
+
+        void TestMethodCache() {
+            vector<unique_ptr<Class>> classes;
+            for (size_t i = 0; i <= MethodCache::CAPACITY; ++i) {
+                vector<Method> methods;
+                methods.push_back({"m"s, {}, nullptr});
+                classes.push_back(make_unique<Class>("C"s + to_string(i), std::move(methods), nullptr));
+            }
+
+            MethodCache cache;
+            for (const auto &cls : classes) {
+                ASSERT_EQUAL(cache.Find(*cls, "m"sv, 0), cls->GetMethod("m"sv));
+            }
+            ASSERT_EQUAL(cache.GetSize(), MethodCache::CAPACITY);
+            ASSERT_EQUAL(cache.GetStats().misses, MethodCache::CAPACITY + 1);
+
+            // Последние классы остались в кеше, самый первый вытеснен
+            ASSERT_EQUAL(cache.Find(*classes.back(), "m"sv, 0), classes.back()->GetMethod("m"sv));
+            ASSERT_EQUAL(cache.GetStats().hits, 1U);
+            ASSERT_EQUAL(cache.Find(*classes.front(), "m"sv, 0), classes.front()->GetMethod("m"sv));
+            ASSERT_EQUAL(cache.GetStats().misses, MethodCache::CAPACITY + 2);
+
+            // Отсутствие метода тоже кешируется
+            MethodCache missing;
+            ASSERT(missing.Find(*classes.front(), "m"sv, 1) == nullptr);
+            ASSERT(missing.Find(*classes.front(), "m"sv, 1) == nullptr);
+            ASSERT_EQUAL(missing.GetStats().hits, 1U);
+
+            // Классы различаются идентификаторами, даже если один создан на месте другого
+            const auto old_id = classes.front()->GetId();
+            classes.front() = make_unique<Class>("New"s, vector<Method>{}, nullptr);
+            ASSERT(classes.front()->GetId() != old_id);
+            ASSERT(cache.Find(*classes.front(), "m"sv, 0) == nullptr);
+
+            cache.Clear();
+            ASSERT_EQUAL(cache.GetSize(), 0U);
+            ASSERT_EQUAL(cache.GetStats().hits, 0U);
+        }
+
+        void TestFieldShapes() {
+            Class cls{"Point"s, {}, nullptr};
+            ClassInstance a{cls};
+            ClassInstance b{cls};
+            ClassInstance c{cls};
+            a.Fields()["x"s] = ObjectHolder::Own(Number{1});
+            a.Fields()["y"s] = ObjectHolder::Own(Number{2});
+            b.Fields()["x"s] = ObjectHolder::Own(Number{3});
+            b.Fields()["y"s] = ObjectHolder::Own(Number{4});
+            c.Fields()["y"s] = ObjectHolder::Own(Number{5});
+            c.Fields()["x"s] = ObjectHolder::Own(Number{6});
+
+            // Объекты с одинаковым порядком добавления полей разделяют схему
+            ASSERT(a.Fields().GetLayout() == b.Fields().GetLayout());
+            ASSERT(a.Fields().GetLayout() != c.Fields().GetLayout());
+            ASSERT_EQUAL(a.Fields().GetLayout()->FindSlot("y"s), 1U);
+            ASSERT_EQUAL(c.Fields().GetLayout()->FindSlot("y"s), 0U);
+
+            // Доступ к полям по имени работает как прежде
+            b.Fields()["x"s] = ObjectHolder::Own(Number{7});
+            ASSERT(a.Fields().GetLayout() == b.Fields().GetLayout());
+            ASSERT_EQUAL(b.Fields().size(), 2U);
+            ASSERT_EQUAL(b.Fields().at("x"s).TryAs<Number>()->GetValue(), 7);
+            ASSERT_EQUAL(c.Fields().find("x"s)->second.TryAs<Number>()->GetValue(), 6);
+            ASSERT(c.Fields().find("z"s) == c.Fields().end());
+
+            // Кеш слота срабатывает для любого объекта той же схемы
+            Closure::SlotCache cache;
+            ASSERT_EQUAL(a.Fields().Find("y"s, cache)->TryAs<Number>()->GetValue(), 2);
+            ASSERT_EQUAL(cache.layout_and_slot.load() >> Closure::SlotCache::SLOT_BITS,
+                         a.Fields().GetLayout()->GetId());
+            ASSERT_EQUAL(b.Fields().Find("y"s, cache)->TryAs<Number>()->GetValue(), 4);
+            ASSERT_EQUAL(c.Fields().Find("y"s, cache)->TryAs<Number>()->GetValue(), 5);
+            Closure::SlotCache missing_cache;
+            ASSERT(c.Fields().Find("z"s, missing_cache) == nullptr);
+
+            c.Fields().clear();
+            ASSERT(c.Fields().empty());
+            ASSERT(c.Fields().GetLayout() == ClosureLayout::GetEmptyShape());
+        }
+
+        void TestFieldsMemory() {
+            constexpr size_t INSTANCE_COUNT = 100;
+            Class cls{"Point"s, {}, nullptr};
+            auto make_instance = [&cls] {
+                auto instance = ObjectHolder::Own(ClassInstance{cls});
+                auto &fields = instance.TryAs<ClassInstance>()->Fields();
+                fields["x"s] = ObjectHolder::Own(Number{1});
+                fields["y"s] = ObjectHolder::Own(Number{2});
+                fields["z"s] = ObjectHolder::Own(Number{3});
+                return instance;
+            };
+            // Схемы полей создаются при первом объекте
+            auto first = make_instance();
+
+            vector<ObjectHolder> instances;
+            instances.reserve(INSTANCE_COUNT);
+            const size_t bytes_before = GetAllocatedBytes();
+            for (size_t i = 0; i < INSTANCE_COUNT; ++i) {
+                instances.push_back(make_instance());
+            }
+            const size_t bytes_per_instance = (GetAllocatedBytes() - bytes_before) / INSTANCE_COUNT;
+
+            // Объект с управляющим блоком shared_ptr и ровно три слота полей, без узлов хеш-таблицы
+            ASSERT(bytes_per_instance <= sizeof(ClassInstance) + 32 + 3 * sizeof(ObjectHolder));
+        }
+
         void TestClassInstance() {
             vector<Method> methods;
 
@@ -538,9 +814,14 @@ namespace runtime {
         RUN_TEST(tr, runtime::TestString);
         RUN_TEST(tr, runtime::TestBool);
         RUN_TEST(tr, runtime::TestMethodInvocation);
+        RUN_TEST(tr, runtime::TestClosure);
         RUN_TEST(tr, runtime::TestIsTrue);
         RUN_TEST(tr, runtime::TestComparison);
         RUN_TEST(tr, runtime::TestClass);
+        RUN_TEST(tr, runtime::TestMethodTable);
+        RUN_TEST(tr, runtime::TestMethodCache);
+        RUN_TEST(tr, runtime::TestFieldShapes);
+        RUN_TEST(tr, runtime::TestFieldsMemory);
         RUN_TEST(tr, runtime::TestClassInstance);
     }
 
@@ -549,6 +830,9 @@ namespace runtime {
         RUN_TEST(tr, runtime::TestOwning);
         RUN_TEST(tr, runtime::TestMove);
         RUN_TEST(tr, runtime::TestNullptr);
+        RUN_TEST(tr, runtime::TestBorrowed);
+        RUN_TEST(tr, runtime::TestInlineValues);
+        RUN_TEST(tr, runtime::TestTypeTags);
     }
 
 }  // namespace runtime
@@ -0,0 +1,166 @@
+#include "../lexer.h"
+#include "../parse.h"
+#include "../program_cache.h"
+#include "../serialize.h"
+#include "test_runner_p.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace serialize {
+
+    namespace {
+        const string PROGRAM = R"(
+class Shape:
+  def __init__(name):
+    self.name = name
+
+  def area():
+    return 0
+
+  def __str__():
+    return self.name + ': ' + str(self.area())
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.name = 'rect'
+    self.size = Shape('size')
+    self.size.w = w
+    self.size.h = h
+
+  def area():
+    if self.size.w > 0 and not self.size.h <= 0:
+      return self.size.w * self.size.h
+    else:
+      return None
+
+shapes = Shape('dot')
+r = Rect(3, -4 / 2 + 6)
+print shapes, r, r.area() >= 12, r.area() != 12, r.size.w == 3 or False
+print 'it\'s', "a \"quoted\"\n", True, None, -2147483647
+)"s;
+
+        unique_ptr<runtime::Executable> Parse(const string &program, const ParseOptions &options = {}) {
+            parse::Lexer lexer(string_view{program});
+            return ParseProgram(lexer, options);
+        }
+
+        string Run(runtime::Executable &program) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            program.Execute(closure, context);
+            return context.output.str();
+        }
+
+        void TestRoundTrip() {
+            auto parsed = Parse(PROGRAM);
+            const string image = SerializeProgram(*parsed, GetSourceKey(PROGRAM));
+            auto loaded = DeserializeProgram(image);
+
+            const string expected = Run(*parsed);
+            ASSERT_EQUAL(Run(*loaded), expected);
+            // Образ восстановленной программы совпадает с исходным
+            ASSERT_EQUAL(SerializeProgram(*loaded, GetSourceKey(PROGRAM)), image);
+            ASSERT(ReadSourceKey(image) == GetSourceKey(PROGRAM));
+        }
+
+        void TestLazyBodiesAreSaved() {
+            auto lazy = Parse(PROGRAM, {true});
+            ASSERT_EQUAL(SerializeProgram(*lazy), SerializeProgram(*Parse(PROGRAM)));
+        }
+
+        void TestImageIsCompact() {
+            // Повторяющиеся имена и строки хранятся в образе один раз
+            ostringstream program;
+            for (int i = 0; i < 100; ++i) {
+                program << "some_long_variable_name = 'some long string constant'\n"s;
+            }
+            const string source = program.str();
+            ASSERT(SerializeProgram(*Parse(source)).size() < source.size() / 5);
+        }
+
+        void TestCorruptImage() {
+            const string image = SerializeProgram(*Parse(PROGRAM));
+            ASSERT_THROWS(DeserializeProgram(""s), SerializeError);
+            ASSERT_THROWS(DeserializeProgram("not an image at all, really"s), SerializeError);
+            for (size_t size = 0; size < image.size(); size += 7) {
+                ASSERT_THROWS(DeserializeProgram(image.substr(0, size)), SerializeError);
+            }
+            ASSERT_THROWS(DeserializeProgram(image + "x"s), SerializeError);
+
+            string other_version = image;
+            other_version[4] = static_cast<char>(FORMAT_VERSION + 1);
+            ASSERT_THROWS(DeserializeProgram(other_version), SerializeError);
+        }
+
+        void TestProgramCache() {
+            const auto directory = filesystem::temp_directory_path() / "mython_cache_test"s;
+            filesystem::remove_all(directory);
+
+            const string expected = Run(*Parse(PROGRAM));
+            {
+                ProgramCache cache(directory);
+                ASSERT_EQUAL(Run(*cache.Load(PROGRAM)), expected);
+                ASSERT_EQUAL(cache.GetMisses(), 1U);
+                ASSERT(filesystem::exists(cache.GetImagePath(GetSourceKey(PROGRAM))));
+            }
+            {
+                ProgramCache cache(directory);
+                ASSERT_EQUAL(Run(*cache.Load(PROGRAM)), expected);
+                ASSERT_EQUAL(cache.GetHits(), 1U);
+                ASSERT_EQUAL(cache.GetMisses(), 0U);
+
+                // Изменённая программа получает собственный образ
+                ASSERT_EQUAL(Run(*cache.Load("print 'changed'\n"s)), "changed\n"s);
+                ASSERT_EQUAL(cache.GetMisses(), 1U);
+            }
+            {
+                // Повреждённый образ заменяется
+                ofstream(ProgramCache(directory).GetImagePath(GetSourceKey(PROGRAM)), ios::binary | ios::trunc)
+                        << "MYTIgarbage"s;
+                ProgramCache cache(directory);
+                ASSERT_EQUAL(Run(*cache.Load(PROGRAM)), expected);
+                ASSERT_EQUAL(cache.GetMisses(), 1U);
+                ASSERT_EQUAL(Run(*cache.Load(PROGRAM)), expected);
+                ASSERT_EQUAL(cache.GetHits(), 1U);
+            }
+            {
+                // Программа, разобранная с другими параметрами, получает собственный образ
+                const SourceKey lazy_key = ProgramCache::GetProgramKey(PROGRAM, {true});
+                ASSERT(lazy_key != ProgramCache::GetProgramKey(PROGRAM));
+                ProgramCache cache(directory);
+                ASSERT_EQUAL(Run(*cache.Load(PROGRAM, {true})), expected);
+                ASSERT_EQUAL(cache.GetMisses(), 1U);
+                ASSERT(filesystem::exists(cache.GetImagePath(lazy_key)));
+                ASSERT_EQUAL(Run(*cache.Load(PROGRAM, {true})), expected);
+                ASSERT_EQUAL(cache.GetHits(), 1U);
+            }
+            {
+                // Ошибка в отложенном теле метода выбрасывается только при его вызове, поэтому
+                // такая программа не кешируется
+                const string broken = "class A:\n  def f():\n    return Unknown()\n\nprint 'ok'\n"s;
+                ProgramCache cache(directory);
+                ASSERT_EQUAL(Run(*cache.Load(broken, {true})), "ok\n"s);
+                ASSERT_EQUAL(Run(*cache.Load(broken, {true})), "ok\n"s);
+                ASSERT_EQUAL(cache.GetMisses(), 2U);
+                ASSERT_THROWS(cache.Load(broken), ParseError);
+            }
+            // Ошибки разбора не кешируются
+            ASSERT_THROWS(ProgramCache(directory).Load("x = \n"s), std::runtime_error);
+
+            filesystem::remove_all(directory);
+        }
+    }  // namespace
+
+    void RunSerializeTests(TestRunner &tr) {
+        RUN_TEST(tr, serialize::TestRoundTrip);
+        RUN_TEST(tr, serialize::TestLazyBodiesAreSaved);
+        RUN_TEST(tr, serialize::TestImageIsCompact);
+        RUN_TEST(tr, serialize::TestCorruptImage);
+        RUN_TEST(tr, serialize::TestProgramCache);
+    }
+
+}  // namespace serialize
@@ -1,6 +1,9 @@
 #include "../statement.h"
+#include "alloc_counter.h"
 #include "test_runner_p.h"
 
+#include <limits>
+
 using namespace std;
 
 namespace ast {
@@ -104,6 +107,10 @@ namespace ast {
             ASSERT(closure.find("y"s) != closure.end());
             ASSERT_OBJECT_VALUE_EQUAL(closure.at("y"s), "Hello"s);
 
+            // Значение переменной переживает инструкцию, константа которой была присвоена
+            Assignment("z"s, make_unique<StringConst>(runtime::String("constant"s))).Execute(closure, context);
+            ASSERT_OBJECT_VALUE_EQUAL(closure.at("z"s), "constant"s);
+
             ASSERT(context.output.str().empty());
         }
 
@@ -129,7 +136,7 @@ namespace ast {
 
             assign_y.Execute(closure, context);
             FieldAssignment assign_yz(
-                    VariableValue{vector<string>{"self"s, "y"s}}, "z"s,
+                    VariableValue{vector<runtime::Symbol>{"self"s, "y"s}}, "z"s,
                     make_unique<StringConst>(runtime::String("Hello, world! Hooray! Yes-yes!!!"s)));
             {
                 ObjectHolder o = assign_yz.Execute(closure, context);
@@ -215,10 +222,53 @@ namespace ast {
                 Stringify str(make_unique<None>());
                 ASSERT_OBJECT_VALUE_EQUAL(str.Execute(empty, context), "None"s);
             }
+            {
+                Stringify str(make_unique<BoolConst>(runtime::Bool{false}));
+                ASSERT_OBJECT_VALUE_EQUAL(str.Execute(empty, context), "False"s);
+            }
+            {
+                // Результат __str__ другого объекта дописывается к итоговой строке
+                vector<runtime::Method> inner_methods;
+                inner_methods.push_back({"__str__"s, {}, make_unique<NumericConst>(-15)});
+                runtime::Class inner("Inner"s, std::move(inner_methods), nullptr);
+                vector<runtime::Method> outer_methods;
+                outer_methods.push_back({"__str__"s, {}, make_unique<NewInstance>(inner)});
+                runtime::Class outer("Outer"s, std::move(outer_methods), nullptr);
+
+                auto result = Stringify(make_unique<NewInstance>(outer)).Execute(empty, context);
+                ASSERT_OBJECT_VALUE_EQUAL(result, "-15"s);
+            }
 
             ASSERT(context.output.str().empty());
         }
 
+        void TestStringifyAllocations() {
+            runtime::DummyContext context;
+            Closure closure = {
+                    {"n"s, ObjectHolder::Own(runtime::Number(-2147483647))},
+                    {"b"s, ObjectHolder::Own(runtime::Bool(true))},
+                    {"s"s, ObjectHolder::Own(runtime::String("some long text that is not small"s))},
+                    {"none"s, ObjectHolder::None()},
+            };
+            Stringify str_number(make_unique<VariableValue>("n"s));
+            Stringify str_bool(make_unique<VariableValue>("b"s));
+            Stringify str_string(make_unique<VariableValue>("s"s));
+            Stringify str_none(make_unique<VariableValue>("none"s));
+
+            auto count_allocations = [&](Stringify &str, const string &expected) {
+                const size_t allocations_before = GetAllocationCount();
+                auto result = str.Execute(closure, context);
+                const size_t allocations = GetAllocationCount() - allocations_before;
+                ASSERT_EQUAL(result.TryAs<runtime::String>()->GetValue(), expected);
+                return allocations;
+            };
+
+            ASSERT(count_allocations(str_number, "-2147483647"s) <= 1U);
+            ASSERT_EQUAL(count_allocations(str_bool, "True"s), 0U);
+            ASSERT_EQUAL(count_allocations(str_string, "some long text that is not small"s), 0U);
+            ASSERT_EQUAL(count_allocations(str_none, "None"s), 0U);
+        }
+
         void TestNumbersAddition() {
             runtime::DummyContext context;
 
@@ -230,6 +280,26 @@ namespace ast {
             ASSERT(context.output.str().empty());
         }
 
+        void TestArithmeticsDoesNotAllocate() {
+            runtime::DummyContext context;
+
+            Comparison expr(runtime::Less,
+                            make_unique<Add>(make_unique<Mult>(make_unique<NumericConst>(6),
+                                                               make_unique<NumericConst>(7)),
+                                             make_unique<Sub>(make_unique<NumericConst>(10),
+                                                              make_unique<Div>(make_unique<NumericConst>(8),
+                                                                               make_unique<NumericConst>(2)))),
+                            make_unique<NumericConst>(100));
+
+            Closure empty;
+            const size_t allocations_before = GetAllocationCount();
+            ObjectHolder result = expr.Execute(empty, context);
+            const size_t allocations_after = GetAllocationCount();
+
+            ASSERT_EQUAL(allocations_after, allocations_before);
+            ASSERT(result.TryAs<runtime::Bool>() && result.TryAs<runtime::Bool>()->GetValue());
+        }
+
         void TestStringsAddition() {
             runtime::DummyContext context;
 
@@ -260,6 +330,21 @@ namespace ast {
             ASSERT(context.output.str().empty());
         }
 
+        void TestDivisionByZero() {
+            runtime::DummyContext context;
+
+            Closure empty;
+
+            ASSERT_THROWS(Div(make_unique<NumericConst>(42), make_unique<NumericConst>(0)).Execute(empty, context),
+                          std::runtime_error);
+            // Частное наименьшего числа и -1 не представимо в int
+            ASSERT_THROWS(Div(make_unique<NumericConst>(std::numeric_limits<int>::min()),
+                              make_unique<NumericConst>(-1)).Execute(empty, context),
+                          std::runtime_error);
+
+            ASSERT(context.output.str().empty());
+        }
+
         void TestSuccessfulClassInstanceAdd() {
             runtime::DummyContext context;
 
@@ -322,13 +407,13 @@ namespace ast {
                                {make_unique<FieldAssignment>(VariableValue{"self"s}, "value"s,
                                                              make_unique<NumericConst>(0))}});
             methods.push_back(
-                    {"value"s, {}, {make_unique<VariableValue>(vector<string>{"self"s, "value"s})}});
+                    {"value"s, {}, {make_unique<VariableValue>(vector<runtime::Symbol>{"self"s, "value"s})}});
             methods.push_back(
                     {"add"s,
                      {"x"s},
                      {make_unique<FieldAssignment>(
                              VariableValue{"self"s}, "value"s,
-                             make_unique<Add>(make_unique<VariableValue>(vector<string>{"self"s, "value"s}),
+                             make_unique<Add>(make_unique<VariableValue>(vector<runtime::Symbol>{"self"s, "value"s}),
                                               make_unique<VariableValue>("x"s)))}});
 
             runtime::Class cls("BoxedValue"s, std::move(methods), nullptr);
@@ -350,7 +435,7 @@ namespace ast {
 
         void TestBaseClass() {
             vector<runtime::Method> methods;
-            methods.push_back({"GetValue"s, {}, make_unique<VariableValue>(vector{"self"s, "value"s})});
+            methods.push_back({"GetValue"s, {}, make_unique<VariableValue>(vector<runtime::Symbol>{"self"s, "value"s})});
             methods.push_back({"SetValue"s,
                                {"x"s},
                                make_unique<FieldAssignment>(VariableValue{"self"s}, "value"s,
@@ -376,7 +461,7 @@ namespace ast {
 
         void TestInheritance() {
             vector<runtime::Method> methods;
-            methods.push_back({"GetValue"s, {}, make_unique<VariableValue>(vector{"self"s, "value"s})});
+            methods.push_back({"GetValue"s, {}, make_unique<VariableValue>(vector<runtime::Symbol>{"self"s, "value"s})});
             methods.push_back({"SetValue"s,
                                {"x"s},
                                make_unique<FieldAssignment>(VariableValue{"self"s}, "value"s,
@@ -457,6 +542,136 @@ namespace ast {
             test_not(false);
         }
 
+        void TestMethodCallCache() {
+            runtime::DummyContext context;
+
+            vector<runtime::Method> a_methods;
+            a_methods.push_back({"m"s, {}, make_unique<NumericConst>(1)});
+            runtime::Class a{"A"s, std::move(a_methods), nullptr};
+            vector<runtime::Method> b_methods;
+            b_methods.push_back({"m"s, {}, make_unique<NumericConst>(2)});
+            runtime::Class b{"B"s, std::move(b_methods), nullptr};
+            runtime::ClassInstance a_inst(a);
+            runtime::ClassInstance b_inst(b);
+
+            MethodCall call(make_unique<VariableValue>("obj"s), "m"s, {});
+            Closure closure = {{"obj"s, ObjectHolder::Share(a_inst)}};
+            ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 1);
+            ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 1);
+            ASSERT_EQUAL(call.GetCache().GetSize(), 1U);
+
+            closure["obj"s] = ObjectHolder::Share(b_inst);
+            ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 2);
+            closure["obj"s] = ObjectHolder::Share(a_inst);
+            ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 1);
+
+            ASSERT_EQUAL(call.GetCache().GetSize(), 2U);
+            ASSERT_EQUAL(call.GetCache().GetStats().hits, 2U);
+            ASSERT_EQUAL(call.GetCache().GetStats().misses, 2U);
+
+            Add add(make_unique<VariableValue>("obj"s), make_unique<NumericConst>(1));
+            ASSERT_THROWS(add.Execute(closure, context), runtime_error);
+            ASSERT_THROWS(add.Execute(closure, context), runtime_error);
+            ASSERT_EQUAL(add.GetCache().GetStats().misses, 1U);
+            ASSERT_EQUAL(add.GetCache().GetStats().hits, 1U);
+        }
+
+        void TestMethodCallDoesNotAllocate() {
+            runtime::DummyContext context;
+
+            // def add(x):
+            //   self.value = self.value + x
+            //   return self.value
+            auto body = make_unique<Compound>();
+            body->AddStatement(make_unique<FieldAssignment>(
+                    VariableValue{"self"s}, "value"s,
+                    make_unique<Add>(make_unique<VariableValue>(vector<runtime::Symbol>{"self"s, "value"s}),
+                                     make_unique<VariableValue>("x"s))));
+            body->AddStatement(make_unique<Return>(make_unique<VariableValue>(vector<runtime::Symbol>{"self"s, "value"s})));
+            vector<runtime::Method> methods;
+            methods.push_back({"add"s, {"x"s}, make_unique<MethodBody>(std::move(body))});
+            runtime::Class cls{"Counter"s, std::move(methods), nullptr};
+            runtime::ClassInstance counter{cls};
+            counter.Fields()["value"s] = ObjectHolder::Own(runtime::Number(0));
+
+            vector<unique_ptr<Statement>> args;
+            args.push_back(make_unique<NumericConst>(1));
+            MethodCall call(make_unique<VariableValue>("counter"s), "add"s, std::move(args));
+            Closure closure = {{"counter"s, ObjectHolder::Share(counter)}};
+            call.Execute(closure, context);
+
+            const size_t allocations_before = GetAllocationCount();
+            for (int i = 0; i < 100; ++i) {
+                call.Execute(closure, context);
+            }
+            const size_t allocations_after = GetAllocationCount();
+
+            ASSERT_EQUAL(allocations_after, allocations_before);
+            ASSERT_OBJECT_VALUE_EQUAL(counter.Fields().at("value"s), 101);
+            ASSERT_EQUAL(runtime::CallStack::GetInstance().GetDepth(), 0U);
+        }
+
+        void TestReturn() {
+            runtime::DummyContext context;
+
+            // if x:
+            //   return 'yes'
+            //   print 'unreachable'
+            // print 'no'
+            // return 'no'
+            auto if_body = make_unique<Compound>();
+            if_body->AddStatement(make_unique<Return>(make_unique<StringConst>("yes"s)));
+            if_body->AddStatement(make_unique<Print>(make_unique<StringConst>("unreachable"s)));
+            auto body = make_unique<Compound>();
+            body->AddStatement(make_unique<IfElse>(make_unique<VariableValue>("x"s), std::move(if_body), nullptr));
+            body->AddStatement(make_unique<Print>(make_unique<StringConst>("no"s)));
+            body->AddStatement(make_unique<Return>(make_unique<StringConst>("no"s)));
+            MethodBody method(std::move(body));
+
+            Closure closure = {{"x"s, ObjectHolder::Own(runtime::Bool(true))}};
+            ASSERT_OBJECT_VALUE_EQUAL(method.Execute(closure, context), "yes"s);
+            ASSERT(!closure.HasReturned());
+            ASSERT(context.output.str().empty());
+
+            closure["x"s] = ObjectHolder::Own(runtime::Bool(false));
+            ASSERT_OBJECT_VALUE_EQUAL(method.Execute(closure, context), "no"s);
+            ASSERT(!closure.HasReturned());
+            ASSERT_EQUAL(context.output.str(), "no\n"s);
+        }
+
+        void TestResolvedNames() {
+            runtime::DummyContext context;
+
+            Compound program;
+            program.AddStatement(make_unique<Assignment>("x"s, make_unique<NumericConst>(20)));
+            program.AddStatement(make_unique<Assignment>(
+                    "y"s, make_unique<Add>(make_unique<VariableValue>("x"s), make_unique<VariableValue>("z"s))));
+            program.AddStatement(Print::Variable("y"s));
+
+            auto layout = make_shared<runtime::ClosureLayout>();
+            program.ResolveNames(*layout);
+            program.SetLayout(layout);
+            ASSERT_EQUAL(layout->GetSize(), 3U);
+            ASSERT_EQUAL(layout->FindSlot("x"s), 0U);
+            ASSERT_EQUAL(layout->FindSlot("z"s), 1U);
+
+            // Переменные, присвоенные до выполнения программы, переносятся в слоты
+            Closure closure = {{"z"s, ObjectHolder::Own(runtime::Number(1))},
+                               {"other"s, ObjectHolder::Own(runtime::Number(2))}};
+            program.Execute(closure, context);
+
+            ASSERT(closure.GetLayout() == layout.get());
+            ASSERT_EQUAL(closure.size(), 4U);
+            ASSERT_OBJECT_VALUE_EQUAL(*closure.GetSlot(2), 21);
+            ASSERT_OBJECT_VALUE_EQUAL(closure.at("y"s), 21);
+            ASSERT_OBJECT_VALUE_EQUAL(closure.at("other"s), 2);
+            ASSERT_EQUAL(context.output.str(), "21\n"s);
+
+            // Без разрешения имён инструкции по-прежнему работают с переменными по имени
+            Closure unresolved = {{"x"s, ObjectHolder::Own(runtime::Number(3))}};
+            ASSERT_OBJECT_VALUE_EQUAL(VariableValue("x"s).Execute(unresolved, context), 3);
+        }
+
     }  // namespace
 
     void RunUnitTests(TestRunner &tr) {
@@ -468,9 +683,12 @@ namespace ast {
         RUN_TEST(tr, ast::TestPrintVariable);
         RUN_TEST(tr, ast::TestPrintMultipleStatements);
         RUN_TEST(tr, ast::TestStringify);
+        RUN_TEST(tr, ast::TestStringifyAllocations);
         RUN_TEST(tr, ast::TestNumbersAddition);
+        RUN_TEST(tr, ast::TestArithmeticsDoesNotAllocate);
         RUN_TEST(tr, ast::TestStringsAddition);
         RUN_TEST(tr, ast::TestBadAddition);
+        RUN_TEST(tr, ast::TestDivisionByZero);
         RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd);
         RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod);
         RUN_TEST(tr, ast::TestCompound);
@@ -480,6 +698,10 @@ namespace ast {
         RUN_TEST(tr, ast::TestOr);
         RUN_TEST(tr, ast::TestAnd);
         RUN_TEST(tr, ast::TestNot);
+        RUN_TEST(tr, ast::TestMethodCallCache);
+        RUN_TEST(tr, ast::TestMethodCallDoesNotAllocate);
+        RUN_TEST(tr, ast::TestReturn);
+        RUN_TEST(tr, ast::TestResolvedNames);
     }
 
 }  // namespace ast
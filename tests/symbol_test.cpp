@@ -0,0 +1,75 @@
+#include "../symbol.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        void TestSameTextSameSymbol() {
+            const Symbol a{"value"sv};
+            const Symbol b{"value"s};
+            const string text = "val"s + "ue"s;
+            const Symbol c{text};
+
+            ASSERT(a == b);
+            ASSERT(a == c);
+            ASSERT_EQUAL(&a.GetText(), &c.GetText());
+            ASSERT_EQUAL(a.GetHash(), c.GetHash());
+            ASSERT_EQUAL(a.GetText(), "value"s);
+            ASSERT_EQUAL(a.GetHash(), hash<string_view>{}("value"sv));
+        }
+
+        void TestDifferentTextDifferentSymbol() {
+            const Symbol a{"x"};
+            const Symbol b{"y"};
+            ASSERT(a != b);
+            ASSERT(!(a == b));
+
+            unordered_set<Symbol> symbols{a, b, Symbol{"x"}};
+            ASSERT_EQUAL(symbols.size(), 2U);
+
+            ostringstream out;
+            out << a << b;
+            ASSERT_EQUAL(out.str(), "xy"s);
+        }
+
+        void TestEmptySymbol() {
+            const Symbol empty;
+            ASSERT(empty == Symbol{""sv});
+            ASSERT(empty.GetText().empty());
+        }
+
+        void TestInternFromManyThreads() {
+            constexpr size_t THREAD_COUNT = 4;
+            vector<const string *> texts(THREAD_COUNT);
+            vector<thread> threads;
+            for (size_t i = 0; i < THREAD_COUNT; ++i) {
+                threads.emplace_back([&texts, i] {
+                    const Symbol symbol{"shared_between_threads"sv};
+                    texts[i] = &symbol.GetText();
+                });
+            }
+            for (auto &t : threads) {
+                t.join();
+            }
+            for (const string *text : texts) {
+                ASSERT_EQUAL(text, &Symbol{"shared_between_threads"}.GetText());
+            }
+        }
+
+    }  // namespace
+
+    void RunSymbolTests(TestRunner &tr) {
+        RUN_TEST(tr, runtime::TestSameTextSameSymbol);
+        RUN_TEST(tr, runtime::TestDifferentTextDifferentSymbol);
+        RUN_TEST(tr, runtime::TestEmptySymbol);
+        RUN_TEST(tr, runtime::TestInternFromManyThreads);
+    }
+
+}  // namespace runtime
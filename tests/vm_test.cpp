@@ -0,0 +1,282 @@
+#include "../lexer.h"
+#include "../parse.h"
+#include "../vm.h"
+#include "test_runner_p.h"
+
+using namespace std;
+
+namespace vm {
+
+    namespace {
+
+        // Выполняет программу обходом AST и на виртуальной машине, проверяя, что вывод совпадает
+        string RunOnBothEngines(const string &program) {
+            istringstream ast_input(program);
+            parse::Lexer ast_lexer(ast_input);
+            auto ast_tree = ParseProgram(ast_lexer);
+            runtime::DummyContext ast_context;
+            runtime::Closure ast_closure;
+            ast_tree->Execute(ast_closure, ast_context);
+
+            istringstream vm_input(program);
+            parse::Lexer vm_lexer(vm_input);
+            auto vm_tree = ParseProgram(vm_lexer);
+            runtime::DummyContext vm_context;
+            runtime::Closure vm_closure;
+            VirtualMachine{}.Run(*vm_tree, vm_closure, vm_context);
+
+            ASSERT_EQUAL(vm_context.output.str(), ast_context.output.str());
+            return vm_context.output.str();
+        }
+
+        void TestArithmeticsAndLogic() {
+            const string program = R"(
+x = 4
+y = 5
+print x + y, x - y, x * y, y / 2, -x
+print x < y, x > y, x == 4, x != 4, x <= 4, y >= 6
+print 'a' + 'b', 'a' < 'b', True and False, True or False, not x
+print str(x) + str(None), None
+print
+        )"s;
+
+            ASSERT_EQUAL(RunOnBothEngines(program),
+                         "9 -1 20 2 -4\nTrue False True False True False\nab True False True False\n4None None\n\n"s);
+        }
+
+        void TestMethodsAndFields() {
+            const string program = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __add__(other):
+    return self.x * other.x + self.y * other.y
+
+  def __eq__(other):
+    return self.x == other.x and self.y == other.y
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ')'
+
+class Segment:
+  def __init__(a, b):
+    self.a = a
+    self.b = b
+
+f = Fib()
+print f.calc(15)
+p = Point(4, 6)
+print Point(1, 2) + Point(3, 4), p, p == Point(4, 6), p.x
+s = Segment(p, Point(0, 0))
+s.a.x = 10
+print s.a, s.b, s.a.y
+print f.missing(), p.x
+        )"s;
+
+            ASSERT_EQUAL(RunOnBothEngines(program), "610\n11 (4, 6) True 4\n(10, 6) (0, 0) 6\nNone 10\n"s);
+        }
+
+        void TestIfElseAndInheritance() {
+            const string program = R"(
+class Shape:
+  def name():
+    return 'shape'
+
+  def describe():
+    return 'I am ' + self.name()
+
+class Circle(Shape):
+  def name():
+    return 'circle'
+
+  def kind(r):
+    if r > 10:
+      result = 'big'
+    else:
+      if r > 0:
+        result = 'small'
+      else:
+        result = 'empty'
+    return result
+
+c = Circle()
+s = Shape()
+print c.describe(), s.describe()
+print c.kind(20), c.kind(5), c.kind(0)
+        )"s;
+
+            ASSERT_EQUAL(RunOnBothEngines(program), "I am circle I am shape\nbig small empty\n"s);
+        }
+
+        void TestGlobalsAreStoredInClosure() {
+            istringstream input("x = 57\ny = x + 1\n"s);
+            parse::Lexer lexer(input);
+            auto program = ParseProgram(lexer);
+
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            VirtualMachine{}.Run(*program, closure, context);
+
+            ASSERT_EQUAL(closure.size(), 2U);
+            ASSERT_EQUAL(closure.at("y"s).TryAs<runtime::Number>()->GetValue(), 58);
+        }
+
+        void TestErrors() {
+            auto run = [](const string &program) {
+                istringstream input(program);
+                parse::Lexer lexer(input);
+                auto tree = ParseProgram(lexer);
+                runtime::DummyContext context;
+                runtime::Closure closure;
+                VirtualMachine{}.Run(*tree, closure, context);
+            };
+
+            ASSERT_THROWS(run("print x\n"s), std::runtime_error);
+            ASSERT_THROWS(run("print 1 + 'a'\n"s), std::runtime_error);
+            ASSERT_THROWS(run("print 1 / 0\n"s), std::runtime_error);
+            ASSERT_THROWS(run("x = 0 - 2147483647 - 1\nprint x / (0 - 1)\n"s), std::runtime_error);
+            ASSERT_THROWS(run("print None < None\n"s), std::runtime_error);
+            // Локальная переменная, которой не было присвоено значение
+            ASSERT_THROWS(run(R"(
+class A:
+  def f(c):
+    if c:
+      x = 1
+    return x
+
+a = A()
+print a.f(False)
+)"s), std::runtime_error);
+        }
+
+        // Выполняет программу обеими машинами и возвращает текст ошибки, проверив, что он совпадает
+        string GetErrorOnBothEngines(const string &program) {
+            auto get_error = [&program](bool use_vm) {
+                istringstream input(program);
+                parse::Lexer lexer(input);
+                auto tree = ParseProgram(lexer);
+                runtime::DummyContext context;
+                runtime::Closure closure;
+                try {
+                    if (use_vm) {
+                        VirtualMachine{}.Run(*tree, closure, context);
+                    } else {
+                        tree->Execute(closure, context);
+                    }
+                } catch (const std::runtime_error &e) {
+                    return string(e.what());
+                }
+                return ""s;
+            };
+            const string vm_error = get_error(true);
+            ASSERT_EQUAL(vm_error, get_error(false));
+            return vm_error;
+        }
+
+        void TestUnknownVariableMessages() {
+            ASSERT_EQUAL(GetErrorOnBothEngines("print x\n"s), "Uncknown variable name: x"s);
+            // Ошибка в любом звене цепочки называет цепочку целиком
+            ASSERT_EQUAL(GetErrorOnBothEngines("a = 1\nprint a.b.c\n"s), "Uncknown variable name: a.b.c"s);
+            ASSERT_EQUAL(GetErrorOnBothEngines(R"(
+class P:
+  def __init__():
+    self.x = 1
+
+p = P()
+print p.y
+)"s), "Uncknown variable name: p.y"s);
+            ASSERT_EQUAL(GetErrorOnBothEngines(R"(
+class A:
+  def f(c):
+    if c:
+      x = self
+    return x.y
+
+a = A()
+print a.f(False)
+)"s), "Uncknown variable name: x.y"s);
+        }
+
+        struct NativeBody : runtime::Executable {
+            runtime::ObjectHolder Execute(runtime::Closure &closure, runtime::Context & /*context*/) override {
+                return closure.at("arg"s);
+            }
+        };
+
+        void TestUncompilableMethodIsInterpreted() {
+            vector<runtime::Method> methods;
+            methods.push_back({"echo"s, {"arg"s}, make_unique<NativeBody>()});
+            auto cls = runtime::ObjectHolder::Own(runtime::Class{"Native"s, std::move(methods), nullptr});
+
+            vector<unique_ptr<ast::Statement>> args;
+            args.push_back(make_unique<ast::NumericConst>(42));
+            ast::Print program(make_unique<ast::MethodCall>(
+                    make_unique<ast::NewInstance>(*cls.TryAs<runtime::Class>()), "echo"s, std::move(args)));
+
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            VirtualMachine{}.Run(program, closure, context);
+            ASSERT_EQUAL(context.output.str(), "42\n"s);
+        }
+
+        void TestLazyMethodBodies() {
+            const string program = R"(
+class Sum:
+  def upto(n):
+    total = 0
+    i = n
+    if i > 0:
+      total = i + self.upto(i - 1)
+    return total
+
+s = Sum()
+print s.upto(10)
+)"s;
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            auto tree = ParseProgram(lexer, ParseOptions{true});
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            VirtualMachine{}.Run(*tree, closure, context);
+
+            ASSERT_EQUAL(context.output.str(), "55\n"s);
+        }
+
+        void TestReuseAcrossPrograms() {
+            VirtualMachine machine;
+            runtime::DummyContext context;
+            // Методы второй программы могут занять адреса освобождённых методов первой
+            for (const string &value : {"1"s, "2"s}) {
+                istringstream input("class A:\n  def f():\n    return "s + value + "\n\na = A()\nprint a.f()\n"s);
+                parse::Lexer lexer(input);
+                auto tree = ParseProgram(lexer);
+                runtime::Closure closure;
+                machine.Run(*tree, closure, context);
+            }
+
+            ASSERT_EQUAL(context.output.str(), "1\n2\n"s);
+        }
+
+    }  // namespace
+
+    void RunVirtualMachineTests(TestRunner &tr) {
+        RUN_TEST(tr, vm::TestArithmeticsAndLogic);
+        RUN_TEST(tr, vm::TestMethodsAndFields);
+        RUN_TEST(tr, vm::TestIfElseAndInheritance);
+        RUN_TEST(tr, vm::TestGlobalsAreStoredInClosure);
+        RUN_TEST(tr, vm::TestErrors);
+        RUN_TEST(tr, vm::TestUnknownVariableMessages);
+        RUN_TEST(tr, vm::TestUncompilableMethodIsInterpreted);
+        RUN_TEST(tr, vm::TestLazyMethodBodies);
+        RUN_TEST(tr, vm::TestReuseAcrossPrograms);
+    }
+
+}  // namespace vm
@@ -0,0 +1,798 @@
+#include "vm.h"
+
+#include <unordered_set>
+
+using namespace std;
+
+namespace vm {
+
+    using runtime::ObjectHolder;
+
+    namespace {
+        const runtime::Symbol ADD_METHOD{"__add__"};
+        const runtime::Symbol INIT_METHOD{"__init__"};
+
+        using ComparatorFn = bool (*)(const ObjectHolder &, const ObjectHolder &, runtime::Context &);
+
+        // Значение регистра локальной переменной, которой ещё ничего не присвоено
+        class Unbound : public runtime::Object {
+        public:
+            void Print(std::ostream &os, [[maybe_unused]] runtime::Context &context) override {
+                os << "<unbound>"sv;
+            }
+        };
+
+        const ObjectHolder &UnboundValue() {
+            static const ObjectHolder unbound = ObjectHolder::Own(Unbound{});
+            return unbound;
+        }
+
+        //////////////////////////////////////////////////////////////////////////////
+        //
+        //  Compiler
+
+        class Compiler {
+        public:
+            Function CompileProgram(const ast::Statement &program) {
+                Compile(program, NO_REGISTER);
+                Emit(OpCode::Return, NO_REGISTER);
+                return Finish();
+            }
+
+            Function CompileMethod(const runtime::Method &method) {
+                const runtime::Executable &method_body = method.body->Prepare();
+                is_method_ = true;
+                AddLocal("self");
+                for (const auto &param: method.formal_params) {
+                    AddLocal(param);
+                }
+                function_.param_count = static_cast<uint32_t>(locals_.size());
+                CollectLocals(method_body);
+                function_.local_count = static_cast<uint32_t>(locals_.size()) - function_.param_count;
+                next_register_ = static_cast<uint32_t>(locals_.size());
+                max_register_ = next_register_;
+
+                if (const auto *body = dynamic_cast<const ast::MethodBody *>(&method_body)) {
+                    Compile(body->GetBody(), NO_REGISTER);
+                    Emit(OpCode::Return, NO_REGISTER);
+                } else {
+                    // Тело метода без MethodBody возвращает значение вычисленного выражения
+                    uint32_t result = CompileToRegister(method_body);
+                    Emit(OpCode::Return, result);
+                }
+                return Finish();
+            }
+
+        private:
+            Function Finish() {
+                function_.register_count = max_register_;
+                return std::move(function_);
+            }
+
+            size_t Emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+                function_.code.push_back({op, a, b, c});
+                return function_.code.size() - 1;
+            }
+
+            uint32_t Here() const {
+                return static_cast<uint32_t>(function_.code.size());
+            }
+
+            void PatchJump(size_t instruction) {
+                auto &ins = function_.code[instruction];
+                if (ins.op == OpCode::Jump) {
+                    ins.a = Here();
+                } else {
+                    ins.b = Here();
+                }
+            }
+
+            uint32_t AllocRegister() {
+                uint32_t reg = next_register_++;
+                max_register_ = std::max(max_register_, next_register_);
+                return reg;
+            }
+
+            uint32_t AddConstant(ObjectHolder value) {
+                function_.constants.push_back(std::move(value));
+                return static_cast<uint32_t>(function_.constants.size() - 1);
+            }
+
+            uint32_t AddName(runtime::Symbol name) {
+                auto [it, inserted] = name_indices_.emplace(name, static_cast<uint32_t>(function_.names.size()));
+                if (inserted) {
+                    function_.names.push_back(name);
+                }
+                return it->second;
+            }
+
+            uint32_t AddCallSite(runtime::Symbol method, size_t arg_count) {
+                function_.call_sites.push_back({method, static_cast<uint32_t>(arg_count)});
+                return static_cast<uint32_t>(function_.call_sites.size() - 1);
+            }
+
+            void AddLocal(runtime::Symbol name) {
+                locals_.emplace(name, static_cast<uint32_t>(locals_.size()));
+            }
+
+            // Собирает имена всех переменных, к которым обращается тело метода
+            void CollectLocals(const ast::Statement &stmt) {
+                if (const auto *var = dynamic_cast<const ast::VariableValue *>(&stmt)) {
+                    AddLocal(var->GetDottedIds().front());
+                } else if (const auto *assign = dynamic_cast<const ast::Assignment *>(&stmt)) {
+                    AddLocal(assign->GetVarName());
+                    CollectLocals(assign->GetRvalue());
+                } else if (const auto *field_assign = dynamic_cast<const ast::FieldAssignment *>(&stmt)) {
+                    CollectLocals(field_assign->GetObject());
+                    CollectLocals(field_assign->GetRvalue());
+                } else if (const auto *print = dynamic_cast<const ast::Print *>(&stmt)) {
+                    CollectLocals(print->GetArgs());
+                } else if (const auto *call = dynamic_cast<const ast::MethodCall *>(&stmt)) {
+                    CollectLocals(call->GetObject());
+                    CollectLocals(call->GetArgs());
+                } else if (const auto *new_instance = dynamic_cast<const ast::NewInstance *>(&stmt)) {
+                    CollectLocals(new_instance->GetArgs());
+                } else if (const auto *unary = dynamic_cast<const ast::UnaryOperation *>(&stmt)) {
+                    CollectLocals(unary->GetArgument());
+                } else if (const auto *binary = dynamic_cast<const ast::BinaryOperation *>(&stmt)) {
+                    CollectLocals(binary->GetLhs());
+                    CollectLocals(binary->GetRhs());
+                } else if (const auto *compound = dynamic_cast<const ast::Compound *>(&stmt)) {
+                    CollectLocals(compound->GetStatements());
+                } else if (const auto *body = dynamic_cast<const ast::MethodBody *>(&stmt)) {
+                    CollectLocals(body->GetBody());
+                } else if (const auto *ret = dynamic_cast<const ast::Return *>(&stmt)) {
+                    CollectLocals(ret->GetStatement());
+                } else if (const auto *class_def = dynamic_cast<const ast::ClassDefinition *>(&stmt)) {
+                    AddLocal(class_def->GetClass().TryAs<runtime::Class>()->GetName());
+                } else if (const auto *if_else = dynamic_cast<const ast::IfElse *>(&stmt)) {
+                    CollectLocals(if_else->GetCondition());
+                    CollectLocals(if_else->GetIfBody());
+                    if (if_else->GetElseBody()) {
+                        CollectLocals(*if_else->GetElseBody());
+                    }
+                }
+            }
+
+            void CollectLocals(const std::vector<std::unique_ptr<ast::Statement>> &statements) {
+                for (const auto &stmt: statements) {
+                    CollectLocals(*stmt);
+                }
+            }
+
+            // Возвращает регистр локальной переменной name либо NO_REGISTER для глобальной переменной
+            uint32_t FindLocal(runtime::Symbol name) const {
+                if (!is_method_) {
+                    return NO_REGISTER;
+                }
+                return locals_.at(name);
+            }
+
+            // Возвращает регистр переменной name, проверив, что ей уже присвоено значение.
+            // Если значение не присвоено, ошибка называет переменную reported_name
+            uint32_t ReadLocal(runtime::Symbol name, runtime::Symbol reported_name) {
+                uint32_t reg = FindLocal(name);
+                if (reg >= function_.param_count) {
+                    Emit(OpCode::CheckBound, reg, AddName(reported_name));
+                }
+                return reg;
+            }
+
+            uint32_t ReadLocal(runtime::Symbol name) {
+                return ReadLocal(name, name);
+            }
+
+            // Вычисляет выражение и возвращает регистр, содержащий его значение.
+            // Для локальных переменных новый регистр не выделяется
+            uint32_t CompileToRegister(const ast::Statement &stmt) {
+                if (const auto *var = dynamic_cast<const ast::VariableValue *>(&stmt)) {
+                    if (is_method_ && var->GetDottedIds().size() == 1) {
+                        return ReadLocal(var->GetDottedIds().front());
+                    }
+                }
+                uint32_t reg = AllocRegister();
+                Compile(stmt, reg);
+                return reg;
+            }
+
+            void EmitMove(uint32_t dst, uint32_t src) {
+                if (dst != NO_REGISTER && dst != src) {
+                    Emit(OpCode::Move, dst, src);
+                }
+            }
+
+            void StoreVariable(runtime::Symbol name, uint32_t src) {
+                if (uint32_t reg = FindLocal(name); reg != NO_REGISTER) {
+                    EmitMove(reg, src);
+                } else {
+                    Emit(OpCode::StoreGlobal, src, AddName(name));
+                }
+            }
+
+            // Генерирует код, записывающий значение stmt в регистр dst.
+            // Регистр dst изменяется только последней инструкцией, поэтому он может совпадать
+            // с регистром переменной, участвующей в вычислении
+            void Compile(const ast::Statement &stmt, uint32_t dst) {
+                const uint32_t mark = next_register_;
+
+                if (const auto *num = dynamic_cast<const ast::NumericConst *>(&stmt)) {
+                    CompileConst(ObjectHolder::Own(runtime::Number{num->GetValue()}), dst);
+                } else if (const auto *str = dynamic_cast<const ast::StringConst *>(&stmt)) {
+                    CompileConst(ObjectHolder::Own(runtime::String{str->GetValue()}), dst);
+                } else if (const auto *boolean = dynamic_cast<const ast::BoolConst *>(&stmt)) {
+                    CompileConst(ObjectHolder::Own(runtime::Bool{boolean->GetValue()}), dst);
+                } else if (dynamic_cast<const ast::None *>(&stmt)) {
+                    if (dst != NO_REGISTER) {
+                        Emit(OpCode::LoadNone, dst);
+                    }
+                } else if (const auto *var = dynamic_cast<const ast::VariableValue *>(&stmt)) {
+                    CompileVariable(*var, dst);
+                } else if (const auto *assign = dynamic_cast<const ast::Assignment *>(&stmt)) {
+                    CompileAssignment(*assign, dst);
+                } else if (const auto *field_assign = dynamic_cast<const ast::FieldAssignment *>(&stmt)) {
+                    uint32_t object = CompileToRegister(field_assign->GetObject());
+                    uint32_t value = AllocRegister();
+                    Compile(field_assign->GetRvalue(), value);
+                    Emit(OpCode::SetField, object, AddName(field_assign->GetFieldName()), value);
+                    EmitMove(dst, value);
+                } else if (const auto *print = dynamic_cast<const ast::Print *>(&stmt)) {
+                    const auto &args = print->GetArgs();
+                    for (size_t i = 0; i < args.size(); ++i) {
+                        const uint32_t arg_mark = next_register_;
+                        Emit(OpCode::Print, CompileToRegister(*args[i]), i > 0 ? 1 : 0);
+                        next_register_ = arg_mark;
+                    }
+                    Emit(OpCode::PrintNewline);
+                    if (dst != NO_REGISTER) {
+                        Emit(OpCode::LoadNone, dst);
+                    }
+                } else if (const auto *call = dynamic_cast<const ast::MethodCall *>(&stmt)) {
+                    uint32_t object = AllocRegister();
+                    Compile(call->GetObject(), object);
+                    CompileCall(object, call->GetMethodName(), call->GetArgs(), dst);
+                } else if (const auto *new_instance = dynamic_cast<const ast::NewInstance *>(&stmt)) {
+                    CompileNewInstance(*new_instance, dst);
+                } else if (const auto *stringify = dynamic_cast<const ast::Stringify *>(&stmt)) {
+                    CompileUnary(OpCode::Stringify, stringify->GetArgument(), dst);
+                } else if (const auto *not_op = dynamic_cast<const ast::Not *>(&stmt)) {
+                    CompileUnary(OpCode::Not, not_op->GetArgument(), dst);
+                } else if (const auto *add = dynamic_cast<const ast::Add *>(&stmt)) {
+                    CompileBinary(OpCode::Add, *add, dst);
+                } else if (const auto *sub = dynamic_cast<const ast::Sub *>(&stmt)) {
+                    CompileBinary(OpCode::Sub, *sub, dst);
+                } else if (const auto *mult = dynamic_cast<const ast::Mult *>(&stmt)) {
+                    CompileBinary(OpCode::Mult, *mult, dst);
+                } else if (const auto *div = dynamic_cast<const ast::Div *>(&stmt)) {
+                    CompileBinary(OpCode::Div, *div, dst);
+                } else if (const auto *or_op = dynamic_cast<const ast::Or *>(&stmt)) {
+                    CompileBinary(OpCode::Or, *or_op, dst);
+                } else if (const auto *and_op = dynamic_cast<const ast::And *>(&stmt)) {
+                    CompileBinary(OpCode::And, *and_op, dst);
+                } else if (const auto *comparison = dynamic_cast<const ast::Comparison *>(&stmt)) {
+                    CompileComparison(*comparison, dst);
+                } else if (const auto *compound = dynamic_cast<const ast::Compound *>(&stmt)) {
+                    for (const auto &child: compound->GetStatements()) {
+                        Compile(*child, NO_REGISTER);
+                    }
+                    if (dst != NO_REGISTER) {
+                        Emit(OpCode::LoadNone, dst);
+                    }
+                } else if (const auto *ret = dynamic_cast<const ast::Return *>(&stmt)) {
+                    Emit(OpCode::Return, CompileToRegister(ret->GetStatement()));
+                } else if (const auto *class_def = dynamic_cast<const ast::ClassDefinition *>(&stmt)) {
+                    const auto &cls = class_def->GetClass();
+                    uint32_t reg = dst != NO_REGISTER ? dst : AllocRegister();
+                    Emit(OpCode::LoadConst, reg, AddConstant(cls));
+                    StoreVariable(cls.TryAs<runtime::Class>()->GetName(), reg);
+                } else if (const auto *if_else = dynamic_cast<const ast::IfElse *>(&stmt)) {
+                    CompileIfElse(*if_else, dst);
+                } else {
+                    throw CompileError("Unsupported statement in bytecode compiler"s);
+                }
+
+                next_register_ = mark;
+            }
+
+            void CompileConst(ObjectHolder value, uint32_t dst) {
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::LoadConst, dst, AddConstant(std::move(value)));
+                }
+            }
+
+            void CompileVariable(const ast::VariableValue &var, uint32_t dst) {
+                const auto &ids = var.GetDottedIds();
+                // Как и при обходе AST, ошибка в любом звене цепочки называет её целиком
+                const runtime::Symbol path = ids.size() == 1 ? ids.front() : runtime::Symbol(var.GetName());
+                uint32_t current;
+                if (is_method_) {
+                    current = ReadLocal(ids.front(), path);
+                    if (ids.size() == 1) {
+                        EmitMove(dst, current);
+                        return;
+                    }
+                } else {
+                    current = ids.size() == 1 && dst != NO_REGISTER ? dst : AllocRegister();
+                    Emit(OpCode::LoadGlobal, current, AddName(ids.front()), AddName(path));
+                }
+                for (size_t i = 1; i < ids.size(); ++i) {
+                    uint32_t target = i + 1 == ids.size() && dst != NO_REGISTER ? dst : AllocRegister();
+                    function_.field_reads.push_back({ids[i], path});
+                    Emit(OpCode::GetField, target, current, static_cast<uint32_t>(function_.field_reads.size() - 1));
+                    current = target;
+                }
+            }
+
+            void CompileAssignment(const ast::Assignment &assign, uint32_t dst) {
+                const runtime::Symbol name = assign.GetVarName();
+                if (uint32_t reg = FindLocal(name); reg != NO_REGISTER) {
+                    Compile(assign.GetRvalue(), reg);
+                    EmitMove(dst, reg);
+                } else {
+                    uint32_t value = dst != NO_REGISTER ? dst : AllocRegister();
+                    Compile(assign.GetRvalue(), value);
+                    Emit(OpCode::StoreGlobal, value, AddName(name));
+                }
+            }
+
+            // Объект-получатель должен находиться в регистре object, выделенном последним:
+            // аргументы размещаются в регистрах, следующих за ним
+            void CompileCall(uint32_t object, runtime::Symbol method,
+                             const std::vector<std::unique_ptr<ast::Statement>> &args, uint32_t dst) {
+                const uint32_t site = AddCallSite(method, args.size());
+                const size_t check = Emit(OpCode::JumpIfNoMethod, object, 0, site);
+
+                const uint32_t first_arg = next_register_;
+                for (size_t i = 0; i < args.size(); ++i) {
+                    AllocRegister();
+                }
+                for (size_t i = 0; i < args.size(); ++i) {
+                    Compile(*args[i], first_arg + static_cast<uint32_t>(i));
+                }
+                Emit(OpCode::Call, dst, object, site);
+
+                if (dst != NO_REGISTER) {
+                    const size_t skip = Emit(OpCode::Jump);
+                    PatchJump(check);
+                    Emit(OpCode::LoadNone, dst);
+                    PatchJump(skip);
+                } else {
+                    PatchJump(check);
+                }
+            }
+
+            void CompileNewInstance(const ast::NewInstance &new_instance, uint32_t dst) {
+                function_.classes.push_back(&new_instance.GetClass());
+                const auto class_index = static_cast<uint32_t>(function_.classes.size() - 1);
+
+                // Регистр получателя очищается после вызова __init__, поэтому экземпляр
+                // удерживается в отдельном регистре
+                uint32_t instance = AllocRegister();
+                Emit(OpCode::NewInstance, instance, class_index);
+                uint32_t object = AllocRegister();
+                Emit(OpCode::Move, object, instance);
+                CompileCall(object, INIT_METHOD, new_instance.GetArgs(), NO_REGISTER);
+                EmitMove(dst, instance);
+            }
+
+            void CompileUnary(OpCode op, const ast::Statement &argument, uint32_t dst) {
+                uint32_t arg = CompileToRegister(argument);
+                Emit(op, dst != NO_REGISTER ? dst : AllocRegister(), arg);
+            }
+
+            void CompileBinary(OpCode op, const ast::BinaryOperation &operation, uint32_t dst) {
+                uint32_t lhs = CompileToRegister(operation.GetLhs());
+                uint32_t rhs = CompileToRegister(operation.GetRhs());
+                Emit(op, dst != NO_REGISTER ? dst : AllocRegister(), lhs, rhs);
+            }
+
+            void CompileComparison(const ast::Comparison &comparison, uint32_t dst) {
+                static const std::pair<ComparatorFn, OpCode> known_comparators[] = {
+                        {runtime::Equal,          OpCode::Equal},
+                        {runtime::NotEqual,       OpCode::NotEqual},
+                        {runtime::Less,           OpCode::Less},
+                        {runtime::Greater,        OpCode::Greater},
+                        {runtime::LessOrEqual,    OpCode::LessOrEqual},
+                        {runtime::GreaterOrEqual, OpCode::GreaterOrEqual},
+                };
+
+                const auto &cmp = comparison.GetComparator();
+                if (const auto *fn = cmp.target<ComparatorFn>()) {
+                    for (const auto &[known_fn, op]: known_comparators) {
+                        if (*fn == known_fn) {
+                            CompileBinary(op, comparison, dst);
+                            return;
+                        }
+                    }
+                }
+
+                // Произвольный компаратор получает операнды из двух соседних регистров
+                function_.comparators.push_back(cmp);
+                uint32_t lhs = AllocRegister();
+                uint32_t rhs = AllocRegister();
+                Compile(comparison.GetLhs(), lhs);
+                Compile(comparison.GetRhs(), rhs);
+                Emit(OpCode::Compare, dst != NO_REGISTER ? dst : AllocRegister(), lhs,
+                     static_cast<uint32_t>(function_.comparators.size() - 1));
+            }
+
+            void CompileIfElse(const ast::IfElse &if_else, uint32_t dst) {
+                const uint32_t mark = next_register_;
+                const size_t to_else = Emit(OpCode::JumpIfFalse, CompileToRegister(if_else.GetCondition()));
+                next_register_ = mark;
+
+                Compile(if_else.GetIfBody(), dst);
+                const size_t to_end = Emit(OpCode::Jump);
+                PatchJump(to_else);
+                if (if_else.GetElseBody()) {
+                    Compile(*if_else.GetElseBody(), dst);
+                } else if (dst != NO_REGISTER) {
+                    Emit(OpCode::LoadNone, dst);
+                }
+                PatchJump(to_end);
+            }
+
+            Function function_;
+            bool is_method_ = false;
+            std::unordered_map<runtime::Symbol, uint32_t> locals_;
+            std::unordered_map<runtime::Symbol, uint32_t> name_indices_;
+            uint32_t next_register_ = 0;
+            uint32_t max_register_ = 0;
+        };
+
+        [[noreturn]] void ThrowInvalidArguments(const char *operation) {
+            throw std::runtime_error("Invalid arguments in "s + operation);
+        }
+
+        // Возвращает значения обоих операндов, если они являются числами
+        bool AsNumbers(const ObjectHolder &lhs, const ObjectHolder &rhs, int &lhs_value, int &rhs_value) {
+            const auto *lhs_num = lhs.TryAs<runtime::Number>();
+            const auto *rhs_num = lhs_num ? rhs.TryAs<runtime::Number>() : nullptr;
+            if (!rhs_num) {
+                return false;
+            }
+            lhs_value = lhs_num->GetValue();
+            rhs_value = rhs_num->GetValue();
+            return true;
+        }
+
+    }  // namespace
+
+    Function CompileProgram(const ast::Statement &program) {
+        return Compiler{}.CompileProgram(program);
+    }
+
+    Function CompileMethod(const runtime::Method &method) {
+        return Compiler{}.CompileMethod(method);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////
+    //
+    //  VirtualMachine
+
+    ObjectHolder VirtualMachine::Run(const ast::Statement &program, runtime::Closure &globals,
+                                     runtime::Context &context) {
+        const Function function = CompileProgram(program);
+        context_ = &context;
+        globals_ = &globals;
+        // Методы и классы прошлой программы могли быть освобождены, а их адреса - заняты новыми
+        functions_.clear();
+        stack_.clear();
+        EnsureStack(function.register_count);
+        auto result = Execute(function, 0);
+        stack_.clear();
+        return result;
+    }
+
+    void VirtualMachine::EnsureStack(size_t size) {
+        if (stack_.size() < size) {
+            stack_.resize(std::max(size, stack_.size() * 2));
+        }
+    }
+
+    const Function *VirtualMachine::GetFunction(const runtime::Method &method) {
+        auto it = functions_.find(&method);
+        if (it == functions_.end()) {
+            std::unique_ptr<Function> function;
+            try {
+                function = std::make_unique<Function>(CompileMethod(method));
+            } catch (const CompileError &) {
+                // Тело метода будет исполняться обходом AST
+            }
+            it = functions_.emplace(&method, std::move(function)).first;
+        }
+        return it->second.get();
+    }
+
+    ObjectHolder VirtualMachine::CallMethod(const runtime::Method &method, const Function *function,
+                                            size_t callee_base, size_t arg_count) {
+        ObjectHolder result;
+        size_t frame_size;
+        if (function) {
+            frame_size = function->register_count;
+            EnsureStack(callee_base + frame_size);
+            const size_t locals_end = callee_base + function->param_count + function->local_count;
+            for (size_t i = callee_base + function->param_count; i < locals_end; ++i) {
+                stack_[i] = UnboundValue();
+            }
+            result = Execute(*function, callee_base);
+        } else {
+            frame_size = arg_count + 1;
+            // Тело метода исполняется обходом AST и не обращается к стеку виртуальной машины,
+            // а аргументы копируются в кадр вызова до выполнения тела
+            auto *instance = stack_[callee_base].TryAs<runtime::ClassInstance>();
+            result = instance->Call(method, stack_.data() + callee_base + 1, arg_count, *context_);
+        }
+        for (size_t i = callee_base; i < callee_base + frame_size; ++i) {
+            stack_[i] = ObjectHolder::None();
+        }
+        return result;
+    }
+
+    ObjectHolder VirtualMachine::Execute(const Function &function, size_t base) {
+        const Instruction *code = function.code.data();
+        ObjectHolder *regs = &stack_[base];
+        runtime::Context &context = *context_;
+
+        for (size_t pc = 0;;) {
+            const Instruction &ins = code[pc++];
+            switch (ins.op) {
+                case OpCode::LoadConst:
+                    regs[ins.a] = function.constants[ins.b];
+                    break;
+
+                case OpCode::LoadNone:
+                    regs[ins.a] = ObjectHolder::None();
+                    break;
+
+                case OpCode::Move:
+                    regs[ins.a] = regs[ins.b];
+                    break;
+
+                case OpCode::LoadGlobal: {
+                    const auto *value = globals_->Find(function.names[ins.b]);
+                    if (!value) {
+                        runtime::ThrowUnknownVariable(function.names[ins.c].GetText());
+                    }
+                    regs[ins.a] = *value;
+                    break;
+                }
+
+                case OpCode::StoreGlobal: {
+                    ObjectHolder value = regs[ins.a];
+                    value.Retain();
+                    (*globals_)[function.names[ins.b]] = std::move(value);
+                    break;
+                }
+
+                case OpCode::CheckBound:
+                    if (regs[ins.a].Get() == UnboundValue().Get()) {
+                        runtime::ThrowUnknownVariable(function.names[ins.b].GetText());
+                    }
+                    break;
+
+                case OpCode::GetField: {
+                    const FieldRead &read = function.field_reads[ins.c];
+                    const auto *instance = regs[ins.b].TryAs<runtime::ClassInstance>();
+                    const auto *value = instance ? instance->Fields().Find(read.field) : nullptr;
+                    if (!value) {
+                        runtime::ThrowUnknownVariable(read.path.GetText());
+                    }
+                    regs[ins.a] = *value;
+                    break;
+                }
+
+                case OpCode::SetField: {
+                    auto *instance = regs[ins.a].TryAs<runtime::ClassInstance>();
+                    if (!instance) {
+                        throw std::runtime_error("Cannot set field "s + function.names[ins.b].GetText() + " of non-object"s);
+                    }
+                    ObjectHolder value = regs[ins.c];
+                    value.Retain();
+                    instance->Fields()[function.names[ins.b]] = std::move(value);
+                    break;
+                }
+
+                case OpCode::Add: {
+                    const ObjectHolder &lhs = regs[ins.b];
+                    const ObjectHolder &rhs = regs[ins.c];
+                    int lhs_value, rhs_value;
+                    if (AsNumbers(lhs, rhs, lhs_value, rhs_value)) {
+                        regs[ins.a] = ObjectHolder::Own(runtime::Number{lhs_value + rhs_value});
+                        break;
+                    }
+                    const auto *lhs_str = lhs.TryAs<runtime::String>();
+                    const auto *rhs_str = rhs.TryAs<runtime::String>();
+                    if (lhs_str && rhs_str) {
+                        regs[ins.a] = ObjectHolder::Own(runtime::String{lhs_str->GetValue() + rhs_str->GetValue()});
+                        break;
+                    }
+                    const auto *instance = lhs.TryAs<runtime::ClassInstance>();
+                    const auto *method = instance && rhs ? instance->GetClass().FindMethod(ADD_METHOD, 1) : nullptr;
+                    if (method) {
+                        const size_t callee_base = base + function.register_count;
+                        ObjectHolder self = lhs;
+                        ObjectHolder arg = rhs;
+                        EnsureStack(callee_base + 2);
+                        stack_[callee_base] = std::move(self);
+                        stack_[callee_base + 1] = std::move(arg);
+                        auto result = CallMethod(*method, GetFunction(*method), callee_base, 1);
+                        regs = &stack_[base];
+                        regs[ins.a] = std::move(result);
+                        break;
+                    }
+                    ThrowInvalidArguments("Add");
+                }
+
+                case OpCode::Sub: {
+                    int lhs, rhs;
+                    if (!AsNumbers(regs[ins.b], regs[ins.c], lhs, rhs)) {
+                        ThrowInvalidArguments("Sub");
+                    }
+                    regs[ins.a] = ObjectHolder::Own(runtime::Number{lhs - rhs});
+                    break;
+                }
+
+                case OpCode::Mult: {
+                    int lhs, rhs;
+                    if (!AsNumbers(regs[ins.b], regs[ins.c], lhs, rhs)) {
+                        ThrowInvalidArguments("Mul");
+                    }
+                    regs[ins.a] = ObjectHolder::Own(runtime::Number{lhs * rhs});
+                    break;
+                }
+
+                case OpCode::Div: {
+                    int lhs, rhs;
+                    if (!AsNumbers(regs[ins.b], regs[ins.c], lhs, rhs)) {
+                        ThrowInvalidArguments("Div");
+                    }
+                    regs[ins.a] = ObjectHolder::Own(runtime::Number{runtime::Divide(lhs, rhs)});
+                    break;
+                }
+
+#define VM_COMPARISON(op, fn, expr)                                                         \
+                case OpCode::op: {                                                          \
+                    int lhs, rhs;                                                           \
+                    bool result = AsNumbers(regs[ins.b], regs[ins.c], lhs, rhs)             \
+                                  ? (expr)                                                  \
+                                  : runtime::fn(regs[ins.b], regs[ins.c], context);         \
+                    regs = &stack_[base];                                                   \
+                    regs[ins.a] = ObjectHolder::Own(runtime::Bool{result});                 \
+                    break;                                                                  \
+                }
+
+                VM_COMPARISON(Equal, Equal, lhs == rhs)
+                VM_COMPARISON(NotEqual, NotEqual, lhs != rhs)
+                VM_COMPARISON(Less, Less, lhs < rhs)
+                VM_COMPARISON(Greater, Greater, lhs > rhs)
+                VM_COMPARISON(LessOrEqual, LessOrEqual, lhs <= rhs)
+                VM_COMPARISON(GreaterOrEqual, GreaterOrEqual, lhs >= rhs)
+
+#undef VM_COMPARISON
+
+                case OpCode::Compare: {
+                    bool result = function.comparators[ins.c](regs[ins.b], regs[ins.b + 1], context);
+                    regs = &stack_[base];
+                    regs[ins.a] = ObjectHolder::Own(runtime::Bool{result});
+                    break;
+                }
+
+                case OpCode::Or:
+                    if (!regs[ins.b] || !regs[ins.c]) {
+                        ThrowInvalidArguments("Or");
+                    }
+                    regs[ins.a] = ObjectHolder::Own(runtime::Bool{IsTrue(regs[ins.b]) || IsTrue(regs[ins.c])});
+                    break;
+
+                case OpCode::And:
+                    if (!regs[ins.b] || !regs[ins.c]) {
+                        ThrowInvalidArguments("And");
+                    }
+                    regs[ins.a] = ObjectHolder::Own(runtime::Bool{IsTrue(regs[ins.b]) && IsTrue(regs[ins.c])});
+                    break;
+
+                case OpCode::Not:
+                    if (!regs[ins.b]) {
+                        ThrowInvalidArguments("Not");
+                    }
+                    regs[ins.a] = ObjectHolder::Own(runtime::Bool{!IsTrue(regs[ins.b])});
+                    break;
+
+                case OpCode::Stringify: {
+                    ObjectHolder str = runtime::ToString(regs[ins.b], context);
+                    regs = &stack_[base];
+                    regs[ins.a] = std::move(str);
+                    break;
+                }
+
+                case OpCode::Jump:
+                    pc = ins.a;
+                    break;
+
+                case OpCode::JumpIfFalse:
+                    if (!IsTrue(regs[ins.a])) {
+                        pc = ins.b;
+                    }
+                    break;
+
+                case OpCode::JumpIfNoMethod: {
+                    const auto *instance = regs[ins.a].TryAs<runtime::ClassInstance>();
+                    if (!instance) {
+                        pc = ins.b;
+                        break;
+                    }
+                    const CallSite &site = function.call_sites[ins.c];
+                    const runtime::Class *cls = &instance->GetClass();
+                    if (site.cls != cls) {
+                        site.cls = cls;
+                        site.resolved = cls->FindMethod(site.method, site.arg_count);
+                        site.function = site.resolved ? GetFunction(*site.resolved) : nullptr;
+                    }
+                    if (!site.resolved) {
+                        pc = ins.b;
+                    }
+                    break;
+                }
+
+                case OpCode::Call: {
+                    // Разрешение метода выполнено предшествующей инструкцией JumpIfNoMethod
+                    const CallSite &site = function.call_sites[ins.c];
+                    auto result = CallMethod(*site.resolved, site.function, base + ins.b, site.arg_count);
+                    regs = &stack_[base];
+                    if (ins.a != NO_REGISTER) {
+                        regs[ins.a] = std::move(result);
+                    }
+                    break;
+                }
+
+                case OpCode::NewInstance:
+                    regs[ins.a] = ObjectHolder::Own(runtime::ClassInstance{*function.classes[ins.b]});
+                    break;
+
+                case OpCode::Print: {
+                    if (auto *sink = context.GetOutputSink()) {
+                        if (ins.b) {
+                            sink->Write(' ');
+                        }
+                        if (regs[ins.a]) {
+                            regs[ins.a]->PrintTo(*sink, context);
+                            regs = &stack_[base];
+                        } else {
+                            sink->Write("None"sv);
+                        }
+                        break;
+                    }
+                    auto &out = context.GetOutputStream();
+                    if (ins.b) {
+                        out << ' ';
+                    }
+                    if (regs[ins.a]) {
+                        regs[ins.a]->Print(out, context);
+                        regs = &stack_[base];
+                    } else {
+                        out << "None"sv;
+                    }
+                    break;
+                }
+
+                case OpCode::PrintNewline:
+                    if (auto *sink = context.GetOutputSink()) {
+                        sink->Write('\n');
+                    } else {
+                        context.GetOutputStream() << '\n';
+                    }
+                    break;
+
+                case OpCode::Return: {
+                    if (ins.a == NO_REGISTER) {
+                        return ObjectHolder::None();
+                    }
+                    ObjectHolder result = regs[ins.a];
+                    result.Retain();
+                    return result;
+                }
+            }
+        }
+    }
+
+}  // namespace vm
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vm {
+
+    // Номер регистра, означающий, что результат операции не используется
+    inline constexpr std::uint32_t NO_REGISTER = std::numeric_limits<std::uint32_t>::max();
+
+    // Коды операций регистровой виртуальной машины.
+    // Операнды a, b, c - номера регистров текущего кадра, если не указано иное
+    enum class OpCode : std::uint8_t {
+        LoadConst,       // a <- constants[b]
+        LoadNone,        // a <- None
+        Move,            // a <- b
+        LoadGlobal,      // a <- globals[names[b]]; в ошибке называется переменная names[c]
+        StoreGlobal,     // globals[names[b]] <- a
+        CheckBound,      // если переменной a ещё не присвоено значение, выбрасывает runtime_error (имя - names[b])
+        GetField,        // a <- b.fields[field_reads[c].field]
+        SetField,        // a.fields[names[b]] <- c
+        Add,             // a <- b + c
+        Sub,             // a <- b - c
+        Mult,            // a <- b * c
+        Div,             // a <- b / c
+        Equal,           // a <- Bool(b == c)
+        NotEqual,        // a <- Bool(b != c)
+        Less,            // a <- Bool(b < c)
+        Greater,         // a <- Bool(b > c)
+        LessOrEqual,     // a <- Bool(b <= c)
+        GreaterOrEqual,  // a <- Bool(b >= c)
+        Compare,         // a <- Bool(comparators[c](b, b + 1))
+        Or,              // a <- Bool(b or c), оба операнда уже вычислены
+        And,             // a <- Bool(b and c), оба операнда уже вычислены
+        Not,             // a <- Bool(not b)
+        Stringify,       // a <- String(str(b))
+        Jump,            // pc <- a
+        JumpIfFalse,     // если IsTrue(a) == false: pc <- b
+        JumpIfNoMethod,  // если у объекта a нет метода call_sites[c]: pc <- b
+        Call,            // a <- b.call_sites[c](b + 1, ..., b + argc)
+        NewInstance,     // a <- новый экземпляр classes[b], конструктор не вызывается
+        Print,           // выводит значение a; если b != 0, перед ним выводится пробел
+        PrintNewline,    // выводит перевод строки
+        Return,          // завершает функцию и возвращает a (None, если a == NO_REGISTER)
+    };
+
+    struct Instruction {
+        OpCode op;
+        std::uint32_t a = 0;
+        std::uint32_t b = 0;
+        std::uint32_t c = 0;
+    };
+
+    struct Function;
+
+    // Чтение поля в цепочке a.b.c. Ошибка называет всю цепочку path, как при обходе AST
+    struct FieldRead {
+        runtime::Symbol field;
+        runtime::Symbol path;
+    };
+
+    // Точка вызова метода. Хранит результат последнего разрешения метода по классу получателя
+    struct CallSite {
+        runtime::Symbol method;
+        std::uint32_t arg_count = 0;
+
+        mutable const runtime::Class *cls = nullptr;
+        mutable const runtime::Method *resolved = nullptr;
+        mutable const Function *function = nullptr;
+    };
+
+    // Скомпилированное тело метода либо программы верхнего уровня.
+    // Регистры кадра: self, формальные параметры, локальные переменные, временные значения
+    struct Function {
+        std::vector<Instruction> code;
+        std::vector<runtime::ObjectHolder> constants;
+        std::vector<runtime::Symbol> names;
+        std::vector<FieldRead> field_reads;
+        std::vector<CallSite> call_sites;
+        std::vector<const runtime::Class *> classes;
+        std::vector<ast::Comparison::Comparator> comparators;
+
+        std::uint32_t param_count = 0;
+        std::uint32_t local_count = 0;
+        std::uint32_t register_count = 0;
+    };
+
+    // Выбрасывается, если AST содержит инструкцию, которую невозможно перевести в байт-код
+    class CompileError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Компилирует программу верхнего уровня. Переменные программы хранятся в глобальном Closure
+    Function CompileProgram(const ast::Statement &program);
+
+    // Компилирует тело метода. Переменные метода размещаются в регистрах
+    Function CompileMethod(const runtime::Method &method);
+
+    // Регистровая виртуальная машина, исполняющая байт-код вместо обхода AST.
+    // Наблюдаемое поведение программы совпадает с Executable::Execute
+    class VirtualMachine {
+    public:
+        // Компилирует и выполняет программу program. Глобальные переменные программы
+        // хранятся в globals, вывод осуществляется через context
+        runtime::ObjectHolder Run(const ast::Statement &program, runtime::Closure &globals,
+                                  runtime::Context &context);
+
+    private:
+        runtime::ObjectHolder Execute(const Function &function, size_t base);
+
+        // Вызывает метод method. Объект self и arg_count аргументов уже лежат в стеке,
+        // начиная с позиции callee_base
+        runtime::ObjectHolder CallMethod(const runtime::Method &method, const Function *function,
+                                         size_t callee_base, size_t arg_count);
+
+        // Возвращает скомпилированное тело метода либо nullptr, если тело метода
+        // не может быть скомпилировано и должно исполняться обходом AST
+        const Function *GetFunction(const runtime::Method &method);
+
+        void EnsureStack(size_t size);
+
+        runtime::Context *context_ = nullptr;
+        runtime::Closure *globals_ = nullptr;
+        std::vector<runtime::ObjectHolder> stack_;
+        // Скомпилированные тела методов текущей программы. Очищаются в начале каждого Run
+        std::unordered_map<const runtime::Method *, std::unique_ptr<Function>> functions_;
+    };
+
+}  // namespace vm